@@ -0,0 +1,5 @@
+# Package configuration of the Cyclus-free misoenrichment_core library,
+# installed with misoenrichment. Provides the imported target
+# misoenrichment::misoenrichment_core.
+FIND_PACKAGE(Threads REQUIRED)
+INCLUDE("${CMAKE_CURRENT_LIST_DIR}/misoenrichment_core_targets.cmake")
@@ -0,0 +1,148 @@
+#include "cascade_cache.h"
+
+#include <algorithm>
+#include <cmath>
+#include <tuple>
+
+namespace misoenrichment {
+
+// Number of mantissa bits kept when quantising the keys. This corresponds
+// to a relative resolution of roughly 1e-12.
+const int kKeyMantissaBits = 40;
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+bool CascadeCache::Key::operator<(const Key& other) const {
+  return std::tie(values, enrichment_process, use_integer_stages,
+                  use_downblending, enrichment_model, fixed_n_enriching,
+                  fixed_n_stripping)
+         < std::tie(other.values, other.enrichment_process,
+                    other.use_integer_stages, other.use_downblending,
+                    other.enrichment_model, other.fixed_n_enriching,
+                    other.fixed_n_stripping);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+CascadeCache::CascadeCache() : capacity_(kCascadeCacheCapacity), hits_(0),
+                               misses_(0) {}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+CascadeCache& CascadeCache::Instance() {
+  static CascadeCache cache;
+  return cache;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+CascadeCache::Key CascadeCache::MakeKey(
+    const IsotopeArray& feed_composition, double target_product_assay,
+    double target_tails_assay, double gamma_235,
+    EnrichmentProcess enrichment_process, bool use_integer_stages,
+    bool use_downblending, EnrichmentModel enrichment_model,
+    double fixed_n_enriching, double fixed_n_stripping) {
+  Key key;
+  key.enrichment_process = enrichment_process;
+  key.use_integer_stages = use_integer_stages;
+  key.use_downblending = use_downblending;
+  key.enrichment_model = enrichment_model;
+  key.fixed_n_enriching = fixed_n_enriching;
+  key.fixed_n_stripping = fixed_n_stripping;
+
+  std::array<double, kNumIsotopes+3> values;
+  std::copy(feed_composition.begin(), feed_composition.end(),
+            values.begin());
+  values[kNumIsotopes] = target_product_assay;
+  values[kNumIsotopes+1] = target_tails_assay;
+  values[kNumIsotopes+2] = gamma_235;
+
+  for (int i = 0; i < static_cast<int>(values.size()); i++) {
+    int exponent = 0;
+    double mantissa = std::frexp(values[i], &exponent);
+    key.values[2*i] = std::llround(std::ldexp(mantissa, kKeyMantissaBits));
+    key.values[2*i + 1] = exponent;
+  }
+  return key;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+bool CascadeCache::Find(const Key& key, CascadeDesign& design) {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  std::map<Key, DesignList::iterator>::iterator it = index_.find(key);
+  if (it == index_.end()) {
+    misses_++;
+    return false;
+  }
+  hits_++;
+  // Mark the design as the most recently used one.
+  designs_.splice(designs_.begin(), designs_, it->second);
+  design = it->second->second;
+  return true;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void CascadeCache::Insert(const Key& key, const CascadeDesign& design) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (capacity_ <= 0) {
+    return;
+  }
+
+  std::map<Key, DesignList::iterator>::iterator it = index_.find(key);
+  if (it != index_.end()) {
+    it->second->second = design;
+    designs_.splice(designs_.begin(), designs_, it->second);
+    return;
+  }
+  designs_.push_front(std::make_pair(key, design));
+  index_[key] = designs_.begin();
+  Evict_();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void CascadeCache::Clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  designs_.clear();
+  index_.clear();
+  hits_ = 0;
+  misses_ = 0;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+int CascadeCache::size() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return index_.size();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+int CascadeCache::capacity() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return capacity_;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void CascadeCache::capacity(int new_capacity) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  capacity_ = new_capacity;
+  Evict_();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+long long CascadeCache::hits() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return hits_;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+long long CascadeCache::misses() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return misses_;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void CascadeCache::Evict_() {
+  // Must only be called while holding the lock.
+  while (static_cast<int>(designs_.size()) > std::max(capacity_, 0)) {
+    index_.erase(designs_.back().first);
+    designs_.pop_back();
+  }
+}
+
+}  // namespace misoenrichment
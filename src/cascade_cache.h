@@ -0,0 +1,98 @@
+#ifndef MISOENRICHMENT_SRC_CASCADE_CACHE_H_
+#define MISOENRICHMENT_SRC_CASCADE_CACHE_H_
+
+#include <array>
+#include <list>
+#include <map>
+#include <mutex>
+#include <utility>
+
+#include "cascade_design.h"
+#include "core_helper.h"
+#include "enrichment_process.h"
+#include "stage_cascade.h"
+
+namespace misoenrichment {
+
+// Default maximum number of cascade designs held by the cache.
+const int kCascadeCacheCapacity = 1000;
+
+// Process-wide, bounded cache of matched abundance ratio cascade designs.
+//
+// Designing a cascade (i.e., determining the staging) is by far the most
+// expensive part of an enrichment calculation, while the same design is
+// often needed several times per timestep (by the SWU and feed converters,
+// when bidding and when performing the trade). The cache stores the
+// designs using a least recently used (LRU) eviction policy.
+//
+// The keys are built from the normalised feed composition, the target
+// product and tails assays, the U235 separation factor, the enrichment
+// process, the staging options (including a fixed staging) and the
+// enrichment model. The feed, the assays and the separation factor are
+// quantised such that values only differing by floating-point noise share
+// the same key.
+class CascadeCache {
+ public:
+  struct Key {
+    // Quantised feed composition, target product assay, target tails
+    // assay and U235 separation factor, each stored as (mantissa, exponent).
+    std::array<long long, 2*(kNumIsotopes+3)> values;
+    EnrichmentProcess enrichment_process;
+    bool use_integer_stages;
+    bool use_downblending;
+    EnrichmentModel enrichment_model;
+    // Fixed staging (see `CascadeCalculator::FixStaging`), compared
+    // exactly. Zero enriching stages if the staging follows the targets.
+    double fixed_n_enriching;
+    double fixed_n_stripping;
+
+    bool operator<(const Key& other) const;
+  };
+
+  static CascadeCache& Instance();
+
+  static Key MakeKey(const IsotopeArray& feed_composition,
+                     double target_product_assay, double target_tails_assay,
+                     double gamma_235, EnrichmentProcess enrichment_process,
+                     bool use_integer_stages, bool use_downblending,
+                     EnrichmentModel enrichment_model=
+                         EnrichmentModel::kMatchedAbundanceRatio,
+                     double fixed_n_enriching=0,
+                     double fixed_n_stripping=0);
+
+  // Returns true and copies the design into `design` if `key` is present.
+  bool Find(const Key& key, CascadeDesign& design);
+  void Insert(const Key& key, const CascadeDesign& design);
+
+  // Removes all designs and resets the hit and miss counters.
+  void Clear();
+
+  int size();
+  int capacity();
+  void capacity(int new_capacity);
+
+  long long hits();
+  long long misses();
+
+ private:
+  CascadeCache();
+  CascadeCache(const CascadeCache&) = delete;
+  CascadeCache& operator=(const CascadeCache&) = delete;
+
+  void Evict_();
+
+  // The most recently used design is at the front of the list.
+  typedef std::list<std::pair<Key, CascadeDesign> > DesignList;
+  DesignList designs_;
+  std::map<Key, DesignList::iterator> index_;
+
+  int capacity_;
+  long long hits_;
+  long long misses_;
+
+  std::mutex mutex_;
+};
+
+}  // namespace misoenrichment
+
+#endif  // MISOENRICHMENT_SRC_CASCADE_CACHE_H_
@@ -0,0 +1,125 @@
+#include <gtest/gtest.h>
+
+#include "composition.h"
+
+#include "cascade_cache.h"
+#include "enrichment_calculator.h"
+#include "miso_helper.h"
+
+namespace misoenrichment {
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+CascadeDesign DummyDesign(double n_enriching) {
+  CascadeDesign design;
+  design.n_enriching = n_enriching;
+  design.n_stripping = 1;
+  return design;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST(CascadeCacheTest, Key) {
+  IsotopeArray feed = CompMapToIsotopeArray(misotest::comp_natU()->atom());
+  const EnrichmentProcess centrifuge = EnrichmentProcess::kCentrifuge;
+  CascadeCache::Key key = CascadeCache::MakeKey(feed, 0.05, 0.003, 1.4,
+                                                centrifuge, true, true);
+
+  // Floating-point noise must not change the key.
+  IsotopeArray noisy_feed(feed);
+  noisy_feed[kIdx238] *= 1. + 1e-15;
+  CascadeCache::Key noisy_key = CascadeCache::MakeKey(
+      noisy_feed, 0.05*(1.+1e-15), 0.003, 1.4, centrifuge, true, true);
+  EXPECT_FALSE(key < noisy_key);
+  EXPECT_FALSE(noisy_key < key);
+
+  CascadeCache::Key other_key = CascadeCache::MakeKey(
+      feed, 0.05, 0.003, 1.4, centrifuge, false, false);
+  EXPECT_TRUE(key < other_key || other_key < key);
+  other_key = CascadeCache::MakeKey(feed, 0.0501, 0.003, 1.4, centrifuge,
+                                    true, true);
+  EXPECT_TRUE(key < other_key || other_key < key);
+  other_key = CascadeCache::MakeKey(feed, 0.05, 0.003, 1.4,
+                                    EnrichmentProcess::kDiffusion, true, true);
+  EXPECT_TRUE(key < other_key || other_key < key);
+  other_key = CascadeCache::MakeKey(feed, 0.05, 0.003, 1.4, centrifuge, true,
+                                    true,
+                                    EnrichmentModel::kMatchedAbundanceRatio,
+                                    20, 10);
+  EXPECT_TRUE(key < other_key || other_key < key);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST(CascadeCacheTest, LeastRecentlyUsedEviction) {
+  CascadeCache& cache = CascadeCache::Instance();
+  cache.Clear();
+  int initial_capacity = cache.capacity();
+  cache.capacity(2);
+
+  IsotopeArray feed = CompMapToIsotopeArray(misotest::comp_natU()->atom());
+  std::vector<CascadeCache::Key> keys;
+  for (int i = 0; i < 3; i++) {
+    keys.push_back(CascadeCache::MakeKey(feed, 0.05 + 0.01*i, 0.003, 1.4,
+                                         EnrichmentProcess::kCentrifuge,
+                                         true, true));
+  }
+  CascadeDesign design;
+  cache.Insert(keys[0], DummyDesign(0));
+  cache.Insert(keys[1], DummyDesign(1));
+  // Use the first design such that the second one is the least recently
+  // used design and gets evicted.
+  EXPECT_TRUE(cache.Find(keys[0], design));
+  cache.Insert(keys[2], DummyDesign(2));
+
+  EXPECT_EQ(cache.size(), 2);
+  EXPECT_FALSE(cache.Find(keys[1], design));
+  EXPECT_TRUE(cache.Find(keys[2], design));
+  EXPECT_DOUBLE_EQ(design.n_enriching, 2);
+  EXPECT_EQ(cache.hits(), 2);
+  EXPECT_EQ(cache.misses(), 1);
+
+  cache.capacity(initial_capacity);
+  cache.Clear();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST(CascadeCacheTest, EnrichmentCalculatorReusesDesign) {
+  CascadeCache& cache = CascadeCache::Instance();
+  cache.Clear();
+
+  cyclus::Composition::Ptr feed = misotest::comp_natU();
+  EnrichmentCalculator e1(feed, 0.05, 0.003, 1.4, "centrifuge", 100, 1e299,
+                          1e299, true);
+  EXPECT_EQ(cache.misses(), 1);
+  EXPECT_EQ(cache.hits(), 0);
+
+  // Same design, different quantities.
+  EnrichmentCalculator e2(feed, 0.05, 0.003, 1.4, "centrifuge", 1e299, 3,
+                          1e299, true);
+  EXPECT_EQ(cache.misses(), 1);
+  EXPECT_EQ(cache.hits(), 1);
+
+  cyclus::Composition::Ptr product1, product2, tails1, tails2;
+  double feed_qty, swu, product_qty, tails_qty, n_enriching1, n_stripping1;
+  double n_enriching2, n_stripping2;
+  e1.EnrichmentOutput(product1, tails1, feed_qty, swu, product_qty,
+                      tails_qty, n_enriching1, n_stripping1);
+  e2.EnrichmentOutput(product2, tails2, feed_qty, swu, product_qty,
+                      tails_qty, n_enriching2, n_stripping2);
+  EXPECT_DOUBLE_EQ(n_enriching1, n_enriching2);
+  EXPECT_DOUBLE_EQ(n_stripping1, n_stripping2);
+  EXPECT_TRUE(misotest::CompareCompMap(product1->atom(), product2->atom()));
+  EXPECT_TRUE(misotest::CompareCompMap(tails1->atom(), tails2->atom()));
+  EXPECT_DOUBLE_EQ(product_qty, 3);
+
+  cache.Clear();
+}
+
+}  // namespace misoenrichment
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// required to get functionality in cyclus agent unit tests library
+#ifndef CYCLUS_AGENT_TESTS_CONNECTED
+int ConnectAgentTests();
+static int cyclus_agent_tests_connected = ConnectAgentTests();
+#define CYCLUS_AGENT_TESTS_CONNECTED cyclus_agent_tests_connected
+#endif  // CYCLUS_AGENT_TESTS_CONNECTED
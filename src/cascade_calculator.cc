@@ -0,0 +1,889 @@
+#include "cascade_calculator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "cascade_cache.h"
+#include "core_error.h"
+#include "core_helper.h"
+#include "design_store.h"
+
+namespace misoenrichment {
+
+// Lower bound on the number of stages per section for non-integer staging.
+const double kMinDecimalStages = 1e-3;
+// The Newton iteration stops once the sum of the squared relative assay
+// residuals falls below `kDecimalStagesTol`. If it stagnates before, the
+// staging is accepted as long as the sum is below `kDecimalStagesAcceptTol`.
+const double kDecimalStagesTol = 1e-24;
+const double kDecimalStagesAcceptTol = 1e-12;
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+CascadeCalculator::CascadeCalculator(
+    const IsotopeArray& feed_composition,
+    double target_product_assay, double target_tails_assay,
+    double gamma_235, EnrichmentProcess enrichment_process, double feed_qty,
+    double product_qty, double max_swu, bool use_downblending,
+    bool use_integer_stages, EnrichmentModel enrichment_model,
+    double fixed_n_enriching, double fixed_n_stripping,
+    DesignStore* design_store) :
+      use_downblending(use_downblending),
+      use_integer_stages(use_integer_stages),
+      enrichment_model(enrichment_model),
+      fixed_n_enriching(fixed_n_enriching),
+      fixed_n_stripping(fixed_n_stripping),
+      design_store(design_store),
+      feed_composition(feed_composition),
+      target_product_assay(target_product_assay),
+      target_tails_assay(target_tails_assay),
+      target_feed_qty(feed_qty),
+      target_product_qty(product_qty),
+      feed_qty(0.), product_qty(0.),
+      max_swu(max_swu),
+      enrichment_process(enrichment_process),
+      gamma_235(gamma_235) {
+  if (feed_qty==1e299 && product_qty==1e299 && max_swu==1e299) {
+    // TODO think about whether one or two of these variables have to be
+    // defined. Additionally, add an exception that should be thrown.
+  }
+  if (use_downblending && !use_integer_stages) {
+    throw ValueError(
+      "'use_integer_stages' must be 'true' if 'use_downblending' is 'true'"
+    );
+  }
+  CalculateGammaAlphaStar_();
+
+  BuildMatchedAbundanceRatioCascade();
+  CheckFixedStagingProduct_();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void CascadeCalculator::CalculateGammaAlphaStar_() {
+  separation_factors = SeparationFactors(gamma_235, enrichment_process);
+  alpha_star = AlphaStar(gamma_235, enrichment_process);
+  for (int i = 0; i < kNumIsotopes; i++) {
+    log_alpha_star[i] = std::log(alpha_star[i]);
+  }
+
+  // The coefficients of the value function only depend on the separation
+  // factors, see `ValueFunction_`.
+  ValueFunctionCoefficients(separation_factors, value_coefficients,
+                            value_log_term);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void CascadeCalculator::PPrint() {
+  std::cout << "- - - - - - - - - - - - - - - - - - - - - -\n"
+            << "MIso Enrichment Calculator with parameters:\n"
+            << "  Target product assay   " << target_product_assay << "\n"
+            << "  Target tails assay     " << target_tails_assay << "\n"
+            << "  Maximum SWU            " << max_swu << "\n\n"
+            << "  Feed quantity          " << feed_qty << "\n"
+            << "  Product quantity       " << product_qty << "\n"
+            << "  Tails quantity         " << tails_qty << "\n"
+            << "  Separative work used   " << swu << "\n\n"
+            << "  n(enriching)           " << n_enriching << "\n"
+            << "  n(stripping)           " << n_stripping << "\n"
+            << "  Enrichment process     "
+            << EnrichmentProcessName(enrichment_process) << "\n"
+            << "  Enrichment model       "
+            << EnrichmentModelName(enrichment_model) << "\n"
+            << "  Separation factors         232     233      234      235"
+            << "      236      238\n                         ";
+  for (int i = 0; i < kNumIsotopes; i++) {
+    printf("%6.4f   ", separation_factors[i]);
+  }
+  const std::array<int, kNumIsotopes>& isotopes = IsotopesNucID();
+  std::cout << "\n  Compositions (atom fraction)\n"
+            << "  Isotope         Feed     Product       Tails\n";
+  for (int i = 0; i < kNumIsotopes; i++) {
+    printf("      %3d   %10.4e  %10.4e  %10.4e\n",
+        NucIDToIsotope(isotopes[i]), feed_composition[i],
+        product_composition[i], tails_composition[i]);
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void CascadeCalculator::SetInput(
+    const IsotopeArray& new_feed_composition,
+    double new_target_product_assay, double new_target_tails_assay,
+    double new_feed_qty, double new_product_qty, double new_max_swu,
+    double new_gamma_235, EnrichmentProcess new_enrichment_process,
+    bool new_use_downblending, bool new_use_integer_stages,
+    EnrichmentModel new_enrichment_model) {
+  if (new_use_downblending && !new_use_integer_stages) {
+    throw ValueError(
+      "'use_integer_stages' must be 'true' if 'use_downblending' is 'true'"
+    );
+  }
+  IsotopeArray new_compmap = new_feed_composition;
+
+  // The staging (and thus the product and tails compositions) only depends
+  // on the feed composition, the target assays, the separation factors and
+  // on whether or not an integer number of stages is used (and on the
+  // enrichment model). If none of these change, then only the flows need
+  // to be recalculated.
+  // A fixed staging does not depend on the target assays.
+  bool new_targets = new_target_product_assay != target_product_assay
+                     || new_target_tails_assay != target_tails_assay;
+  bool redesign_cascade = new_compmap != feed_composition
+      || (new_targets && !HasFixedStaging())
+      || new_use_integer_stages != use_integer_stages
+      || new_enrichment_model != enrichment_model;
+
+  if (new_gamma_235 != gamma_235
+      || new_enrichment_process != enrichment_process) {
+    gamma_235 = new_gamma_235;
+    enrichment_process = new_enrichment_process;
+    CalculateGammaAlphaStar_();
+    redesign_cascade = true;
+  }
+  feed_composition = new_compmap;
+  target_product_assay = new_target_product_assay;
+  target_tails_assay = new_target_tails_assay;
+
+  target_feed_qty = new_feed_qty;
+  target_product_qty = new_product_qty;
+  max_swu = new_max_swu;
+
+  use_downblending = new_use_downblending;
+  use_integer_stages = new_use_integer_stages;
+  enrichment_model = new_enrichment_model;
+
+  if (redesign_cascade) {
+    BuildMatchedAbundanceRatioCascade();
+  } else {
+    if (HasFixedStaging()) {
+      design.target_product_assay = target_product_assay;
+    }
+    RecalculateFlows_();
+  }
+  CheckFixedStagingProduct_();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void CascadeCalculator::FixStaging(double n_enriching,
+                                   double n_stripping) {
+  if (n_enriching != 0 || n_stripping != 0) {
+    CheckFixedStaging_(n_enriching, n_stripping);
+  }
+  fixed_n_enriching = n_enriching;
+  fixed_n_stripping = n_stripping;
+  BuildMatchedAbundanceRatioCascade();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void CascadeCalculator::EnrichBatch(
+    const IsotopeArray& new_feed_composition,
+    const std::vector<double>& product_assays,
+    const std::vector<double>& product_qtys, double new_tails_assay,
+    double new_feed_qty, double new_max_swu, double new_gamma_235,
+    EnrichmentProcess new_enrichment_process, bool new_use_downblending,
+    bool new_use_integer_stages, EnrichmentModel new_enrichment_model,
+    BatchedFlows& flows) const {
+  if (product_assays.size() != product_qtys.size()) {
+    throw ValueError(
+      "'product_assays' and 'product_qtys' must have the same size"
+    );
+  }
+  if (new_use_downblending && !new_use_integer_stages) {
+    throw ValueError(
+      "'use_integer_stages' must be 'true' if 'use_downblending' is 'true'"
+    );
+  }
+  // The designs are determined by a copy holding the parameters of the
+  // batch, such that the state of this calculator does not change.
+  CascadeCalculator batch(*this);
+  if (new_gamma_235 != gamma_235
+      || new_enrichment_process != enrichment_process) {
+    batch.gamma_235 = new_gamma_235;
+    batch.enrichment_process = new_enrichment_process;
+    batch.CalculateGammaAlphaStar_();
+  }
+  batch.feed_composition = new_feed_composition;
+  batch.target_tails_assay = new_tails_assay;
+  batch.use_downblending = new_use_downblending;
+  batch.use_integer_stages = new_use_integer_stages;
+  batch.enrichment_model = new_enrichment_model;
+  batch.CheckDesignOptions_();
+
+  // Requests with the same product assay share their design.
+  std::vector<double> design_assays(product_assays);
+  std::sort(design_assays.begin(), design_assays.end());
+  design_assays.erase(std::unique(design_assays.begin(),
+                                  design_assays.end()),
+                      design_assays.end());
+  int n_requests = product_assays.size();
+  std::vector<int> design_index(n_requests);
+  for (int r = 0; r < n_requests; r++) {
+    design_index[r] = std::lower_bound(design_assays.begin(),
+                                       design_assays.end(),
+                                       product_assays[r])
+                      - design_assays.begin();
+  }
+
+  int n_designs = design_assays.size();
+  std::vector<CascadeDesign> designs(n_designs);
+  std::vector<CascadeCache::Key> keys(n_designs);
+  // Designs whose concentrations are evaluated at once below, only their
+  // staging is determined in the following loop.
+  bool batch_concentrations = batch.use_integer_stages
+      && batch.enrichment_model == EnrichmentModel::kMatchedAbundanceRatio
+      && !batch.HasFixedStaging();
+  std::vector<int> searched;
+  std::vector<double> n_enriching;
+  std::vector<double> n_stripping;
+  for (int d = 0; d < n_designs; d++) {
+    batch.target_product_assay = design_assays[d];
+    keys[d] = batch.DesignKey_();
+    if (batch.FindDesign_(keys[d])) {
+      designs[d] = batch.design;
+    } else if (batch_concentrations) {
+      batch.SearchIntegerStages_();
+      searched.push_back(d);
+      n_enriching.push_back(batch.n_enriching);
+      n_stripping.push_back(batch.n_stripping);
+    } else {
+      batch.DesignCascade_();
+      designs[d] = batch.design;
+      CascadeCache::Instance().Insert(keys[d], designs[d]);
+    }
+  }
+
+  if (!searched.empty()) {
+    std::array<std::vector<double>, kNumIsotopes> product_compositions;
+    std::array<std::vector<double>, kNumIsotopes> tails_compositions;
+    std::vector<double> sum_e;
+    std::vector<double> sum_s;
+    CalculateConcentrations(batch.log_alpha_star, batch.feed_composition,
+                            n_enriching, n_stripping, product_compositions,
+                            tails_compositions, sum_e, sum_s);
+    double value_feed = batch.ValueFunction_(batch.feed_composition);
+    for (int k = 0; k < static_cast<int>(searched.size()); k++) {
+      CascadeDesign& design = designs[searched[k]];
+      design.n_enriching = n_enriching[k];
+      design.n_stripping = n_stripping[k];
+      design.feed_composition = batch.feed_composition;
+      for (int i = 0; i < kNumIsotopes; i++) {
+        design.product_composition[i] = product_compositions[i][k];
+        design.tails_composition[i] = tails_compositions[i][k];
+      }
+      design.target_product_assay = design_assays[searched[k]];
+      design.sum_e = sum_e[k];
+      design.sum_s = sum_s[k];
+      design.value_feed = value_feed;
+      design.value_product = batch.ValueFunction_(design.product_composition);
+      design.value_tails = batch.ValueFunction_(design.tails_composition);
+      design.swu_per_feed = StreamSwuPerFeed(design);
+      batch.n_enriching = design.n_enriching;
+      batch.n_stripping = design.n_stripping;
+      batch.product_composition = design.product_composition;
+      batch.tails_composition = design.tails_composition;
+      batch.target_product_assay = design.target_product_assay;
+      batch.CheckIntegerStages_();
+      CascadeCache::Instance().Insert(keys[searched[k]], design);
+    }
+  }
+  for (int d = 0; d < n_designs; d++) {
+    if (design_store != NULL) {
+      design_store->Insert(keys[d], designs[d]);
+    }
+    if (batch.HasFixedStaging()) {
+      designs[d].target_product_assay = design_assays[d];
+      batch.design = designs[d];
+      batch.target_product_assay = design_assays[d];
+      batch.CheckFixedStagingProduct_();
+    }
+  }
+
+  CalculateFlows(designs, design_index, new_feed_qty, product_qtys,
+                 new_max_swu, new_use_downblending, flows);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+EnrichmentResult CascadeCalculator::Result() const {
+  EnrichmentResult result;
+  result.flows.feed_qty = feed_qty;
+  result.flows.product_qty = product_qty;
+  result.flows.tails_qty = tails_qty;
+  result.flows.swu = swu;
+  result.flows.product_composition = product_composition;
+  result.tails_composition = tails_composition;
+  result.n_enriching = n_enriching;
+  result.n_stripping = n_stripping;
+  return result;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+FlowSensitivities CascadeCalculator::Sensitivities() const {
+  if (enrichment_model == EnrichmentModel::kStageByStage) {
+    throw ValueError(
+      "Sensitivities are not available for the 'stage_by_stage' enrichment "
+      "model"
+    );
+  }
+  typedef std::array<SensitivityDual, kNumIsotopes> DualIsotopeArray;
+
+  SensitivityDual product_assay = SensitivityDual::Variable(
+      target_product_assay, kSensitivityProductAssay);
+  SensitivityDual tails_assay = SensitivityDual::Variable(
+      target_tails_assay, kSensitivityTailsAssay);
+  SensitivityDual gamma = SensitivityDual::Variable(gamma_235,
+                                                    kSensitivityGamma235);
+  DualIsotopeArray feed;
+  SensitivityDual feed_total = 0.;
+  for (int i = 0; i < kNumIsotopes; i++) {
+    feed[i] = SensitivityDual::Variable(feed_composition[i],
+                                        kSensitivityFeed + i);
+    feed_total += feed[i];
+  }
+  for (int i = 0; i < kNumIsotopes; i++) {
+    feed[i] /= feed_total;
+  }
+
+  // Same calculations as in `CalculateGammaAlphaStar_`.
+  DualIsotopeArray factors;
+  switch (enrichment_process) {
+    case EnrichmentProcess::kCentrifuge:
+      factors = BasicSeparationFactors<CentrifugeProcess>(gamma);
+      break;
+    case EnrichmentProcess::kDiffusion:
+      factors = BasicSeparationFactors<DiffusionProcess>(gamma);
+      break;
+  }
+  DualIsotopeArray log_alpha;
+  DualIsotopeArray coefficients;
+  for (int i = 0; i < kNumIsotopes; i++) {
+    log_alpha[i] = log(factors[i] / sqrt(factors[kIdx235]));
+    SensitivityDual k = (factors[i]-1.) / (factors[kIdx235]-1.);
+    coefficients[i] = value_log_term[i] ? SensitivityDual(0.)
+                                        : 1. / (2.*k - 1.);
+  }
+
+  BasicCascadeDesign<SensitivityDual> dual_design;
+  dual_design.n_enriching = n_enriching;
+  dual_design.n_stripping = n_stripping;
+  if (!use_integer_stages && !HasFixedStaging()) {
+    // The staging n solves F(n, p) = 0 with F being the deviations of the
+    // U235 product and tails assays from their targets and p being the
+    // parameters. Hence, dn/dp = -(dF/dn)^-1 dF/dp, where dF/dp is
+    // obtained by evaluating the concentrations at a fixed staging.
+    CalculateConcentrations(log_alpha, feed, dual_design.n_enriching,
+                            dual_design.n_stripping,
+                            dual_design.product_composition,
+                            dual_design.tails_composition, dual_design.sum_e,
+                            dual_design.sum_s);
+    SensitivityDual residual[2] = {
+        dual_design.product_composition[kIdx235] - product_assay,
+        dual_design.tails_composition[kIdx235] - tails_assay};
+    double jacobian[2][2];
+    AssayJacobian_(jacobian);
+    double det = jacobian[0][0]*jacobian[1][1] - jacobian[0][1]*jacobian[1][0];
+    for (int k = 0; k < kNumSensitivityParameters; k++) {
+      double d_residual[2] = {residual[0].gradient[k],
+                              residual[1].gradient[k]};
+      dual_design.n_enriching.gradient[k] =
+          -(jacobian[1][1]*d_residual[0] - jacobian[0][1]*d_residual[1]) / det;
+      dual_design.n_stripping.gradient[k] =
+          -(jacobian[0][0]*d_residual[1] - jacobian[1][0]*d_residual[0]) / det;
+    }
+  }
+  CalculateConcentrations(log_alpha, feed, dual_design.n_enriching,
+                          dual_design.n_stripping,
+                          dual_design.product_composition,
+                          dual_design.tails_composition, dual_design.sum_e,
+                          dual_design.sum_s);
+
+  dual_design.feed_composition = feed;
+  dual_design.target_product_assay = product_assay;
+  dual_design.value_feed = ValueFunction(feed, coefficients, value_log_term);
+  dual_design.value_product = ValueFunction(dual_design.product_composition,
+                                            coefficients, value_log_term);
+  dual_design.value_tails = ValueFunction(dual_design.tails_composition,
+                                          coefficients, value_log_term);
+  dual_design.swu_per_feed = StreamSwuPerFeed(dual_design);
+
+  return CalculateFlows(dual_design, target_feed_qty, target_product_qty,
+                        max_swu, use_downblending);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void CascadeCalculator::BuildMatchedAbundanceRatioCascade() {
+  CheckDesignOptions_();
+  // Only design the cascade if the same design has not been determined
+  // before.
+  CascadeCache::Key key = DesignKey_();
+  if (!FindDesign_(key)) {
+    DesignCascade_();
+    CascadeCache::Instance().Insert(key, design);
+  }
+  // Designs found in the cache may not be in the store yet, e.g., if they
+  // were calculated by a calculator without store.
+  if (design_store != NULL) {
+    design_store->Insert(key, design);
+  }
+  if (HasFixedStaging()) {
+    design.target_product_assay = target_product_assay;
+  }
+  RecalculateFlows_();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void CascadeCalculator::CheckDesignOptions_() const {
+  if (enrichment_model == EnrichmentModel::kStageByStage
+      && !use_integer_stages) {
+    throw ValueError(
+      "'use_integer_stages' must be 'true' if the 'stage_by_stage' "
+      "enrichment model is used"
+    );
+  }
+  if (HasFixedStaging() || fixed_n_stripping != 0) {
+    CheckFixedStaging_(fixed_n_enriching, fixed_n_stripping);
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+CascadeCache::Key CascadeCalculator::DesignKey_() const {
+  // A fixed staging yields the same design for all targets.
+  return CascadeCache::MakeKey(
+      feed_composition, HasFixedStaging() ? 0 : target_product_assay,
+      HasFixedStaging() ? 0 : target_tails_assay, gamma_235,
+      enrichment_process, use_integer_stages, use_downblending,
+      enrichment_model, fixed_n_enriching, fixed_n_stripping);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+bool CascadeCalculator::FindDesign_(const CascadeCache::Key& key) {
+  CascadeCache& cache = CascadeCache::Instance();
+  if (cache.Find(key, design)) {
+    return true;
+  }
+  if (design_store != NULL && design_store->Find(key, design)) {
+    cache.Insert(key, design);
+    return true;
+  }
+  return false;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void CascadeCalculator::DesignCascade_() {
+  if (HasFixedStaging()) {
+    n_enriching = fixed_n_enriching;
+    n_stripping = fixed_n_stripping;
+    CalculateConcentrations_();
+  } else if (use_integer_stages) {
+    CalculateIntegerStages_();
+  } else {
+    CalculateDecimalStages_();
+  }
+  double stage_swu_per_feed = 0;
+  if (enrichment_model == EnrichmentModel::kStageByStage) {
+    stage_swu_per_feed = SimulateStages_();
+  }
+  design.n_enriching = n_enriching;
+  design.n_stripping = n_stripping;
+  design.feed_composition = feed_composition;
+  design.product_composition = product_composition;
+  design.tails_composition = tails_composition;
+  design.target_product_assay = target_product_assay;
+  design.sum_e = sum_e;
+  design.sum_s = sum_s;
+  design.value_feed = ValueFunction_(feed_composition);
+  design.value_product = ValueFunction_(product_composition);
+  design.value_tails = ValueFunction_(tails_composition);
+  // The separative work performed by the stages exceeds the one of the
+  // product and tails due to the mixing losses.
+  design.swu_per_feed = enrichment_model == EnrichmentModel::kStageByStage
+                        ? stage_swu_per_feed : StreamSwuPerFeed(design);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void CascadeCalculator::CheckFixedStaging_(double n_enriching,
+                                           double n_stripping) const {
+  if (!(n_enriching > 0) || !(n_stripping >= 0)
+      || !std::isfinite(n_enriching) || !std::isfinite(n_stripping)) {
+    throw ValueError(
+      "A fixed staging needs a positive number of enriching stages and a "
+      "non-negative number of stripping stages"
+    );
+  }
+  if (use_integer_stages
+      && (n_enriching != std::round(n_enriching)
+          || n_stripping != std::round(n_stripping))) {
+    throw ValueError(
+      "The fixed staging must consist of integer numbers of stages if "
+      "'use_integer_stages' is 'true'"
+    );
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void CascadeCalculator::CheckFixedStagingProduct_() const {
+  // Downblending can only lower the product assay.
+  if (HasFixedStaging()
+      && design.product_composition[kIdx235] < target_product_assay) {
+    std::stringstream msg;
+    msg << "The fixed staging of " << fixed_n_enriching << " enriching and "
+        << fixed_n_stripping << " stripping stages yields a product assay "
+        << "of " << design.product_composition[kIdx235] << ", which is "
+        << "below the target product assay " << target_product_assay
+        << ".";
+    throw ValueError(msg.str());
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void CascadeCalculator::RecalculateFlows_() {
+  CascadeFlows flows = CalculateFlows(design, target_feed_qty,
+                                      target_product_qty, max_swu,
+                                      use_downblending);
+  feed_qty = flows.feed_qty;
+  product_qty = flows.product_qty;
+  tails_qty = flows.tails_qty;
+  swu = flows.swu;
+
+  n_enriching = design.n_enriching;
+  n_stripping = design.n_stripping;
+  product_composition = flows.product_composition;
+  tails_composition = design.tails_composition;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void CascadeCalculator::CalculateIntegerStages_() {
+  SearchIntegerStages_();
+  // The last evaluation of the search is not necessarily the final
+  // staging, hence recalculate the concentrations.
+  CalculateConcentrations_();
+  CheckIntegerStages_();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void CascadeCalculator::SearchIntegerStages_() {
+  // The target concentrations should always be reached or exceeded (i.e.,
+  // at least equal U235 concentration in product, at most equal
+  // U235 concentration in tails). The enriching section is determined
+  // first (without any stripping stages), then the stripping section is
+  // determined using the number of enriching stages found.
+  n_enriching = 0;
+  n_stripping = 0;
+  n_enriching = SmallestIntegerStages_(true);
+  n_stripping = SmallestIntegerStages_(false);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void CascadeCalculator::CheckIntegerStages_() const {
+  if (!IntegerStagingReachesTargets(n_enriching, n_stripping,
+                                    tails_composition[kIdx235],
+                                    target_tails_assay)) {
+    std::stringstream msg;
+    msg << "Unable to determine the number of stages! The staging of "
+        << n_enriching << " enriching and " << n_stripping << " stripping "
+        << "stages does not reach the target product assay "
+        << target_product_assay << " and tails assay " << target_tails_assay
+        << ".";
+    throw Error(msg.str());
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+int CascadeCalculator::SmallestIntegerStages_(bool enriching_section) {
+  return SmallestIntegerStages([this, enriching_section](int n_stages) {
+    return IntegerStagesReachTarget_(enriching_section, n_stages);
+  });
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+bool CascadeCalculator::IntegerStagesReachTarget_(bool enriching_section,
+                                                  int n_stages) {
+  if (enriching_section) {
+    n_enriching = n_stages;
+    CalculateConcentrations_();
+    return !(product_composition[kIdx235] < target_product_assay);
+  }
+  n_stripping = n_stages;
+  CalculateConcentrations_();
+  return !(tails_composition[kIdx235] > target_tails_assay);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void CascadeCalculator::CalculateDecimalStages_() {
+  // Between two calls, the targets and the feed usually change only
+  // slightly, such that the previous solution is the best initial guess.
+  // If the solver does not converge from there, fall back to the estimate.
+  bool found_solution = false;
+  if (has_previous_decimal_stages) {
+    n_enriching = previous_n_enriching;
+    n_stripping = previous_n_stripping;
+    found_solution = SolveDecimalStages_();
+  }
+  if (!found_solution) {
+    InitialDecimalStages_();
+    found_solution = SolveDecimalStages_();
+  }
+  if (!found_solution) {
+    double residual[2];
+    StagingResidual_(residual);
+    std::stringstream msg;
+    msg << "Did not manage to determine the correct staging! Target "
+        << "product assay " << target_product_assay << ", target tails "
+        << "assay " << target_tails_assay << ", feed assay "
+        << feed_composition[kIdx235] << ", gamma_235 " << gamma_235
+        << ", last staging " << n_enriching << " enriching and "
+        << n_stripping << " stripping stages with relative product and "
+        << "tails assay residuals " << residual[0] << " and "
+        << residual[1] << ".";
+    throw Error(msg.str());
+  }
+  has_previous_decimal_stages = true;
+  previous_n_enriching = n_enriching;
+  previous_n_stripping = n_stripping;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+double CascadeCalculator::SimulateStages_() {
+  // The staging of the matched abundance ratio cascade is kept and the
+  // common stage cut is chosen such that the stages perform the same
+  // separative work as the ideal ones, i.e., both cascades consist of the
+  // same machines. Due to the mixing of streams with different
+  // compositions, part of this separative work is lost and the product and
+  // tails assays deviate from the ones of the ideal cascade.
+  double swu_per_feed = ValueFunction_(product_composition)*sum_e
+                        + ValueFunction_(tails_composition)*sum_s
+                        - ValueFunction_(feed_composition);
+  StageCascadeResult stages = StageCascadeForSeparativeWork(
+      separation_factors, feed_composition, std::lround(n_enriching),
+      std::lround(n_stripping), swu_per_feed);
+
+  product_composition = stages.product_composition;
+  tails_composition = stages.tails_composition;
+  sum_e = stages.product_per_feed;
+  sum_s = stages.tails_per_feed;
+  return stages.swu_per_feed;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+bool CascadeCalculator::SolveDecimalStages_() {
+  // The staging is the root of the two equations
+  //   x_p(n_e, n_s) = target product assay,
+  //   x_t(n_e, n_s) = target tails assay,
+  // (U235 only) which is determined using Newton's method with the
+  // analytic Jacobian. Each step is projected onto the allowed range of
+  // stages and safeguarded by a backtracking line search on the sum of the
+  // squared relative residuals.
+  const double n_min = kMinDecimalStages;
+  const double n_max = kIterMax;
+
+  double residual[2];
+  double merit = StagingResidual_(residual);
+
+  for (int iter = 0; iter < kIterMax && merit > kDecimalStagesTol; iter++) {
+    double jacobian[2][2];
+    AssayJacobian_(jacobian);
+    for (int j = 0; j < 2; j++) {
+      jacobian[0][j] /= target_product_assay;
+      jacobian[1][j] /= target_tails_assay;
+    }
+
+    double step[2];
+    double det = jacobian[0][0]*jacobian[1][1] - jacobian[0][1]*jacobian[1][0];
+    if (det != 0 && std::isfinite(det)) {
+      step[0] = (-residual[0]*jacobian[1][1] + residual[1]*jacobian[0][1])
+                / det;
+      step[1] = (-residual[1]*jacobian[0][0] + residual[0]*jacobian[1][0])
+                / det;
+    } else {
+      // Singular Jacobian: fall back to a steepest descent step.
+      double grad[2];
+      for (int j = 0; j < 2; j++) {
+        grad[j] = residual[0]*jacobian[0][j] + residual[1]*jacobian[1][j];
+      }
+      double norm = grad[0]*grad[0] + grad[1]*grad[1];
+      if (!(norm > 0)) {
+        break;
+      }
+      step[0] = -merit * grad[0] / norm;
+      step[1] = -merit * grad[1] / norm;
+    }
+
+    double n_enriching_old = n_enriching;
+    double n_stripping_old = n_stripping;
+    double lambda = 1.;
+    double trial_merit = merit;
+    bool accepted = false;
+    for (int i = 0; i < 50 && !accepted; i++, lambda /= 2) {
+      n_enriching = std::min(std::max(n_enriching_old + lambda*step[0],
+                                      n_min), n_max);
+      n_stripping = std::min(std::max(n_stripping_old + lambda*step[1],
+                                      n_min), n_max);
+      trial_merit = StagingResidual_(residual);
+      accepted = trial_merit < (1.-1e-4*lambda) * merit;
+    }
+    if (!accepted) {
+      // No further progress is possible, e.g., because the solution lies
+      // outside of the bounds or because machine precision is reached.
+      n_enriching = n_enriching_old;
+      n_stripping = n_stripping_old;
+      merit = StagingResidual_(residual);
+      break;
+    }
+    merit = trial_merit;
+  }
+
+  return merit < kDecimalStagesAcceptTol;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void CascadeCalculator::InitialDecimalStages_() {
+  // For a large number of stages, Eqs. (37), (39), (47) and (50) yield
+  //   R_p / R_f = alpha*_238^(-n_e)  and  R_f / R_t = alpha*_235^(n_s+1),
+  // with R being the U235/U238 abundance ratio.
+  double feed_ratio = feed_composition[kIdx235] / feed_composition[kIdx238];
+  double product_ratio = target_product_assay / (1.-target_product_assay);
+  double tails_ratio = target_tails_assay / (1.-target_tails_assay);
+
+  n_enriching = -std::log(product_ratio/feed_ratio)
+                / log_alpha_star[kIdx238];
+  n_stripping = std::log(feed_ratio/tails_ratio)
+                / log_alpha_star[kIdx235] - 1.;
+
+  // The negated comparisons also catch NaNs, e.g., for infeasible targets.
+  if (!(n_enriching > 1)) {
+    n_enriching = 1;
+  }
+  if (!(n_stripping > 1)) {
+    n_stripping = 1;
+  }
+  n_enriching = std::min(n_enriching, static_cast<double>(kIterMax));
+  n_stripping = std::min(n_stripping, static_cast<double>(kIterMax));
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+double CascadeCalculator::StagingResidual_(double residual[2]) {
+  CalculateConcentrations_();
+  residual[0] = (product_composition[kIdx235]-target_product_assay)
+                / target_product_assay;
+  residual[1] = (tails_composition[kIdx235]-target_tails_assay)
+                / target_tails_assay;
+  return residual[0]*residual[0] + residual[1]*residual[1];
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+double CascadeCalculator::ValueFunction_(
+    const IsotopeArray& composition) const {
+  double value = 0.;
+
+  if (!(composition[kIdx235] > 0) || !(composition[kIdx238] > 0)) {
+    bool empty = true;
+    for (double x : composition) {
+      empty = empty && x == 0;
+    }
+    if (empty) {
+      // This case can happen, e.g., during initalisation and is not a bug.
+      return value;
+    }
+    // Else, throw an error.
+    std::stringstream msg;
+    msg << "No U-235 or U-238 present in composition passed to "
+        << "'CascadeCalculator::ValueFunction_'.";
+    throw KeyError(msg.str());
+  }
+
+  // Isotopes with k_i = 0.5 use a logarithmic term. This formula is not
+  // included in de la Garza 1963, it is taken from the preceding article,
+  // see Eq. (26) in:
+  // A. de la Garza et al., 'Multicomponent isotope separation in
+  // cascades'. Chemical Engineering Science 15, pp. 188-209 (1961).
+  return ValueFunction(composition, value_coefficients, value_log_term);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void CascadeCalculator::CalculateConcentrations_() {
+  // Variable naming follows E. von Halle, the equation numbers also refer
+  // to his article.
+  CalculateConcentrations(log_alpha_star, feed_composition, n_enriching,
+                          n_stripping, product_composition, tails_composition,
+                          sum_e, sum_s);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void CascadeCalculator::AssayJacobian_(double jacobian[2][2]) const {
+  // With r_i = s_i / e_i, the fraction of isotope i leaving the cascade via
+  // the product is E_i = e_i / (e_i+s_i) = 1 / (1+r_i) and the one leaving
+  // via the tails is 1 - E_i, see also `CalculateConcentrations_`.
+  double sum_e = 0;
+  double sum_s = 0;
+  double d_sum_e[2] = {0, 0};
+  double frac_235 = 0;
+  double d_frac_235[2] = {0, 0};
+
+  for (int i = 0; i < kNumIsotopes; i++) {
+    double log_alpha = log_alpha_star[i];
+    // alpha*^(n_s+1) - 1
+    double expm1_stripping = std::expm1((n_stripping+1.)*log_alpha);
+
+    double r = TailsToProductRatio(log_alpha, n_enriching, n_stripping);
+    double dr_dn_enriching = log_alpha * std::exp(-n_enriching*log_alpha)
+                             / expm1_stripping;
+    double dr_dn_stripping = -r * log_alpha * (expm1_stripping+1.)
+                             / expm1_stripping;
+
+    double frac = 1. / (1.+r);
+    double d_frac[2] = {-frac * frac * dr_dn_enriching,
+                        -frac * frac * dr_dn_stripping};
+
+    double atom_frac = feed_composition[i];
+    sum_e += atom_frac * frac;
+    sum_s += atom_frac / (1.+1./r);
+    for (int j = 0; j < 2; j++) {
+      d_sum_e[j] += atom_frac * d_frac[j];
+    }
+    if (i == kIdx235) {
+      frac_235 = frac;
+      d_frac_235[0] = d_frac[0];
+      d_frac_235[1] = d_frac[1];
+    }
+  }
+
+  // Derivatives of x_p = x_f E / sum_e and x_t = x_f (1-E) / sum_s, where
+  // the derivative of sum_s is the negative one of sum_e.
+  double feed_235 = feed_composition[kIdx235];
+  for (int j = 0; j < 2; j++) {
+    jacobian[0][j] = feed_235 * (d_frac_235[j]*sum_e - frac_235*d_sum_e[j])
+                     / (sum_e*sum_e);
+    jacobian[1][j] = feed_235 * (-d_frac_235[j]*sum_s
+                                 + (1.-frac_235)*d_sum_e[j])
+                     / (sum_s*sum_s);
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+EnrichmentResult EvaluateEnrichment(const EnrichmentInput& input) {
+  CascadeCalculator calculator(
+      input.feed_composition, input.product_assay, input.tails_assay,
+      input.gamma_235, input.enrichment_process, input.feed_qty,
+      input.product_qty, input.max_swu, input.use_downblending,
+      input.use_integer_stages, input.enrichment_model,
+      input.fixed_n_enriching, input.fixed_n_stripping, input.design_store);
+  return calculator.Result();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+CascadeDesign FixedStagingDesign(const EnrichmentInput& input) {
+  if (!(input.fixed_n_enriching > 0)) {
+    throw ValueError("The input does not contain a fixed staging.");
+  }
+  // The design does not depend on the targets, the lowest possible target
+  // product assay never triggers the check of the product assay.
+  CascadeCalculator calculator(
+      input.feed_composition, 0, input.tails_assay, input.gamma_235,
+      input.enrichment_process, 1e299, 1, 1e299, false,
+      input.use_integer_stages, input.enrichment_model,
+      input.fixed_n_enriching, input.fixed_n_stripping, input.design_store);
+  return calculator.Design();
+}
+
+}  // namespace misoenrichment
@@ -0,0 +1,317 @@
+#ifndef MISOENRICHMENT_SRC_CASCADE_CALCULATOR_H_
+#define MISOENRICHMENT_SRC_CASCADE_CALCULATOR_H_
+
+#include <array>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "cascade_cache.h"
+#include "cascade_design.h"
+#include "dual_number.h"
+#include "core_helper.h"
+#include "enrichment_process.h"
+#include "stage_cascade.h"
+
+namespace misoenrichment {
+
+class DesignStore;
+
+// Parameters with respect to which `CascadeCalculator::Sensitivities`
+// differentiates. The derivative with respect to the feed atom fraction of
+// isotope i (see `IsotopeArray`) is stored at kSensitivityFeed + i.
+const int kSensitivityProductAssay = 0;
+const int kSensitivityTailsAssay = 1;
+const int kSensitivityGamma235 = 2;
+const int kSensitivityFeed = 3;
+const int kNumSensitivityParameters = kSensitivityFeed + kNumIsotopes;
+
+typedef Dual<kNumSensitivityParameters> SensitivityDual;
+typedef BasicCascadeFlows<SensitivityDual> FlowSensitivities;
+
+// Input of `EvaluateEnrichment`, see `CascadeCalculator` for the
+// meaning of the parameters. Use 1e299 for quantities that are not
+// constraining.
+struct EnrichmentInput {
+  // Uranium atom fractions as returned by `CompMapToIsotopeArray`.
+  IsotopeArray feed_composition;
+  double product_assay;
+  double tails_assay;
+  double feed_qty = 1e299;
+  double product_qty = 1e299;
+  double max_swu = 1e299;
+  double gamma_235 = 1.4;
+  EnrichmentProcess enrichment_process = EnrichmentProcess::kCentrifuge;
+  bool use_downblending = true;
+  bool use_integer_stages = true;
+  EnrichmentModel enrichment_model = EnrichmentModel::kMatchedAbundanceRatio;
+  // Fixed staging, see `CascadeCalculator::FixStaging`. Zero enriching
+  // stages mean that the staging is determined from the target assays.
+  double fixed_n_enriching = 0;
+  double fixed_n_stripping = 0;
+  // Persistent design store consulted before the staging is determined,
+  // see `CascadeCalculator::UseDesignStore`. Not owned, may be NULL.
+  DesignStore* design_store = NULL;
+};
+
+// Result of `EvaluateEnrichment`. The flows contain the composition of the
+// product delivered (i.e., after downblending).
+struct EnrichmentResult {
+  CascadeFlows flows;
+  IsotopeArray tails_composition;
+  double n_enriching;
+  double n_stripping;
+};
+
+class CascadeCalculator {
+ public:
+  // The feed is given as in `EnrichmentInput`. A fixed staging (see
+  // `FixStaging`) and a design store (see `UseDesignStore`) can be passed
+  // directly, such that the staging is not searched for first.
+  CascadeCalculator(const IsotopeArray& feed_composition,
+                    double target_product_assay,
+                    double target_tails_assay, double gamma,
+                    EnrichmentProcess enrichment_process,
+                    double feed_qty, double product_qty,
+                    double max_swu, bool use_downblending,
+                    bool use_integer_stages,
+                    EnrichmentModel enrichment_model,
+                    double fixed_n_enriching=0,
+                    double fixed_n_stripping=0,
+                    DesignStore* design_store=NULL);
+  // Apart from the design store, the calculator only holds values, hence
+  // copies and moves carry over the complete state (including the cascade
+  // design) without any recalculation. Copies share the design store.
+  CascadeCalculator(const CascadeCalculator& e) = default;
+  CascadeCalculator(CascadeCalculator&& e) noexcept = default;
+  CascadeCalculator& operator= (const CascadeCalculator& e) = default;
+  CascadeCalculator& operator= (CascadeCalculator&& e) noexcept = default;
+
+  void PPrint();
+
+  void BuildMatchedAbundanceRatioCascade();
+
+  // Uses the given staging (e.g., the one of an existing plant) instead of
+  // determining it from the target assays and recalculates the enrichment.
+  // The staging then stays fixed for all subsequent calls of `SetInput`:
+  // the target tails assay is ignored, the target product assay only
+  // enters via the downblending and changing it only requires the flows to
+  // be recalculated. Zero enriching stages revert to determining the
+  // staging from the targets.
+  //
+  // A fixed cascade cannot deliver a product assay above the one given by
+  // its staging, hence the constructor and `SetInput` throw a ValueError
+  // if the target product assay lies above it, see also
+  // `FixedStagingDesign`.
+  //
+  // Throws a ValueError for negative stage numbers or if an
+  // integer number of stages is used and the stage numbers are not
+  // integral.
+  void FixStaging(double n_enriching, double n_stripping);
+  inline bool HasFixedStaging() const { return fixed_n_enriching > 0; }
+
+  // Consults `store` (unless NULL) whenever the staging has to be
+  // determined and the design is not in the `CascadeCache`, and adds the
+  // designs used by this calculator to it. The store is not owned and must
+  // outlive the calculator. The current design is kept.
+  inline void UseDesignStore(DesignStore* store) { design_store = store; }
+
+  // Updates the input parameters and recalculates the enrichment. The
+  // staging is only redetermined if the feed composition, the target
+  // assays, the separation factors, the type of staging or the enrichment
+  // model change. Else, only the flows (and the downblending) are
+  // recalculated.
+  void SetInput(const IsotopeArray& new_feed_composition,
+      double new_target_product_assay, double new_target_tails_assay,
+      double new_feed_qty, double new_product_qty, double new_max_swu,
+      double gamma_235, EnrichmentProcess enrichment_process,
+      bool use_downblending, bool use_integer_stages=true,
+      EnrichmentModel enrichment_model=
+          EnrichmentModel::kMatchedAbundanceRatio);
+
+  // Evaluates several product requests sharing the same feed, tails assay
+  // and constraints. Each request is evaluated as if it were the only one,
+  // i.e., the feed and SWU limits apply to every request individually, and
+  // yields the same flows as `SetInput` would.
+  //
+  // Every distinct product assay needs one cascade design, which is taken
+  // from the `CascadeCache` (or the design store) if possible. With the
+  // matched abundance ratio model and a staging determined from an integer
+  // number of stages, the stage searches only yield the stagings of the
+  // missing designs, their concentrations are then evaluated for all of
+  // them at once. Finally, the flows of all requests are calculated at
+  // once. Both steps work on structures of arrays, such that the loops
+  // over the isotopes run across the designs (requests) and can be
+  // vectorised. Other designs are determined one at a time.
+  //
+  // The state of the calculator is not changed.
+  void EnrichBatch(const IsotopeArray& feed_composition,
+                   const std::vector<double>& product_assays,
+                   const std::vector<double>& product_qtys,
+                   double tails_assay, double feed_qty, double max_swu,
+                   double gamma_235, EnrichmentProcess enrichment_process,
+                   bool use_downblending, bool use_integer_stages,
+                   EnrichmentModel enrichment_model,
+                   BatchedFlows& flows) const;
+
+  // Returns the current flows, compositions and staging.
+  EnrichmentResult Result() const;
+
+  // Returns the current flows together with their derivatives with respect
+  // to the target product and tails assays, `gamma_235` and the feed atom
+  // fractions, obtained in one pass using forward-mode automatic
+  // differentiation. The feed gets renormalised, i.e., the derivative with
+  // respect to a feed fraction corresponds to changing only this fraction
+  // before normalising.
+  //
+  // An integer staging is treated as fixed, such that the target assays
+  // only enter via the downblending, as is a staging set by `FixStaging`.
+  // Any other non-integer staging follows the target assays, its
+  // derivatives are obtained by applying the implicit function theorem to
+  // the staging equations. Throws a ValueError for the stage-by-stage
+  // enrichment model.
+  FlowSensitivities Sensitivities() const;
+
+  inline double FeedUsed() { return feed_qty; }
+  inline double ProductProduced() { return product_qty; }
+  inline double SwuUsed() { return swu; }
+  inline const CascadeDesign& Design() { return design; }
+
+ private:
+  bool use_downblending;  // Use only in conjunction with `use_integer_stages`.
+  bool use_integer_stages;  // Else use floating-point number of stages
+  // The stage-by-stage model requires `use_integer_stages`.
+  EnrichmentModel enrichment_model;
+  // Staging used instead of the one determined from the targets if
+  // `fixed_n_enriching` is positive, see `FixStaging`.
+  double fixed_n_enriching = 0;
+  double fixed_n_stripping = 0;
+  DesignStore* design_store = NULL;
+
+  // All assays and compositions are assumed to be atom fractions. The
+  // compositions only contain uranium, they are normalised to the total
+  // uranium content and follow the order given by `IsotopesNucID`.
+  // Conversion from and to cyclus::Composition is left to
+  // `EnrichmentCalculator`.
+  IsotopeArray feed_composition;
+  IsotopeArray product_composition;
+  IsotopeArray tails_composition;
+
+  // Current cascade design, the flows are calculated from this design.
+  CascadeDesign design;
+
+  double target_product_assay;
+  double target_tails_assay;
+  // Units of all of the streams are kg timestep^-1
+  double target_feed_qty;
+  double target_product_qty;
+  double feed_qty;
+  double product_qty;
+  double tails_qty;
+  double max_swu;  // in kg SWU timestep^-1
+  double swu = 0;  // Separative work that has been performed
+                   // in kg SWU timestep^-1
+
+  EnrichmentProcess enrichment_process;
+  IsotopeArray separation_factors;
+  IsotopeArray alpha_star;
+  // ln(alpha*), cached as the cascade equations are evaluated in log-space.
+  IsotopeArray log_alpha_star;
+  // Coefficients 1 / (2k_i - 1) of the value function with
+  // k_i = (alpha_i-1) / (alpha_235-1). Isotopes with k_i = 0.5 use a
+  // logarithmic term instead, indicated by `value_log_term`.
+  IsotopeArray value_coefficients;
+  std::array<bool, kNumIsotopes> value_log_term;
+
+  // Number of stages in the enriching and in the stripping section
+  double n_enriching;
+  double n_stripping;
+  // Product and tails per unit of feed for the current staging, see
+  // E. von Halle Eqs. (47) and (50).
+  double sum_e;
+  double sum_s;
+
+  double gamma_235;  // The overall separation factor for U-235
+
+  // Last converged non-integer staging, used as initial guess the next
+  // time a non-integer staging gets determined.
+  bool has_previous_decimal_stages = false;
+  double previous_n_enriching = 0;
+  double previous_n_stripping = 0;
+
+  void CalculateGammaAlphaStar_();
+  // Throws if the given fixed staging is invalid, see `FixStaging`.
+  void CheckFixedStaging_(double n_enriching, double n_stripping) const;
+  // Throws if a fixed staging does not reach the target product assay.
+  void CheckFixedStagingProduct_() const;
+  // Throws if the model cannot be used with the staging options.
+  void CheckDesignOptions_() const;
+  // Key of the current design in the `CascadeCache` and the design store.
+  CascadeCache::Key DesignKey_() const;
+  // Looks up the design in the cache and in the design store and copies it
+  // into `design`. Returns false if it is in neither of them.
+  bool FindDesign_(const CascadeCache::Key& key);
+  // Determines the staging and sets `design` accordingly.
+  void DesignCascade_();
+  void CalculateIntegerStages_();
+  // Determines the integer staging without calculating the concentrations
+  // of the final staging.
+  void SearchIntegerStages_();
+  // Throws if the integer staging does not reach the targets, see
+  // `IntegerStagingReachesTargets`.
+  void CheckIntegerStages_() const;
+  // Returns the smallest number of enriching (or stripping) stages such
+  // that the target product (or tails) assay is reached.
+  int SmallestIntegerStages_(bool enriching_section);
+  bool IntegerStagesReachTarget_(bool enriching_section, int n_stages);
+  void CalculateDecimalStages_();
+  // Replaces the concentrations of the matched abundance ratio cascade by
+  // the ones of the stage-by-stage model using the same staging. Returns
+  // the separative work per unit of feed performed by the stages.
+  double SimulateStages_();
+  // Determines the non-integer staging starting from the current staging.
+  // Returns false if the solver did not converge.
+  bool SolveDecimalStages_();
+  // Sets the staging to the estimate used as initial guess when solving for
+  // a non-integer number of stages.
+  void InitialDecimalStages_();
+  // Calculates the concentrations for the current staging, stores the
+  // relative deviations of the U235 product and tails assays from their
+  // targets in `residual` and returns the sum of their squares.
+  double StagingResidual_(double residual[2]);
+  // Recalculates the flows (and performs the downblending, if needed)
+  // using the current cascade design.
+  void RecalculateFlows_();
+  void CalculateConcentrations_();
+  // Derivatives of the U235 product (row 0) and tails (row 1) assays with
+  // respect to the number of enriching (column 0) and stripping (column 1)
+  // stages for the current staging, obtained by differentiating
+  // Eqs. (37), (39), (47) and (50).
+  void AssayJacobian_(double jacobian[2][2]) const;
+
+  double ValueFunction_(const IsotopeArray& composition) const;
+};
+
+// Evaluates an enrichment without side effects: the inputs are passed by
+// value, the result is returned and all intermediate state is local to the
+// call. The function is therefore reentrant and may be called
+// concurrently, e.g., from a thread pool evaluating the constraints of
+// several facilities. The only state shared between calls is the
+// `CascadeCache`, which is internally synchronised and only ever returns
+// the design that would have been calculated otherwise.
+//
+// In contrast to the constructors of `EnrichmentCalculator`, no
+// cyclus::Composition is accessed, as these convert their compositions
+// lazily and are thus not safe to share between threads.
+EnrichmentResult EvaluateEnrichment(const EnrichmentInput& input);
+
+// Returns the design of the cascade with the fixed staging given in
+// `input`. It does not depend on the target assays and flows of `input`.
+// Its product (tails) assay is the highest (lowest) one the cascade can
+// deliver for the given feed. Throws a ValueError if `input` does not
+// contain a fixed staging.
+CascadeDesign FixedStagingDesign(const EnrichmentInput& input);
+
+}  // namespace misoenrichment
+
+#endif  // MISOENRICHMENT_SRC_CASCADE_CALCULATOR_H_
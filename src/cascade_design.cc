@@ -0,0 +1,103 @@
+#include "cascade_design.h"
+
+#include <cmath>
+#include <limits>
+
+namespace misoenrichment {
+
+// Tolerance of `ValueFunctionLogTerm`, equal to cyclus::eps() such that the
+// core library treats the isotopes as the Cyclus module does.
+const double kLogTermTol = 1e-6;
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+bool ValueFunctionLogTerm(double k) {
+  return std::fabs(k - 0.5) < kLogTermTol;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void CalculateFlows(const std::vector<CascadeDesign>& designs,
+                    const std::vector<int>& design_index, double feed_qty,
+                    const std::vector<double>& product_qtys, double max_swu,
+                    bool use_downblending, BatchedFlows& flows) {
+  std::size_t n_requests = design_index.size();
+  flows.feed_qty.resize(n_requests);
+  flows.product_qty.resize(n_requests);
+  flows.tails_qty.resize(n_requests);
+  flows.swu.resize(n_requests);
+  for (int i = 0; i < kNumIsotopes; i++) {
+    flows.product_composition[i].resize(n_requests);
+  }
+  if (n_requests == 0) {
+    return;
+  }
+
+  // Gather the quantities of the designs used by each request.
+  std::vector<double> sum_e(n_requests);
+  std::vector<double> sum_s(n_requests);
+  std::vector<double> product_assay(n_requests);
+  std::vector<double> target_product_assay(n_requests);
+  std::vector<double> swu_per_feed(n_requests);
+  for (std::size_t r = 0; r < n_requests; r++) {
+    const CascadeDesign& design = designs[design_index[r]];
+    sum_e[r] = design.sum_e;
+    sum_s[r] = design.sum_s;
+    product_assay[r] = design.product_composition[kIdx235];
+    target_product_assay[r] = design.target_product_assay;
+    swu_per_feed[r] = design.swu_per_feed;
+    for (int i = 0; i < kNumIsotopes; i++) {
+      flows.product_composition[i][r] = design.product_composition[i];
+    }
+  }
+
+  // Same calculations as in `CalculateFlows` above, with the binding
+  // constraint being selected instead of branched on.
+  const IsotopeArray& feed_composition = designs[design_index[0]]
+                                         .feed_composition;
+  double feed_assay = feed_composition[kIdx235];
+  std::vector<double> enriched_product(n_requests);
+  std::vector<double> blend_feed(n_requests);
+  for (std::size_t r = 0; r < n_requests; r++) {
+    double blend_feed_per_product =
+        use_downblending && product_assay[r]-target_product_assay[r] >= 0.00005
+        ? (product_assay[r]-target_product_assay[r])
+          / (target_product_assay[r]-feed_assay)
+        : 0.;
+    double product_limit = product_qtys[r] / (1.+blend_feed_per_product);
+    double feed_limit = feed_qty / (1./sum_e[r] + blend_feed_per_product);
+    double swu_limit = swu_per_feed[r] > 0
+                       ? max_swu * sum_e[r] / swu_per_feed[r]
+                       : std::numeric_limits<double>::infinity();
+
+    bool product_binding = product_limit <= feed_limit
+                           && product_limit <= swu_limit;
+    bool feed_binding = !product_binding && feed_limit <= swu_limit;
+    bool swu_binding = !product_binding && !feed_binding;
+    double enriched_feed =
+        product_binding ? product_limit / sum_e[r]
+        : feed_binding ? feed_qty / (1.+blend_feed_per_product*sum_e[r])
+        : max_swu / swu_per_feed[r];
+    enriched_product[r] = product_binding ? product_limit
+                                          : enriched_feed * sum_e[r];
+    flows.tails_qty[r] = enriched_feed * sum_s[r];
+    flows.swu[r] = swu_binding ? max_swu : swu_per_feed[r]*enriched_feed;
+    blend_feed[r] = blend_feed_per_product * enriched_product[r];
+    flows.feed_qty[r] = enriched_feed + blend_feed[r];
+    flows.product_qty[r] = enriched_product[r] + blend_feed[r];
+  }
+  for (int i = 0; i < kNumIsotopes; i++) {
+    double feed = feed_composition[i];
+    double* product = flows.product_composition[i].data();
+    for (std::size_t r = 0; r < n_requests; r++) {
+      product[r] = blend_feed[r] > 0
+                   ? (product[r]*enriched_product[r] + feed*blend_feed[r])
+                     / (enriched_product[r]+blend_feed[r])
+                   : product[r];
+    }
+  }
+}
+
+template CascadeFlows CalculateFlows<double, UraniumIsotopes>(
+    const CascadeDesign& design, double feed_qty, double product_qty,
+    double max_swu, bool use_downblending);
+
+}  // namespace misoenrichment
@@ -0,0 +1,471 @@
+#ifndef MISOENRICHMENT_SRC_CASCADE_DESIGN_H_
+#define MISOENRICHMENT_SRC_CASCADE_DESIGN_H_
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "core_helper.h"
+#include "isotope_set.h"
+
+namespace misoenrichment {
+
+// Quantity-free description of a matched abundance ratio cascade.
+//
+// Once the staging is fixed, the product and tails compositions as well as
+// the product, tails and separative work per unit of feed do not depend on
+// the quantities enriched anymore. Determining the staging is the only
+// expensive operation, all flows can then be obtained from the design
+// using `CalculateFlows`.
+//
+// Variable naming follows E. von Halle, 'Multicomponent Isotope Separation
+// in Matched Abundance Ratio Cascades Composed of Stages With Large
+// Separation Factors'. In: Proceedings of the 1st Workshop on Separation
+// Phenomena in Liquids and Gases, pp. 325--356 (1987).
+//
+// The scalar type `T` is double, except when calculating sensitivities
+// (see `CascadeCalculator::Sensitivities`), where dual numbers are used.
+// `Isotopes` is the isotope set separated (see `isotope_set.h`), the key
+// isotope taking the role of U235 in the comments.
+template <typename T, typename Isotopes = UraniumIsotopes>
+struct BasicCascadeDesign {
+  // Number of stages in the enriching and in the stripping section
+  T n_enriching;
+  T n_stripping;
+
+  // Atom fractions, see also `IsotopeArray`. The product composition is the
+  // one leaving the cascade, i.e., before any downblending.
+  BasicIsotopeArray<Isotopes, T> feed_composition;
+  BasicIsotopeArray<Isotopes, T> product_composition;
+  BasicIsotopeArray<Isotopes, T> tails_composition;
+
+  // Target U235 product assay, used for the downblending.
+  T target_product_assay;
+
+  // Product and tails per unit of feed, Eqs. (47) and (50).
+  T sum_e;
+  T sum_s;
+
+  // Value function of the feed, product and tails compositions.
+  T value_feed;
+  T value_product;
+  T value_tails;
+
+  // Separative work per unit of feed. For a matched abundance ratio
+  // cascade, this is the one of its streams, see `StreamSwuPerFeed`.
+  // Cascades simulated stage by stage and cascade networks mix streams of
+  // different compositions and hence perform more separative work.
+  T swu_per_feed;
+};
+typedef BasicCascadeDesign<double> CascadeDesign;
+
+// Returns the separative work per unit of feed needed to produce the
+// product and tails streams of `design`, Eqs. (47) and (50).
+template <typename T, typename Isotopes>
+T StreamSwuPerFeed(const BasicCascadeDesign<T, Isotopes>& design) {
+  return design.value_product*design.sum_e
+         + design.value_tails*design.sum_s
+         - design.value_feed;
+}
+
+// Flows obtained from a cascade design, units of all of the streams are
+// kg timestep^-1 and kg SWU timestep^-1.
+template <typename T, typename Isotopes = UraniumIsotopes>
+struct BasicCascadeFlows {
+  T feed_qty;
+  T product_qty;
+  T tails_qty;
+  T swu;
+  // Composition of the product delivered, i.e., after downblending.
+  BasicIsotopeArray<Isotopes, T> product_composition;
+};
+typedef BasicCascadeFlows<double> CascadeFlows;
+
+// Returns r = s / e for an isotope with ln(alpha*) = `log_alpha`, with e and
+// s given by E. von Halle Eqs. (37) and (39), i.e.,
+//   r = (1 - alpha*^-n_e) / (alpha*^(n_s+1) - 1).
+// Using expm1 keeps the result accurate for exponents close to zero and
+// yields 0 or inf instead of NaN if the powers overflow.
+template <typename T>
+T TailsToProductRatio(const T& log_alpha, const T& n_enriching,
+                      const T& n_stripping) {
+  using std::expm1;
+  return -expm1(-n_enriching*log_alpha) / expm1((n_stripping+1.)*log_alpha);
+}
+
+// Calculates the product and tails compositions as well as the product
+// and tails per unit of feed (Eqs. (47) and (50)) of a matched abundance
+// ratio cascade with the given staging. The fractions of isotope i leaving
+// the cascade via the product and via the tails are e_i / (e_i+s_i) =
+// 1 / (1+r_i) and s_i / (e_i+s_i) = 1 / (1+1/r_i), respectively. The
+// number of isotopes `N` is deduced from the arrays, such that the loops
+// run over a compile-time bound for every isotope set.
+template <typename T, std::size_t N>
+void CalculateConcentrations(
+    const std::array<T, N>& log_alpha_star,
+    const std::array<T, N>& feed_composition,
+    const T& n_enriching, const T& n_stripping,
+    std::array<T, N>& product_composition,
+    std::array<T, N>& tails_composition, T& sum_e, T& sum_s) {
+  std::array<T, N> to_product;
+  std::array<T, N> to_tails;
+  sum_e = 0.;
+  sum_s = 0.;
+  for (std::size_t i = 0; i < N; i++) {
+    T r = TailsToProductRatio(log_alpha_star[i], n_enriching, n_stripping);
+    to_product[i] = feed_composition[i] / (1.+r);
+    to_tails[i] = feed_composition[i] / (1.+1./r);
+    sum_e += to_product[i];  // right-hand side of Eq. (47)
+    sum_s += to_tails[i];  // right-hand side of Eq. (50)
+  }
+
+  // Calculate the compositions of product and tails.
+  for (std::size_t i = 0; i < N; i++) {
+    product_composition[i] = to_product[i] / sum_e;
+    tails_composition[i] = to_tails[i] / sum_s;
+  }
+}
+
+// Same as `CalculateConcentrations` above for several stagings of the same
+// feed, stored as structures of arrays: element d of each vector belongs to
+// the d-th staging. The inner loops run across the stagings such that they
+// can be vectorised, every staging yields the same values as a separate
+// call of the function above. The output vectors are resized as needed.
+template <std::size_t N>
+void CalculateConcentrations(
+    const std::array<double, N>& log_alpha_star,
+    const std::array<double, N>& feed_composition,
+    const std::vector<double>& n_enriching,
+    const std::vector<double>& n_stripping,
+    std::array<std::vector<double>, N>& product_composition,
+    std::array<std::vector<double>, N>& tails_composition,
+    std::vector<double>& sum_e, std::vector<double>& sum_s) {
+  std::size_t n_stagings = n_enriching.size();
+  sum_e.assign(n_stagings, 0.);
+  sum_s.assign(n_stagings, 0.);
+  for (std::size_t i = 0; i < N; i++) {
+    product_composition[i].resize(n_stagings);
+    tails_composition[i].resize(n_stagings);
+    double log_alpha = log_alpha_star[i];
+    double feed = feed_composition[i];
+    // The product and tails of isotope i per unit of feed are stored in
+    // the compositions until they are normalised below.
+    double* to_product = product_composition[i].data();
+    double* to_tails = tails_composition[i].data();
+    for (std::size_t d = 0; d < n_stagings; d++) {
+      double r = TailsToProductRatio(log_alpha, n_enriching[d],
+                                     n_stripping[d]);
+      to_product[d] = feed / (1.+r);
+      to_tails[d] = feed / (1.+1./r);
+      sum_e[d] += to_product[d];  // right-hand side of Eq. (47)
+      sum_s[d] += to_tails[d];  // right-hand side of Eq. (50)
+    }
+  }
+  for (std::size_t i = 0; i < N; i++) {
+    for (std::size_t d = 0; d < n_stagings; d++) {
+      product_composition[i][d] /= sum_e[d];
+      tails_composition[i][d] /= sum_s[d];
+    }
+  }
+}
+
+// Value function of a composition containing U235 and U238 (the key and
+// the reference isotope), see `CascadeCalculator::ValueFunction_` for
+// the coefficients and the references. Isotopes flagged in `log_term`
+// contribute a logarithmic term.
+template <typename Isotopes = UraniumIsotopes, typename T>
+T ValueFunction(const BasicIsotopeArray<Isotopes, T>& composition,
+                const BasicIsotopeArray<Isotopes, T>& coefficients,
+                const BasicIsotopeArray<Isotopes, bool>& log_term) {
+  using std::log;
+  const int kIdxKey = Isotopes::kIdxKey;
+  const int kIdxReference = Isotopes::kIdxReference;
+  T value = 0.;
+  for (int i = 0; i < Isotopes::kNumIsotopes; i++) {
+    if (log_term[i]) {
+      // Isotopes that are not present do not contribute.
+      if (composition[i] > 0) {
+        value += log(composition[i] / composition[kIdxReference]);
+      }
+    } else {
+      value += coefficients[i] * composition[i];
+    }
+  }
+  value *= log(composition[kIdxKey] / composition[kIdxReference]);
+
+  return value;
+}
+
+// Returns true if an isotope with k_i = `k` contributes a logarithmic term
+// to the value function, i.e., if k_i = 0.5.
+bool ValueFunctionLogTerm(double k);
+
+// Calculates the coefficients 1 / (2k_i - 1) of the value function with
+// k_i = (alpha_i-1) / (alpha_235-1). Isotopes with k_i = 0.5 use a
+// logarithmic term instead, they are flagged in `log_term` and get a zero
+// coefficient.
+template <typename Isotopes = UraniumIsotopes>
+void ValueFunctionCoefficients(
+    const BasicIsotopeArray<Isotopes>& separation_factors,
+    BasicIsotopeArray<Isotopes>& coefficients,
+    BasicIsotopeArray<Isotopes, bool>& log_term) {
+  for (int i = 0; i < Isotopes::kNumIsotopes; i++) {
+    double k = (separation_factors[i]-1)
+               / (separation_factors[Isotopes::kIdxKey]-1);
+    log_term[i] = ValueFunctionLogTerm(k);
+    coefficients[i] = log_term[i] ? 0 : 1 / (2*k - 1);
+  }
+}
+
+// Returns the smallest number of stages n >= 1 for which
+// `reaches_target(n)` is true, with `reaches_target` being monotone in n.
+// The U235 product (tails) assay increases (decreases) monotonically
+// with the number of enriching (stripping) stages. Therefore, the
+// smallest number of stages reaching the target assay is bracketed by
+// doubling the number of stages and then determined using a bisection.
+// This yields the same result as adding one stage at a time but it only
+// needs a logarithmic number of evaluations.
+//
+// The search stops at `kIterMax + 1` stages if the target cannot be
+// reached, i.e., this value is treated as reaching the target without
+// being evaluated. Callers relying on reproducing a staging exactly (see
+// `ConversionTable`) must use this function, such that the same stage
+// numbers get evaluated.
+template <typename Predicate>
+int SmallestIntegerStages(Predicate reaches_target) {
+  const int n_max = kIterMax + 1;
+  int n_too_small = 0;
+  int n_reached = 1;
+  while (n_reached < n_max && !reaches_target(n_reached)) {
+    n_too_small = n_reached;
+    n_reached = std::min(2 * n_reached, n_max);
+  }
+  while (n_reached - n_too_small > 1) {
+    int n_mid = (n_too_small + n_reached) / 2;
+    if (reaches_target(n_mid)) {
+      n_reached = n_mid;
+    } else {
+      n_too_small = n_mid;
+    }
+  }
+  return n_reached;
+}
+
+// Returns true if an integer staging determined using
+// `SmallestIntegerStages` reaches the targets. The product assay is
+// reached by the enriching section alone (the stripping section changes
+// it slightly), which holds for all evaluated stagings, i.e., for up to
+// `kIterMax` stages. A section with `kIterMax + 1` stages has not reached
+// its target. In addition, the key assay of the tails must not exceed
+// `tails_assay`. All designers of integer stagings use this criterion,
+// such that they accept the same stagings.
+inline bool IntegerStagingReachesTargets(double n_enriching,
+                                         double n_stripping,
+                                         double tails_key_assay,
+                                         double tails_assay) {
+  return n_enriching <= kIterMax && n_stripping <= kIterMax
+         && !(tails_key_assay > tails_assay);
+}
+
+// Flows of several product requests evaluated at once using
+// `CascadeCalculator::EnrichBatch`. The flows are stored as a structure
+// of arrays, element r of each vector belongs to the r-th request.
+struct BatchedFlows {
+  std::vector<double> feed_qty;
+  std::vector<double> product_qty;
+  std::vector<double> tails_qty;
+  std::vector<double> swu;
+  // product_composition[i][r] is the atom fraction of the i-th isotope (see
+  // `IsotopeArray`) in the product of the r-th request.
+  std::array<std::vector<double>, kNumIsotopes> product_composition;
+};
+
+// Calculates the flows of a given design in O(1) such that neither the
+// available feed, the desired product nor the SWU capacity get exceeded.
+// Use 1e299 for quantities that are not constraining.
+//
+// If `use_downblending` is true and the product assay exceeds the target
+// assay, then the product is downblended using feed material.
+template <typename T, typename Isotopes>
+BasicCascadeFlows<T, Isotopes> CalculateFlows(
+    const BasicCascadeDesign<T, Isotopes>& design, double feed_qty,
+    double product_qty, double max_swu, bool use_downblending) {
+  BasicCascadeFlows<T, Isotopes> flows;
+  flows.product_composition = design.product_composition;
+
+  T sum_e = design.sum_e;
+  T sum_s = design.sum_s;
+
+  // Quantity of blending feed needed per unit of enriched product.
+  T feed_assay = design.feed_composition[Isotopes::kIdxKey];
+  T product_assay = design.product_composition[Isotopes::kIdxKey];
+  T target_product_assay = design.target_product_assay;
+  T blend_feed_per_product = 0.;
+  if (use_downblending && product_assay - target_product_assay >= 0.00005) {
+    blend_feed_per_product = (product_assay-target_product_assay)
+                             / (target_product_assay-feed_assay);
+  }
+  // Separative work per unit of feed enriched.
+  T swu_per_feed = design.swu_per_feed;
+
+  // All flows are proportional to the enriched (i.e., undiluted) product.
+  // Each of the constraints limits this quantity:
+  //   product:  P_e (1+b)           <= product_qty,
+  //   feed:     P_e (1/sum_e + b)   <= feed_qty,
+  //   SWU:      P_e swu_per_feed / sum_e <= max_swu,
+  // with b being the blending feed per enriched product. The smallest limit
+  // is binding, ties are resolved in the order product, feed, SWU.
+  T product_limit = product_qty / (1.+blend_feed_per_product);
+  T feed_limit = feed_qty / (1./sum_e + blend_feed_per_product);
+  T swu_limit = std::numeric_limits<double>::infinity();
+  if (swu_per_feed > 0) {
+    swu_limit = max_swu * sum_e / swu_per_feed;
+  }
+
+  T enriched_feed;
+  T enriched_product;
+  bool swu_is_constraint = false;
+  if (product_limit <= feed_limit && product_limit <= swu_limit) {
+    enriched_product = product_limit;
+    enriched_feed = enriched_product / sum_e;  // Eq. (47)
+  } else if (feed_limit <= swu_limit) {
+    enriched_feed = feed_qty / (1.+blend_feed_per_product*sum_e);
+    enriched_product = enriched_feed * sum_e;  // Eq. (47)
+  } else {
+    swu_is_constraint = true;
+    enriched_feed = max_swu / swu_per_feed;
+    enriched_product = enriched_feed * sum_e;  // Eq. (47)
+  }
+  flows.tails_qty = enriched_feed * sum_s;  // Eq. (50)
+  if (swu_is_constraint) {
+    flows.swu = max_swu;
+  } else {
+    flows.swu = swu_per_feed * enriched_feed;
+  }
+
+  T blend_feed = blend_feed_per_product * enriched_product;
+  flows.feed_qty = enriched_feed + blend_feed;
+  flows.product_qty = enriched_product + blend_feed;
+  if (blend_feed > 0) {
+    for (int i = 0; i < Isotopes::kNumIsotopes; i++) {
+      flows.product_composition[i] =
+          (design.product_composition[i]*enriched_product
+           + design.feed_composition[i]*blend_feed)
+          / (enriched_product+blend_feed);
+    }
+  }
+  return flows;
+}
+
+// Calculates the flows of several requests at once, the r-th request
+// asking for product_qtys[r] and being served by designs[design_index[r]].
+// All designs must have the same feed composition. The feed and SWU limits
+// apply to every request individually, such that each request yields the
+// same flows as `CalculateFlows` above. The loops run across the requests
+// and can be vectorised.
+void CalculateFlows(const std::vector<CascadeDesign>& designs,
+                    const std::vector<int>& design_index, double feed_qty,
+                    const std::vector<double>& product_qtys, double max_swu,
+                    bool use_downblending, BatchedFlows& flows);
+
+// Matched abundance ratio cascade of an arbitrary isotope set, e.g.,
+// `MarcKernel<XenonIsotopes>`. All quantities only depending on the
+// separation factors are precomputed upon construction, designing a
+// cascade then neither allocates memory nor needs any runtime lookup of
+// the isotopes.
+//
+// The kernel evaluates the same functions as `CascadeCalculator` and
+// `ConversionTable`, hence `MarcKernel<UraniumIsotopes>` yields the
+// designs of the calculator using the matched abundance ratio model.
+template <typename Isotopes>
+class MarcKernel {
+ public:
+  typedef BasicIsotopeArray<Isotopes> Array;
+  typedef BasicCascadeDesign<double, Isotopes> Design;
+
+  // The separation factors are given with respect to the reference
+  // isotope, see `SeparationFactors<Process, Isotopes>`.
+  explicit MarcKernel(const Array& separation_factors) {
+    double sqrt_alpha_key = std::sqrt(separation_factors[Isotopes::kIdxKey]);
+    for (int i = 0; i < Isotopes::kNumIsotopes; i++) {
+      log_alpha_star_[i] = std::log(separation_factors[i] / sqrt_alpha_key);
+    }
+    ValueFunctionCoefficients<Isotopes>(separation_factors, coefficients_,
+                                        log_term_);
+  }
+
+  // Returns the design of the cascade with the given staging. The target
+  // product assay is set to the key assay of the product, i.e., there is
+  // no downblending unless it is changed.
+  Design Cascade(const Array& feed_composition, double n_enriching,
+                 double n_stripping) const {
+    Design design;
+    Concentrations_(feed_composition, n_enriching, n_stripping, design);
+    design.target_product_assay =
+        design.product_composition[Isotopes::kIdxKey];
+    design.value_feed = ValueFunction<Isotopes>(feed_composition,
+                                                coefficients_, log_term_);
+    design.value_product = ValueFunction<Isotopes>(
+        design.product_composition, coefficients_, log_term_);
+    design.value_tails = ValueFunction<Isotopes>(
+        design.tails_composition, coefficients_, log_term_);
+    design.swu_per_feed = StreamSwuPerFeed(design);
+    return design;
+  }
+
+  // Determines the smallest integer staging such that the key assay
+  // reaches at least `product_assay` in the product and at most
+  // `tails_assay` in the tails, using the same search as
+  // `CascadeCalculator`. Returns false if the feed lacks the key or
+  // the reference isotope or if the staging does not reach the targets,
+  // see `IntegerStagingReachesTargets`.
+  bool IntegerStagesCascade(const Array& feed_composition,
+                            double product_assay, double tails_assay,
+                            Design& design) const {
+    if (!(feed_composition[Isotopes::kIdxKey] > 0)
+        || !(feed_composition[Isotopes::kIdxReference] > 0)) {
+      return false;
+    }
+    int n_enriching = SmallestIntegerStages([&](int n) {
+      Concentrations_(feed_composition, n, 0., design);
+      return !(design.product_composition[Isotopes::kIdxKey]
+               < product_assay);
+    });
+    int n_stripping = SmallestIntegerStages([&](int n) {
+      Concentrations_(feed_composition, n_enriching, n, design);
+      return !(design.tails_composition[Isotopes::kIdxKey] > tails_assay);
+    });
+    design = Cascade(feed_composition, n_enriching, n_stripping);
+    design.target_product_assay = product_assay;
+    return IntegerStagingReachesTargets(
+        n_enriching, n_stripping,
+        design.tails_composition[Isotopes::kIdxKey], tails_assay);
+  }
+
+ private:
+  void Concentrations_(const Array& feed_composition, double n_enriching,
+                       double n_stripping, Design& design) const {
+    design.n_enriching = n_enriching;
+    design.n_stripping = n_stripping;
+    design.feed_composition = feed_composition;
+    CalculateConcentrations(log_alpha_star_, feed_composition, n_enriching,
+                            n_stripping, design.product_composition,
+                            design.tails_composition, design.sum_e,
+                            design.sum_s);
+  }
+
+  Array log_alpha_star_;
+  Array coefficients_;
+  BasicIsotopeArray<Isotopes, bool> log_term_;
+};
+
+// The double version is instantiated in cascade_design.cc.
+extern template CascadeFlows CalculateFlows<double, UraniumIsotopes>(
+    const CascadeDesign& design, double feed_qty, double product_qty,
+    double max_swu, bool use_downblending);
+
+}  // namespace misoenrichment
+
+#endif  // MISOENRICHMENT_SRC_CASCADE_DESIGN_H_
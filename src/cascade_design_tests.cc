@@ -0,0 +1,249 @@
+#include <gtest/gtest.h>
+
+#include <cmath>
+
+#include "composition.h"
+
+#include "cascade_cache.h"
+#include "cascade_design.h"
+#include "conversion_table.h"
+#include "core_error.h"
+#include "enrichment_calculator.h"
+#include "enrichment_process.h"
+#include "isotope_set.h"
+#include "miso_helper.h"
+
+namespace misoenrichment {
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+CascadeDesign NaturalUraniumDesign(double product_assay) {
+  EnrichmentCalculator e(misotest::comp_natU(), product_assay, 0.002, 1.4,
+                         "centrifuge", 1., 1e299, 1e299, true);
+  return e.Design();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST(CascadeDesignTest, FlowsScaleLinearly) {
+  CascadeDesign design = NaturalUraniumDesign(0.05);
+  CascadeFlows small = CalculateFlows(design, 1e299, 1, 1e299, false);
+  CascadeFlows large = CalculateFlows(design, 1e299, 10, 1e299, false);
+
+  EXPECT_DOUBLE_EQ(10*small.feed_qty, large.feed_qty);
+  EXPECT_DOUBLE_EQ(10*small.tails_qty, large.tails_qty);
+  EXPECT_NEAR(10*small.swu, large.swu, 1e-10*large.swu);
+  EXPECT_DOUBLE_EQ(small.feed_qty, small.product_qty + small.tails_qty);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST(CascadeDesignTest, Constraints) {
+  CascadeDesign design = NaturalUraniumDesign(0.05);
+  CascadeFlows unconstrained = CalculateFlows(design, 1e299, 1, 1e299,
+                                              false);
+
+  // Feed is constraining.
+  double feed_qty = 0.5 * unconstrained.feed_qty;
+  CascadeFlows flows = CalculateFlows(design, feed_qty, 1, 1e299, false);
+  EXPECT_DOUBLE_EQ(flows.feed_qty, feed_qty);
+  EXPECT_DOUBLE_EQ(flows.product_qty, 0.5);
+
+  // SWU is constraining.
+  double max_swu = 0.25 * unconstrained.swu;
+  flows = CalculateFlows(design, 1e299, 1, max_swu, false);
+  EXPECT_DOUBLE_EQ(flows.swu, max_swu);
+  EXPECT_NEAR(flows.product_qty, 0.25, 1e-12);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST(CascadeDesignTest, Downblending) {
+  CascadeDesign design = NaturalUraniumDesign(0.05);
+  ASSERT_TRUE(design.product_composition[kIdx235] > 0.05);
+
+  CascadeFlows flows = CalculateFlows(design, 1e299, 1, 1e299, true);
+  EXPECT_NEAR(flows.product_composition[kIdx235], 0.05, 1e-12);
+  EXPECT_DOUBLE_EQ(flows.product_qty, 1);
+  EXPECT_DOUBLE_EQ(flows.feed_qty, flows.product_qty + flows.tails_qty);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST(CascadeDesignTest, DownblendingConstraints) {
+  CascadeDesign design = NaturalUraniumDesign(0.05);
+  CascadeFlows unconstrained = CalculateFlows(design, 1e299, 1, 1e299,
+                                              true);
+
+  // Feed is constraining.
+  double feed_qty = 0.5 * unconstrained.feed_qty;
+  CascadeFlows flows = CalculateFlows(design, feed_qty, 1, 1e299, true);
+  EXPECT_DOUBLE_EQ(flows.feed_qty, feed_qty);
+  EXPECT_NEAR(flows.product_qty, 0.5, 1e-12);
+  EXPECT_NEAR(flows.product_composition[kIdx235], 0.05, 1e-12);
+
+  // SWU is constraining.
+  double max_swu = 0.25 * unconstrained.swu;
+  flows = CalculateFlows(design, 1e299, 1, max_swu, true);
+  EXPECT_DOUBLE_EQ(flows.swu, max_swu);
+  EXPECT_NEAR(flows.product_qty, 0.25, 1e-12);
+  EXPECT_NEAR(flows.product_composition[kIdx235], 0.05, 1e-12);
+
+  // Feed and SWU are nearly equally constraining, none of the limits may
+  // be exceeded.
+  flows = CalculateFlows(design, feed_qty, 1, 0.5*unconstrained.swu*1.001,
+                         true);
+  EXPECT_TRUE(flows.feed_qty <= feed_qty);
+  EXPECT_TRUE(flows.swu <= 0.5*unconstrained.swu*1.001);
+  EXPECT_NEAR(flows.product_qty, 0.5, 1e-12);
+}
+
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST(CascadeDesignTest, MarcKernelMatchesCalculator) {
+  MarcKernel<UraniumIsotopes> kernel(
+      SeparationFactors<CentrifugeProcess>(1.4));
+  IsotopeArray feed = CompMapToIsotopeArray(
+      misotest::comp_reprocessedU()->atom());
+
+  for (double product_assay : {0.008, 0.04, 0.2, 0.9}) {
+    CascadeDesign design;
+    ASSERT_TRUE(kernel.IntegerStagesCascade(feed, product_assay, 0.002,
+                                            design));
+    CascadeCache::Instance().Clear();
+    EnrichmentCalculator e(feed, product_assay, 0.002, 1.4,
+                           EnrichmentProcess::kCentrifuge, 1e299, 1., 1e299,
+                           true, true,
+                           EnrichmentModel::kMatchedAbundanceRatio);
+    CascadeDesign expected = e.Design();
+    EXPECT_EQ(expected.n_enriching, design.n_enriching);
+    EXPECT_EQ(expected.n_stripping, design.n_stripping);
+    EXPECT_EQ(expected.product_composition, design.product_composition);
+    EXPECT_EQ(expected.tails_composition, design.tails_composition);
+    EXPECT_EQ(expected.value_product, design.value_product);
+    EXPECT_EQ(expected.value_tails, design.value_tails);
+    EXPECT_EQ(expected.swu_per_feed, design.swu_per_feed);
+    EXPECT_EQ(e.SwuUsed(),
+              CalculateFlows(design, 1e299, 1., 1e299, true).swu);
+  }
+  CascadeCache::Instance().Clear();
+
+  CascadeDesign design;
+  EXPECT_FALSE(kernel.IntegerStagesCascade(feed, 0.9999999, 0.002, design));
+  IsotopeArray depleted = {0, 0, 0, 0, 0, 1};
+  EXPECT_FALSE(kernel.IntegerStagesCascade(depleted, 0.05, 0.002, design));
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Returns true if the calculator, the kernel and the conversion table all
+// accept the targets and false if all of them reject them. Fails if they
+// disagree.
+bool StagingAccepted(const IsotopeArray& feed, double gamma_235,
+                     double product_assay, double tails_assay) {
+  CascadeCache::Instance().Clear();
+  bool calculator_accepts = true;
+  try {
+    EnrichmentCalculator e(feed, product_assay, tails_assay, gamma_235,
+                           EnrichmentProcess::kCentrifuge, 1e299, 1., 1e299,
+                           true, true,
+                           EnrichmentModel::kMatchedAbundanceRatio);
+  } catch (Error& e) {
+    calculator_accepts = false;
+  }
+  MarcKernel<UraniumIsotopes> kernel(
+      SeparationFactors<CentrifugeProcess>(gamma_235));
+  CascadeDesign design;
+  EXPECT_EQ(calculator_accepts, kernel.IntegerStagesCascade(
+      feed, product_assay, tails_assay, design));
+  ConversionTable table(feed, gamma_235, EnrichmentProcess::kCentrifuge,
+                        product_assay, tails_assay);
+  EXPECT_EQ(calculator_accepts, table.Find(product_assay, tails_assay,
+                                           design));
+  return calculator_accepts;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST(CascadeDesignTest, IntegerStagingEdges) {
+  // With a low separation factor, the product assay of `kIterMax`
+  // enriching stages is the highest one that can be reached.
+  IsotopeArray feed = CompMapToIsotopeArray(misotest::comp_natU()->atom());
+  MarcKernel<UraniumIsotopes> kernel(
+      SeparationFactors<CentrifugeProcess>(1.05));
+  double max_product_assay =
+      kernel.Cascade(feed, kIterMax, 0).product_composition[kIdx235];
+  EXPECT_TRUE(StagingAccepted(feed, 1.05, max_product_assay, 0.002));
+  EXPECT_FALSE(StagingAccepted(feed, 1.05,
+                               std::nextafter(max_product_assay, 1.),
+                               0.002));
+  EXPECT_FALSE(StagingAccepted(feed, 1.05, 0.2, 1e-7));
+
+  // The product assay is reached by the enriching section alone. The
+  // stripping stages lower the product assay of reprocessed uranium
+  // slightly, which does not reject the staging.
+  IsotopeArray reprocessed = CompMapToIsotopeArray(
+      misotest::comp_reprocessedU()->atom());
+  MarcKernel<UraniumIsotopes> reprocessed_kernel(
+      SeparationFactors<CentrifugeProcess>(1.4));
+  double product_assay = reprocessed_kernel.Cascade(
+      reprocessed, 30, 0).product_composition[kIdx235];
+  ASSERT_LT(reprocessed_kernel.Cascade(
+      reprocessed, 30, 10).product_composition[kIdx235], product_assay);
+  EXPECT_TRUE(StagingAccepted(reprocessed, 1.4, product_assay, 0.002));
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Checks the targets, the isotope balance and that the lighter isotopes
+// get enriched more than the heavier ones.
+template <typename Isotopes>
+void ExpectValidDesign(const BasicIsotopeArray<Isotopes>& feed,
+                       double product_assay, double tails_assay) {
+  MarcKernel<Isotopes> kernel(
+      SeparationFactors<CentrifugeProcess, Isotopes>(1.3));
+  BasicCascadeDesign<double, Isotopes> design;
+  ASSERT_TRUE(kernel.IntegerStagesCascade(feed, product_assay, tails_assay,
+                                          design));
+  // The product assay is reached by the enriching section alone, the
+  // stripping section lowers it slightly.
+  const int kIdxKey = Isotopes::kIdxKey;
+  BasicCascadeDesign<double, Isotopes> no_stripping = kernel.Cascade(
+      feed, design.n_enriching, 0);
+  EXPECT_GE(no_stripping.product_composition[kIdxKey], product_assay);
+  EXPECT_GT(design.product_composition[kIdxKey], feed[kIdxKey]);
+  EXPECT_LE(design.tails_composition[kIdxKey], tails_assay);
+  EXPECT_NEAR(design.sum_e + design.sum_s, 1., 1e-12);
+  for (int i = 0; i < Isotopes::kNumIsotopes; i++) {
+    EXPECT_NEAR(design.sum_e*design.product_composition[i]
+                + design.sum_s*design.tails_composition[i], feed[i], 1e-12);
+    if (i > 0) {
+      EXPECT_LT(design.product_composition[i] / feed[i],
+                design.product_composition[i-1] / feed[i-1]);
+    }
+  }
+
+  auto flows = CalculateFlows(design, 1e299, 1., 1e299, false);
+  EXPECT_DOUBLE_EQ(flows.feed_qty, flows.product_qty + flows.tails_qty);
+  EXPECT_GT(flows.swu, 0);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST(CascadeDesignTest, MarcKernelOtherIsotopes) {
+  // Natural isotopic abundances (atom fractions).
+  BasicIsotopeArray<XenonIsotopes> xenon = {
+      0.000952, 0.000890, 0.019102, 0.264006, 0.040710, 0.212324, 0.269086,
+      0.104357, 0.088573};
+  ExpectValidDesign<XenonIsotopes>(xenon, 0.01, 0.0005);
+
+  BasicIsotopeArray<MolybdenumIsotopes> molybdenum = {
+      0.14649, 0.09187, 0.15873, 0.16673, 0.09582, 0.24292, 0.09744};
+  ExpectValidDesign<MolybdenumIsotopes>(molybdenum, 0.3, 0.1);
+
+  BasicIsotopeArray<ZincIsotopes> zinc = {
+      0.4917, 0.2773, 0.0404, 0.1845, 0.0061};
+  ExpectValidDesign<ZincIsotopes>(zinc, 0.7, 0.3);
+}
+
+}  // namespace misoenrichment
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// required to get functionality in cyclus agent unit tests library
+#ifndef CYCLUS_AGENT_TESTS_CONNECTED
+int ConnectAgentTests();
+static int cyclus_agent_tests_connected = ConnectAgentTests();
+#define CYCLUS_AGENT_TESTS_CONNECTED cyclus_agent_tests_connected
+#endif  // CYCLUS_AGENT_TESTS_CONNECTED
@@ -0,0 +1,513 @@
+#include "cascade_network.h"
+
+#include <algorithm>
+#include <cmath>
+#include <queue>
+#include <set>
+#include <sstream>
+
+#include "cascade_calculator.h"
+#include "core_error.h"
+
+namespace misoenrichment {
+
+// Relative change of the number of stages below which a non-integer
+// staging of the network is considered converged.
+const double kNetworkStagingTol = 1e-9;
+
+namespace {
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+int ParseDestination(const std::string& destination) {
+  if (destination == "product") {
+    return kNetworkProduct;
+  }
+  if (destination == "tails") {
+    return kNetworkTails;
+  }
+  std::istringstream iss(destination);
+  int index;
+  if (!(iss >> index) || !iss.eof()) {
+    throw ValueError("Invalid cascade network destination '"
+                     + destination + "'");
+  }
+  return index;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Solves a x = b using Gaussian elimination with partial pivoting. The
+// networks only contain a handful of cascades.
+std::vector<double> SolveLinearSystem(std::vector<std::vector<double> > a,
+                                      std::vector<double> b) {
+  int n = b.size();
+  for (int col = 0; col < n; col++) {
+    int pivot = col;
+    for (int row = col+1; row < n; row++) {
+      if (std::fabs(a[row][col]) > std::fabs(a[pivot][col])) {
+        pivot = row;
+      }
+    }
+    if (a[pivot][col] == 0) {
+      throw Error("Singular cascade network");
+    }
+    std::swap(a[col], a[pivot]);
+    std::swap(b[col], b[pivot]);
+    for (int row = col+1; row < n; row++) {
+      double factor = a[row][col] / a[col][col];
+      for (int j = col; j < n; j++) {
+        a[row][j] -= factor * a[col][j];
+      }
+      b[row] -= factor * b[col];
+    }
+  }
+  std::vector<double> x(n);
+  for (int row = n-1; row >= 0; row--) {
+    double sum = b[row];
+    for (int j = row+1; j < n; j++) {
+      sum -= a[row][j] * x[j];
+    }
+    x[row] = sum / a[row][row];
+  }
+  return x;
+}
+
+}  // namespace
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+std::vector<NetworkCascade> ParseCascadeNetwork(
+    const std::vector<std::string>& entries) {
+  std::vector<NetworkCascade> cascades;
+  for (int k = 0; k < static_cast<int>(entries.size()); k++) {
+    std::istringstream iss(entries[k]);
+    NetworkCascade cascade;
+    std::string product_to;
+    std::string tails_to;
+    std::string rest;
+    if (!(iss >> cascade.product_assay >> cascade.tails_assay >> product_to
+          >> tails_to) || (iss >> rest)) {
+      throw ValueError("Invalid cascade network entry '"
+                       + entries[k] + "', expected '<product "
+                       "assay> <tails assay> <product destination> "
+                       "<tails destination>'");
+    }
+    cascade.product_to = ParseDestination(product_to);
+    cascade.tails_to = ParseDestination(tails_to);
+    cascades.push_back(cascade);
+  }
+  return cascades;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+CascadeNetwork::CascadeNetwork(const std::vector<NetworkCascade>& cascades,
+                               double gamma_235,
+                               EnrichmentProcess enrichment_process,
+                               bool use_integer_stages)
+    : cascades_(cascades), gamma_235_(gamma_235),
+      enrichment_process_(enrichment_process),
+      use_integer_stages_(use_integer_stages) {
+  int n = cascades_.size();
+  if (n == 0) {
+    throw ValueError("The cascade network is empty");
+  }
+  bool delivers_product = false;
+  bool delivers_tails = false;
+  for (int k = 0; k < n; k++) {
+    const NetworkCascade& cascade = cascades_[k];
+    for (int to : {cascade.product_to, cascade.tails_to}) {
+      if (to != kNetworkProduct && to != kNetworkTails
+          && (to < 0 || to >= n || to == k)) {
+        std::stringstream ss;
+        ss << "Cascade " << k << " of the network sends a stream to the "
+           << "invalid destination " << to;
+        throw ValueError(ss.str());
+      }
+    }
+    if (cascade.product_assay < 0 || cascade.product_assay >= 1
+        || cascade.tails_assay < 0 || cascade.tails_assay >= 1) {
+      std::stringstream ss;
+      ss << "Cascade " << k << " of the network has invalid target assays";
+      throw ValueError(ss.str());
+    }
+    delivers_product |= cascade.product_to == kNetworkProduct;
+    delivers_tails |= cascade.tails_to == kNetworkTails;
+  }
+  if (!delivers_product || !delivers_tails) {
+    throw ValueError("The cascade network must deliver the product "
+                     "of a cascade as product and the tails of a "
+                     "cascade as tails");
+  }
+
+  // Breadth-first search from cascade 0, which yields the order in which
+  // the cascades get their initial design.
+  std::vector<bool> reached(n, false);
+  std::queue<int> queue;
+  queue.push(0);
+  reached[0] = true;
+  while (!queue.empty()) {
+    int k = queue.front();
+    queue.pop();
+    feed_order_.push_back(k);
+    for (int to : {cascades_[k].product_to, cascades_[k].tails_to}) {
+      if (to >= 0 && !reached[to]) {
+        reached[to] = true;
+        queue.push(to);
+      }
+    }
+  }
+  if (static_cast<int>(feed_order_.size()) != n) {
+    throw ValueError("Not all cascades of the network are fed");
+  }
+
+  // Every cascade needs a path out of the network, else the material
+  // would circulate forever.
+  std::vector<bool> leaves(n, false);
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (int k = 0; k < n; k++) {
+      if (leaves[k]) {
+        continue;
+      }
+      for (int to : {cascades_[k].product_to, cascades_[k].tails_to}) {
+        if (to < 0 || leaves[to]) {
+          leaves[k] = true;
+          changed = true;
+          break;
+        }
+      }
+    }
+  }
+  for (int k = 0; k < n; k++) {
+    if (!leaves[k]) {
+      std::stringstream ss;
+      ss << "The streams of cascade " << k << " never leave the network";
+      throw ValueError(ss.str());
+    }
+  }
+
+  IsotopeArray alpha_star = AlphaStar(gamma_235_, enrichment_process_);
+  for (int i = 0; i < kNumIsotopes; i++) {
+    log_alpha_star_[i] = std::log(alpha_star[i]);
+  }
+  ValueFunctionCoefficients(
+      SeparationFactors(gamma_235_, enrichment_process_),
+      value_coefficients_, value_log_term_);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+bool CascadeNetwork::ValidAssays(double product_assay,
+                                 double tails_assay) const {
+  return AssayError_(product_assay, tails_assay).empty();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+std::string CascadeNetwork::AssayError_(double product_assay,
+                                        double tails_assay) const {
+  std::stringstream ss;
+  if (!(product_assay > 0 && product_assay < 1 && tails_assay > 0
+        && tails_assay < 1)) {
+    ss << "The requested product assay " << product_assay << " and the "
+       << "tails assay " << tails_assay << " of the cascade network must "
+       << "lie between 0 and 1";
+    return ss.str();
+  }
+  int n = cascades_.size();
+  std::vector<double> product_assays(n);
+  std::vector<double> tails_assays(n);
+  for (int k = 0; k < n; k++) {
+    product_assays[k] = cascades_[k].product_assay > 0
+                        ? cascades_[k].product_assay : product_assay;
+    tails_assays[k] = cascades_[k].tails_assay > 0
+                      ? cascades_[k].tails_assay : tails_assay;
+    if (!(tails_assays[k] < product_assays[k])) {
+      ss << "Cascade " << k << " of the network has a product assay of "
+         << product_assays[k] << ", which does not lie above its tails "
+         << "assay of " << tails_assays[k];
+      return ss.str();
+    }
+  }
+  for (int k = 0; k < n; k++) {
+    int to = cascades_[k].product_to;
+    if (to >= 0 && !(product_assays[to] > product_assays[k])) {
+      ss << "Cascade " << to << " of the network enriches the product of "
+         << "cascade " << k << " (assay " << product_assays[k] << "), "
+         << "hence its product assay " << product_assays[to] << " must "
+         << "lie above it";
+      return ss.str();
+    }
+    to = cascades_[k].tails_to;
+    if (to >= 0 && !(tails_assays[to] < tails_assays[k])) {
+      ss << "Cascade " << to << " of the network strips the tails of "
+         << "cascade " << k << " (assay " << tails_assays[k] << "), "
+         << "hence its tails assay " << tails_assays[to] << " must lie "
+         << "below it";
+      return ss.str();
+    }
+  }
+  return "";
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+CascadeDesign CascadeNetwork::Design_(int k,
+                                      const IsotopeArray& feed_composition,
+                                      double product_assay,
+                                      double tails_assay,
+                                      double min_n_enriching,
+                                      double min_n_stripping) const {
+  const NetworkCascade& cascade = cascades_[k];
+  double cascade_product_assay = cascade.product_assay > 0
+                                 ? cascade.product_assay : product_assay;
+  double cascade_tails_assay = cascade.tails_assay > 0
+                               ? cascade.tails_assay : tails_assay;
+  double feed_assay = feed_composition[kIdx235];
+  if (!(feed_assay > cascade_tails_assay
+        && feed_assay < cascade_product_assay)) {
+    std::stringstream ss;
+    ss << "Cascade " << k << " of the network is fed with a U235 assay of "
+       << feed_assay << ", which does not lie between its tails assay "
+       << cascade_tails_assay << " and its product assay "
+       << cascade_product_assay;
+    throw ValueError(ss.str());
+  }
+  CascadeCalculator calculator(
+      feed_composition, cascade_product_assay, cascade_tails_assay,
+      gamma_235_, enrichment_process_, 1e299, 1., 1e299, false,
+      use_integer_stages_, EnrichmentModel::kMatchedAbundanceRatio);
+  CascadeDesign design = calculator.Design();
+  if (design.n_enriching >= min_n_enriching
+      && design.n_stripping >= min_n_stripping) {
+    return design;
+  }
+  CascadeCalculator fixed(
+      feed_composition, cascade_product_assay, cascade_tails_assay,
+      gamma_235_, enrichment_process_, 1e299, 1., 1e299, false,
+      use_integer_stages_, EnrichmentModel::kMatchedAbundanceRatio,
+      std::max(design.n_enriching, min_n_enriching),
+      std::max(design.n_stripping, min_n_stripping));
+  return fixed.Design();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+std::vector<IsotopeArray> CascadeNetwork::IsotopeFlows_(
+    const IsotopeArray& feed_composition,
+    const std::vector<CascadeDesign>& designs) const {
+  int n = cascades_.size();
+  std::vector<IsotopeArray> flows(n);
+  for (int i = 0; i < kNumIsotopes; i++) {
+    // Balance of isotope i entering each cascade, (I - A) x = b, with
+    // A[to][k] being the fraction of the isotope sent from k to `to`.
+    std::vector<std::vector<double> > a(n, std::vector<double>(n, 0.));
+    std::vector<double> b(n, 0.);
+    b[0] = feed_composition[i];
+    for (int k = 0; k < n; k++) {
+      a[k][k] += 1.;
+      double r = TailsToProductRatio(log_alpha_star_[i],
+                                     designs[k].n_enriching,
+                                     designs[k].n_stripping);
+      if (cascades_[k].product_to >= 0) {
+        a[cascades_[k].product_to][k] -= 1. / (1.+r);
+      }
+      if (cascades_[k].tails_to >= 0) {
+        a[cascades_[k].tails_to][k] -= 1. / (1.+1./r);
+      }
+    }
+    std::vector<double> x = SolveLinearSystem(a, b);
+    for (int k = 0; k < n; k++) {
+      flows[k][i] = x[k];
+    }
+  }
+  return flows;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+NetworkSolution CascadeNetwork::Solve(const IsotopeArray& feed_composition,
+                                      double product_assay,
+                                      double tails_assay) const {
+  std::string assay_error = AssayError_(product_assay, tails_assay);
+  if (!assay_error.empty()) {
+    throw ValueError(assay_error);
+  }
+  CascadeCache::Key key = CascadeCache::MakeKey(
+      feed_composition, product_assay, tails_assay, gamma_235_,
+      enrichment_process_, use_integer_stages_, false);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = solutions_.find(key);
+    if (it != solutions_.end()) {
+      return it->second;
+    }
+  }
+
+  int n = cascades_.size();
+  NetworkSolution solution;
+  solution.designs.resize(n);
+  solution.feed_qty.assign(n, 0.);
+
+  // Initial designs, obtained by passing the streams through the network
+  // once while ignoring the streams sent back to earlier cascades.
+  std::vector<IsotopeArray> inflows(n, IsotopeArray());
+  for (int k = 0; k < n; k++) {
+    inflows[k].fill(0.);
+  }
+  inflows[0] = feed_composition;
+  for (int k : feed_order_) {
+    double feed = 0;
+    for (int i = 0; i < kNumIsotopes; i++) {
+      feed += inflows[k][i];
+    }
+    IsotopeArray composition;
+    for (int i = 0; i < kNumIsotopes; i++) {
+      composition[i] = inflows[k][i] / feed;
+    }
+    CascadeDesign& design = solution.designs[k];
+    design = Design_(k, composition, product_assay, tails_assay);
+    for (int i = 0; i < kNumIsotopes; i++) {
+      if (cascades_[k].product_to >= 0) {
+        inflows[cascades_[k].product_to][i] +=
+            feed * design.sum_e * design.product_composition[i];
+      }
+      if (cascades_[k].tails_to >= 0) {
+        inflows[cascades_[k].tails_to][i] +=
+            feed * design.sum_s * design.tails_composition[i];
+      }
+    }
+  }
+
+  // Fixed-point iteration on the stagings. An integer staging may
+  // alternate between two stagings, as a cascade with one more stage
+  // changes the streams recycled into it such that it needs one stage
+  // less. Once a staging repeats, the stagings are therefore no longer
+  // allowed to decrease, which always terminates and yields stagings that
+  // reach all targets.
+  std::set<std::vector<double> > previous_stagings;
+  bool only_increase = false;
+  bool converged = false;
+  for (int iter = 0; iter < kIterMax && !converged; iter++) {
+    std::vector<double> staging;
+    for (int k = 0; k < n; k++) {
+      staging.push_back(solution.designs[k].n_enriching);
+      staging.push_back(solution.designs[k].n_stripping);
+    }
+    if (use_integer_stages_ && !previous_stagings.insert(staging).second) {
+      only_increase = true;
+    }
+
+    inflows = IsotopeFlows_(feed_composition, solution.designs);
+    converged = true;
+    for (int k = 0; k < n; k++) {
+      double feed = 0;
+      for (int i = 0; i < kNumIsotopes; i++) {
+        feed += inflows[k][i];
+      }
+      IsotopeArray composition;
+      for (int i = 0; i < kNumIsotopes; i++) {
+        composition[i] = inflows[k][i] / feed;
+      }
+      solution.feed_qty[k] = feed;
+      const CascadeDesign& previous = solution.designs[k];
+      CascadeDesign design = Design_(
+          k, composition, product_assay, tails_assay,
+          only_increase ? previous.n_enriching : 0,
+          only_increase ? previous.n_stripping : 0);
+      if (use_integer_stages_) {
+        converged &= design.n_enriching == previous.n_enriching
+                     && design.n_stripping == previous.n_stripping;
+      } else {
+        converged &=
+            std::fabs(design.n_enriching-previous.n_enriching)
+                <= kNetworkStagingTol * (1.+design.n_enriching)
+            && std::fabs(design.n_stripping-previous.n_stripping)
+                <= kNetworkStagingTol * (1.+design.n_stripping);
+      }
+      solution.designs[k] = design;
+    }
+  }
+  if (!converged) {
+    throw Error("The stagings of the cascade network did not "
+                "converge!");
+  }
+
+  // Collect the streams leaving the network.
+  IsotopeArray product_flows;
+  IsotopeArray tails_flows;
+  product_flows.fill(0.);
+  tails_flows.fill(0.);
+  solution.swu = 0;
+  for (int k = 0; k < n; k++) {
+    const CascadeDesign& design = solution.designs[k];
+    double feed = solution.feed_qty[k];
+    for (int i = 0; i < kNumIsotopes; i++) {
+      if (cascades_[k].product_to == kNetworkProduct) {
+        product_flows[i] += feed * design.sum_e
+                            * design.product_composition[i];
+      } else if (cascades_[k].product_to == kNetworkTails) {
+        tails_flows[i] += feed * design.sum_e
+                          * design.product_composition[i];
+      }
+      if (cascades_[k].tails_to == kNetworkProduct) {
+        product_flows[i] += feed * design.sum_s
+                            * design.tails_composition[i];
+      } else if (cascades_[k].tails_to == kNetworkTails) {
+        tails_flows[i] += feed * design.sum_s * design.tails_composition[i];
+      }
+    }
+    solution.swu += feed * design.swu_per_feed;
+  }
+  solution.product_qty = 0;
+  solution.tails_qty = 0;
+  for (int i = 0; i < kNumIsotopes; i++) {
+    solution.product_qty += product_flows[i];
+    solution.tails_qty += tails_flows[i];
+  }
+  for (int i = 0; i < kNumIsotopes; i++) {
+    solution.product_composition[i] = product_flows[i]
+                                      / solution.product_qty;
+    solution.tails_composition[i] = tails_flows[i] / solution.tails_qty;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (solutions_.size() >= kCascadeCacheCapacity) {
+    solutions_.clear();
+  }
+  solutions_.emplace(key, solution);
+  return solution;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+CascadeFlows CascadeNetwork::Flows(const IsotopeArray& feed_composition,
+                                   double product_assay, double tails_assay,
+                                   double feed_qty, double product_qty,
+                                   double max_swu,
+                                   bool use_downblending) const {
+  NetworkSolution solution = Solve(feed_composition, product_assay,
+                                   tails_assay);
+
+  // The network acts as a single cascade whose separative work per unit
+  // of feed is the one of all cascades, see `CalculateFlows`. It exceeds
+  // the one of the network streams if streams of different compositions
+  // are mixed at the cascade inlets.
+  CascadeDesign design;
+  design.n_enriching = 0;
+  design.n_stripping = 0;
+  for (int k = 0; k < static_cast<int>(solution.designs.size()); k++) {
+    design.n_enriching += solution.designs[k].n_enriching;
+    design.n_stripping += solution.designs[k].n_stripping;
+  }
+  design.feed_composition = feed_composition;
+  design.product_composition = solution.product_composition;
+  design.tails_composition = solution.tails_composition;
+  design.target_product_assay = product_assay;
+  design.sum_e = solution.product_qty;
+  design.sum_s = solution.tails_qty;
+  design.value_feed = ValueFunction(feed_composition, value_coefficients_,
+                                    value_log_term_);
+  design.value_product = ValueFunction(design.product_composition,
+                                       value_coefficients_, value_log_term_);
+  design.value_tails = ValueFunction(design.tails_composition,
+                                     value_coefficients_, value_log_term_);
+  design.swu_per_feed = solution.swu;
+  return CalculateFlows(design, feed_qty, product_qty, max_swu,
+                        use_downblending);
+}
+
+}  // namespace misoenrichment
@@ -0,0 +1,148 @@
+#ifndef MISOENRICHMENT_SRC_CASCADE_NETWORK_H_
+#define MISOENRICHMENT_SRC_CASCADE_NETWORK_H_
+
+#include <array>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "cascade_cache.h"
+#include "cascade_design.h"
+#include "core_helper.h"
+#include "enrichment_process.h"
+
+namespace misoenrichment {
+
+// Destinations of the streams of a cascade other than another cascade.
+const int kNetworkProduct = -1;
+const int kNetworkTails = -2;
+
+// One matched abundance ratio cascade of a `CascadeNetwork`.
+struct NetworkCascade {
+  // Target U235 assays of the cascade. Zero means the product assay
+  // requested from the network and the tails assay of the network,
+  // respectively.
+  double product_assay;
+  double tails_assay;
+  // Index of the cascade fed by the product (tails) stream, or
+  // `kNetworkProduct` or `kNetworkTails` if the stream leaves the network.
+  int product_to;
+  int tails_to;
+};
+
+// Parses the 'cascade_network' variable of `MIsoEnrich`. Every entry
+// describes one cascade as
+//   '<product assay> <tails assay> <product destination> <tails destination>'
+// with the destinations being 'product', 'tails' or the (zero-based)
+// index of a cascade, e.g., '0.2 0 1 tails'. Throws a ValueError
+// if an entry is malformed.
+std::vector<NetworkCascade> ParseCascadeNetwork(
+    const std::vector<std::string>& entries);
+
+// Steady state of a cascade network per unit of external feed.
+struct NetworkSolution {
+  // Design of each cascade. Its feed composition is the one of the mixture
+  // of all streams entering the cascade.
+  std::vector<CascadeDesign> designs;
+  // Feed entering each cascade per unit of external feed.
+  std::vector<double> feed_qty;
+
+  // Network product and tails per unit of external feed, the product is
+  // the one leaving the cascades, i.e., before any downblending.
+  double product_qty;
+  double tails_qty;
+  IsotopeArray product_composition;
+  IsotopeArray tails_composition;
+  // Separative work of all cascades per unit of external feed.
+  double swu;
+};
+
+// Directed network of matched abundance ratio cascades, e.g., a natural
+// uranium to LEU plant followed by an LEU to HEU plant whose tails are
+// recycled into the first plant. The external feed enters cascade 0, each
+// cascade sends its product and tails either into another cascade or out
+// of the network. Streams entering the same cascade are mixed.
+//
+// The network is solved as a whole. For fixed stagings, the fraction of
+// each isotope leaving a cascade via the product does not depend on the
+// feed composition (see `CalculateConcentrations`), such that the flows of
+// each isotope follow from a small linear system. The stagings are then
+// redesigned for the resulting feed compositions until they do not change
+// anymore. The designs of the single cascades are obtained using
+// `CascadeCalculator`, i.e., they go through the `CascadeCache`, and
+// the solutions of the network are memoised as well.
+class CascadeNetwork {
+ public:
+  // Throws a ValueError if the network is empty or contains
+  // invalid destinations or assays, if a cascade is not reachable from
+  // cascade 0, if the streams of a cascade never leave the network or if
+  // no cascade product (tails) leaves the network as product (tails).
+  CascadeNetwork(const std::vector<NetworkCascade>& cascades,
+                 double gamma_235, EnrichmentProcess enrichment_process,
+                 bool use_integer_stages);
+
+  // Returns the steady state of the network for the given requested
+  // product assay and network tails assay. Throws an Error if the
+  // stagings do not converge within `kIterMax` iterations or if a cascade
+  // cannot be designed. Throws a ValueError if the assays are not valid,
+  // see `ValidAssays`.
+  NetworkSolution Solve(const IsotopeArray& feed_composition,
+                        double product_assay, double tails_assay) const;
+
+  // Same as `CalculateFlows` with the network taking the role of a single
+  // cascade. The product is downblended with external feed if enabled and
+  // if it exceeds `product_assay`. Use 1e299 for quantities that are not
+  // constraining.
+  CascadeFlows Flows(const IsotopeArray& feed_composition,
+                     double product_assay, double tails_assay,
+                     double feed_qty, double product_qty, double max_swu,
+                     bool use_downblending) const;
+
+  // Returns true if the network can be designed for the requested product
+  // assay and network tails assay: the target tails assay of every cascade
+  // must lie below its target product assay, and a product (tails) stream
+  // entering another cascade must be enriched (depleted) further there.
+  bool ValidAssays(double product_assay, double tails_assay) const;
+
+  inline int size() const { return cascades_.size(); }
+
+ private:
+  // Returns why the assays are not valid (see `ValidAssays`), or an empty
+  // string if they are.
+  std::string AssayError_(double product_assay, double tails_assay) const;
+  // Designs cascade `k` for the given feed composition, using at least
+  // the given number of stages in each section. Throws a ValueError if the
+  // U235 assay of the feed does not lie between the target assays.
+  CascadeDesign Design_(int k, const IsotopeArray& feed_composition,
+                        double product_assay, double tails_assay,
+                        double min_n_enriching=0,
+                        double min_n_stripping=0) const;
+  // Solves the isotope flows for the current stagings and returns the
+  // flow of each isotope entering each cascade.
+  std::vector<IsotopeArray> IsotopeFlows_(
+      const IsotopeArray& feed_composition,
+      const std::vector<CascadeDesign>& designs) const;
+
+  std::vector<NetworkCascade> cascades_;
+  // Cascades ordered such that each one is fed by an earlier one, except
+  // for cascade 0 receiving the external feed.
+  std::vector<int> feed_order_;
+
+  double gamma_235_;
+  EnrichmentProcess enrichment_process_;
+  bool use_integer_stages_;
+  IsotopeArray log_alpha_star_;
+  // Coefficients of the value function, see `ValueFunctionCoefficients`.
+  IsotopeArray value_coefficients_;
+  std::array<bool, kNumIsotopes> value_log_term_;
+
+  // Memoised solutions, keyed like the designs of the `CascadeCache`. The
+  // map is cleared once it holds `kCascadeCacheCapacity` solutions.
+  mutable std::map<CascadeCache::Key, NetworkSolution> solutions_;
+  mutable std::mutex mutex_;
+};
+
+}  // namespace misoenrichment
+
+#endif  // MISOENRICHMENT_SRC_CASCADE_NETWORK_H_
@@ -0,0 +1,214 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "cascade_network.h"
+#include "core_error.h"
+#include "enrichment_calculator.h"
+#include "miso_helper.h"
+
+namespace misoenrichment {
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+IsotopeArray NetworkNaturalUranium() {
+  return CompMapToIsotopeArray(misotest::comp_natU()->atom());
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Checks that every isotope entering the network leaves it.
+void ExpectIsotopeBalance(const NetworkSolution& solution,
+                          const IsotopeArray& feed) {
+  for (int i = 0; i < kNumIsotopes; i++) {
+    EXPECT_NEAR(feed[i],
+                solution.product_qty*solution.product_composition[i]
+                + solution.tails_qty*solution.tails_composition[i],
+                1e-10);
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST(CascadeNetworkTest, Parse) {
+  std::vector<NetworkCascade> cascades = ParseCascadeNetwork(
+      {"0.2 0 1 tails", " 0   0.0072 product 0 "});
+  ASSERT_EQ(cascades.size(), 2);
+  EXPECT_DOUBLE_EQ(cascades[0].product_assay, 0.2);
+  EXPECT_DOUBLE_EQ(cascades[0].tails_assay, 0);
+  EXPECT_EQ(cascades[0].product_to, 1);
+  EXPECT_EQ(cascades[0].tails_to, kNetworkTails);
+  EXPECT_DOUBLE_EQ(cascades[1].tails_assay, 0.0072);
+  EXPECT_EQ(cascades[1].product_to, kNetworkProduct);
+  EXPECT_EQ(cascades[1].tails_to, 0);
+
+  EXPECT_THROW(ParseCascadeNetwork({"0.2 0 1"}), ValueError);
+  EXPECT_THROW(ParseCascadeNetwork({"0.2 0 1 tails 3"}), ValueError);
+  EXPECT_THROW(ParseCascadeNetwork({"0.2 0 first tails"}),
+               ValueError);
+  EXPECT_THROW(ParseCascadeNetwork({"0.2 0 1.5 tails"}), ValueError);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST(CascadeNetworkTest, InvalidNetworks) {
+  EnrichmentProcess centrifuge = EnrichmentProcess::kCentrifuge;
+  std::vector<std::vector<std::string> > invalid = {
+      {},
+      // Destination out of range and self-feeding cascade.
+      {"0 0 1 tails"},
+      {"0 0 0 tails"},
+      // Invalid assay.
+      {"1.2 0 product tails"},
+      // No network tails.
+      {"0 0 product product"},
+      // Cascade 1 is not fed.
+      {"0 0 product tails", "0 0 product tails"},
+      // The streams of cascades 1 and 2 circulate forever.
+      {"0.2 0 1 tails", "0 0 2 2", "0 0 1 1"}};
+  for (int n = 0; n < invalid.size(); n++) {
+    EXPECT_THROW(CascadeNetwork(ParseCascadeNetwork(invalid[n]), 1.4,
+                                centrifuge, true),
+                 ValueError) << "network " << n;
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST(CascadeNetworkTest, InvalidRequests) {
+  IsotopeArray feed = NetworkNaturalUranium();
+  // The second cascade cannot enrich the 20% product of the first cascade
+  // to 10%, and the first one cannot strip its 1% tails to 2%.
+  std::vector<std::string> recycle = {"0.2 0 1 tails", "0 0.01 product 0"};
+  for (bool use_integer_stages : {true, false}) {
+    CascadeNetwork network(ParseCascadeNetwork(recycle), 1.4,
+                           EnrichmentProcess::kCentrifuge,
+                           use_integer_stages);
+    EXPECT_TRUE(network.ValidAssays(0.9, 0.003));
+    EXPECT_FALSE(network.ValidAssays(0.1, 0.003));
+    EXPECT_FALSE(network.ValidAssays(0.9, 0.02));
+    EXPECT_FALSE(network.ValidAssays(0.9, 0));
+    EXPECT_THROW(network.Solve(feed, 0.1, 0.003), ValueError);
+    EXPECT_THROW(network.Flows(feed, 0.1, 0.003, 1e299, 10., 1e299, true),
+                 ValueError);
+  }
+  // The U235 assay of the feed must lie between the target assays.
+  CascadeNetwork network(ParseCascadeNetwork({"0 0 product tails"}), 1.4,
+                         EnrichmentProcess::kCentrifuge, true);
+  EXPECT_THROW(network.Solve(feed, 0.005, 0.003), ValueError);
+  EXPECT_THROW(network.Solve(feed, 0.9, 0.008), ValueError);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST(CascadeNetworkTest, SingleCascade) {
+  IsotopeArray feed = NetworkNaturalUranium();
+  CascadeNetwork network(ParseCascadeNetwork({"0 0 product tails"}), 1.4,
+                         EnrichmentProcess::kCentrifuge, true);
+  EXPECT_EQ(network.size(), 1);
+
+  // Same results as a single cascade, including the constraints and the
+  // downblending.
+  EnrichmentInput input;
+  input.feed_composition = feed;
+  input.product_assay = 0.045;
+  input.tails_assay = 0.0025;
+  input.feed_qty = 1000;
+  input.max_swu = 500;
+  for (double product_qty : {10., 1e299}) {
+    input.product_qty = product_qty;
+    EnrichmentResult expected = EvaluateEnrichment(input);
+    CascadeFlows flows = network.Flows(feed, 0.045, 0.0025, 1000,
+                                       product_qty, 500, true);
+    EXPECT_NEAR(flows.feed_qty, expected.flows.feed_qty, 1e-9);
+    EXPECT_NEAR(flows.product_qty, expected.flows.product_qty, 1e-9);
+    EXPECT_NEAR(flows.tails_qty, expected.flows.tails_qty, 1e-9);
+    EXPECT_NEAR(flows.swu, expected.flows.swu, 1e-9);
+    for (int i = 0; i < kNumIsotopes; i++) {
+      EXPECT_NEAR(flows.product_composition[i],
+                  expected.flows.product_composition[i], 1e-14);
+    }
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST(CascadeNetworkTest, CascadesInSeries) {
+  IsotopeArray feed = NetworkNaturalUranium();
+  // Natural uranium to 20% in the first cascade, which is then enriched
+  // to the requested assay in the second cascade, whose tails are
+  // discarded at 0.5%.
+  CascadeNetwork network(
+      ParseCascadeNetwork({"0.2 0 1 tails", "0 0.005 product tails"}), 1.4,
+      EnrichmentProcess::kCentrifuge, false);
+  NetworkSolution solution = network.Solve(feed, 0.9, 0.003);
+  ExpectIsotopeBalance(solution, feed);
+  EXPECT_NEAR(solution.product_composition[kIdx235], 0.9, 1e-9);
+
+  // Without recycling, the network equals the two cascades evaluated one
+  // after the other.
+  EnrichmentCalculator leu(feed, 0.2, 0.003, 1.4,
+                           EnrichmentProcess::kCentrifuge, 1e299, 1e299,
+                           1e299, false, false,
+                           EnrichmentModel::kMatchedAbundanceRatio);
+  EnrichmentResult leu_result = leu.Result();
+  EnrichmentCalculator heu(leu_result.flows.product_composition, 0.9, 0.005,
+                           1.4, EnrichmentProcess::kCentrifuge, 1e299,
+                           1e299, 1e299, false, false,
+                           EnrichmentModel::kMatchedAbundanceRatio);
+  EXPECT_NEAR(solution.feed_qty[0], 1., 1e-14);
+  EXPECT_NEAR(solution.feed_qty[1], leu.Design().sum_e, 1e-14);
+  EXPECT_NEAR(solution.designs[1].n_enriching, heu.Design().n_enriching,
+              1e-9);
+  double swu_per_feed = leu.Design().swu_per_feed
+                        + leu.Design().sum_e*heu.Design().swu_per_feed;
+  EXPECT_NEAR(solution.swu, swu_per_feed, 1e-9 * swu_per_feed);
+
+  CascadeFlows flows = network.Flows(feed, 0.9, 0.003, 1e299, 10., 1e299,
+                                     true);
+  EXPECT_DOUBLE_EQ(flows.product_qty, 10.);
+  EXPECT_NEAR(flows.feed_qty, 10. / solution.product_qty, 1e-9);
+  EXPECT_NEAR(flows.swu, solution.swu * flows.feed_qty, 1e-9 * flows.swu);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST(CascadeNetworkTest, TailsRecycle) {
+  IsotopeArray feed = NetworkNaturalUranium();
+  // The tails of the HEU cascade are richer than natural uranium and get
+  // recycled into the LEU cascade.
+  std::vector<std::string> entries = {"0.2 0 1 tails",
+                                      "0 0.02 product 0"};
+  for (bool use_integer_stages : {true, false}) {
+    CascadeNetwork network(ParseCascadeNetwork(entries), 1.4,
+                           EnrichmentProcess::kCentrifuge,
+                           use_integer_stages);
+    NetworkSolution solution = network.Solve(feed, 0.9, 0.003);
+    ExpectIsotopeBalance(solution, feed);
+    EXPECT_GE(solution.product_composition[kIdx235], 0.9 - 1e-9);
+    EXPECT_LE(solution.tails_composition[kIdx235], 0.003 + 1e-9);
+
+    // The first cascade processes the external feed and the recycled
+    // tails, its design is consistent with the mixture.
+    const CascadeDesign& recycler = solution.designs[1];
+    double recycled = solution.feed_qty[1] * recycler.sum_s;
+    EXPECT_GT(recycled, 0);
+    EXPECT_NEAR(solution.feed_qty[0], 1. + recycled, 1e-10);
+    double mixed_235 = (feed[kIdx235]
+                        + recycled*recycler.tails_composition[kIdx235])
+                       / solution.feed_qty[0];
+    EXPECT_NEAR(solution.designs[0].feed_composition[kIdx235], mixed_235,
+                1e-10);
+
+    // Recycling the tails saves feed compared to discarding them.
+    CascadeNetwork no_recycle(
+        ParseCascadeNetwork({"0.2 0 1 tails", "0 0.02 product tails"}),
+        1.4, EnrichmentProcess::kCentrifuge, use_integer_stages);
+    EXPECT_GT(solution.product_qty,
+              no_recycle.Solve(feed, 0.9, 0.003).product_qty);
+  }
+}
+
+}  // namespace misoenrichment
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// required to get functionality in cyclus agent unit tests library
+#ifndef CYCLUS_AGENT_TESTS_CONNECTED
+int ConnectAgentTests();
+static int cyclus_agent_tests_connected = ConnectAgentTests();
+#define CYCLUS_AGENT_TESTS_CONNECTED cyclus_agent_tests_connected
+#endif  // CYCLUS_AGENT_TESTS_CONNECTED
@@ -0,0 +1,172 @@
+#include "conversion_table.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+namespace misoenrichment {
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Returns the number of stages that need to be tabulated such that
+// `SmallestIntegerStages` only evaluates tabulated stage numbers for all
+// targets which are reached at least as easily as the one described by
+// `reaches_target`. The doubling phase of the search overshoots the result
+// by up to a factor of two, hence the result is rounded up to a power of
+// two. Stagings with more than `kIterMax` stages are rejected by the
+// calculator and thus never tabulated.
+template <typename Predicate>
+int TabulatedStages(Predicate reaches_target) {
+  int n_stages = SmallestIntegerStages(reaches_target);
+  int n_tabulated = 1;
+  while (n_tabulated < n_stages) {
+    n_tabulated *= 2;
+  }
+  return std::min(n_tabulated, kIterMax);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+ConversionTable::ConversionTable(const IsotopeArray& feed_composition,
+                                 double gamma_235,
+                                 EnrichmentProcess enrichment_process,
+                                 double max_product_assay,
+                                 double min_tails_assay)
+    : feed_composition_(feed_composition),
+      gamma_235_(gamma_235),
+      enrichment_process_(enrichment_process) {
+  if (!(feed_composition[kIdx235] > 0) || !(feed_composition[kIdx238] > 0)) {
+    return;
+  }
+  // Same quantities as in `CascadeCalculator::CalculateGammaAlphaStar_`
+  // such that the cascade equations yield the same results.
+  IsotopeArray separation_factors = SeparationFactors(gamma_235,
+                                                      enrichment_process);
+  IsotopeArray alpha_star = AlphaStar(gamma_235, enrichment_process);
+  IsotopeArray log_alpha_star;
+  for (int i = 0; i < kNumIsotopes; i++) {
+    log_alpha_star[i] = std::log(alpha_star[i]);
+  }
+  IsotopeArray coefficients;
+  std::array<bool, kNumIsotopes> log_term;
+  ValueFunctionCoefficients(separation_factors, coefficients, log_term);
+  double value_feed = ValueFunction(feed_composition, coefficients, log_term);
+
+  CascadeDesign design;
+  design.feed_composition = feed_composition;
+  design.value_feed = value_feed;
+  design.target_product_assay = 0;
+  auto concentrations = [&](double n_enriching, double n_stripping) {
+    design.n_enriching = n_enriching;
+    design.n_stripping = n_stripping;
+    CalculateConcentrations(log_alpha_star, feed_composition, n_enriching,
+                            n_stripping, design.product_composition,
+                            design.tails_composition, design.sum_e,
+                            design.sum_s);
+  };
+
+  // The enriching section is determined without stripping stages.
+  int n_enriching_max = TabulatedStages([&](int n_enriching) {
+    concentrations(n_enriching, 0);
+    return !(design.product_composition[kIdx235] < max_product_assay);
+  });
+  enriching_assays_.resize(n_enriching_max);
+  designs_.resize(n_enriching_max);
+  for (int n_e = 1; n_e <= n_enriching_max; n_e++) {
+    concentrations(n_e, 0);
+    enriching_assays_[n_e-1] = design.product_composition[kIdx235];
+
+    int n_stripping_max = TabulatedStages([&](int n_stripping) {
+      concentrations(n_e, n_stripping);
+      return !(design.tails_composition[kIdx235] > min_tails_assay);
+    });
+    std::vector<CascadeDesign>& row = designs_[n_e-1];
+    row.resize(n_stripping_max);
+    for (int n_s = 1; n_s <= n_stripping_max; n_s++) {
+      concentrations(n_e, n_s);
+      design.value_product = ValueFunction(design.product_composition,
+                                           coefficients, log_term);
+      design.value_tails = ValueFunction(design.tails_composition,
+                                         coefficients, log_term);
+      design.swu_per_feed = StreamSwuPerFeed(design);
+      row[n_s-1] = design;
+    }
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+bool ConversionTable::Covers(const IsotopeArray& feed_composition,
+                             double gamma_235,
+                             EnrichmentProcess enrichment_process) const {
+  return !designs_.empty() && feed_composition == feed_composition_
+         && gamma_235 == gamma_235_
+         && enrichment_process == enrichment_process_;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+bool ConversionTable::Find(double product_assay, double tails_assay,
+                           CascadeDesign& design) const {
+  // Same searches as in `CascadeCalculator::CalculateIntegerStages_`.
+  // If they need a staging which has not been tabulated, they are ended
+  // early and the lookup fails.
+  bool covered = true;
+  int n_enriching = SmallestIntegerStages([&](int n) {
+    if (n > static_cast<int>(enriching_assays_.size())) {
+      covered = false;
+      return true;
+    }
+    return !(enriching_assays_[n-1] < product_assay);
+  });
+  // The search ends at `kIterMax + 1` stages without evaluating them if
+  // no tabulated staging reaches the target.
+  if (!covered || n_enriching > static_cast<int>(designs_.size())) {
+    return false;
+  }
+  const std::vector<CascadeDesign>& row = designs_[n_enriching-1];
+  int n_stripping = SmallestIntegerStages([&](int n) {
+    if (n > static_cast<int>(row.size())) {
+      covered = false;
+      return true;
+    }
+    return !(row[n-1].tails_composition[kIdx235] > tails_assay);
+  });
+  if (!covered || n_stripping > static_cast<int>(row.size())) {
+    return false;
+  }
+
+  const CascadeDesign& found = row[n_stripping-1];
+  // Stagings not reaching the targets and compositions lacking U235 or
+  // U238 are rejected by the calculator.
+  if (!IntegerStagingReachesTargets(found.n_enriching, found.n_stripping,
+                                    found.tails_composition[kIdx235],
+                                    tails_assay)
+      || !std::isfinite(found.value_product)
+      || !std::isfinite(found.value_tails)) {
+    return false;
+  }
+  design = found;
+  design.target_product_assay = product_assay;
+  return true;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+bool ConversionTable::Flows(double product_assay, double tails_assay,
+                            double product_qty, bool use_downblending,
+                            CascadeFlows& flows) const {
+  CascadeDesign design;
+  if (!Find(product_assay, tails_assay, design)) {
+    return false;
+  }
+  flows = CalculateFlows(design, 1e299, product_qty, 1e299,
+                         use_downblending);
+  return true;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+int ConversionTable::size() const {
+  int n_designs = 0;
+  for (const std::vector<CascadeDesign>& row : designs_) {
+    n_designs += row.size();
+  }
+  return n_designs;
+}
+
+}  // namespace misoenrichment
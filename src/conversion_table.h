@@ -0,0 +1,78 @@
+#ifndef MISOENRICHMENT_SRC_CONVERSION_TABLE_H_
+#define MISOENRICHMENT_SRC_CONVERSION_TABLE_H_
+
+#include <vector>
+
+#include "cascade_design.h"
+#include "core_helper.h"
+#include "enrichment_process.h"
+
+namespace misoenrichment {
+
+// Precomputed cascade designs of one feed composition, used by the SWU
+// and feed converters to evaluate the capacity constraints without
+// redesigning a cascade for every arc of the exchange.
+//
+// With an integer number of stages, the staging is a step function of the
+// target assays: the number of enriching stages is the smallest one for
+// which the product assay of the cascade without stripping stages reaches
+// the target product assay, the number of stripping stages is then the
+// smallest one for which the tails assay reaches the target tails assay
+// (see `CascadeCalculator::CalculateIntegerStages_`). Between these
+// jumps, the design does not change and the flows are obtained in closed
+// form using `CalculateFlows`, with the target product assay only entering
+// the downblending.
+//
+// Therefore, the table does not interpolate. It stores the assays at which
+// the staging jumps together with the design of every staging. A lookup
+// repeats the stage search of the calculator on the stored assays using
+// `SmallestIntegerStages`, i.e., the same stage numbers are compared in
+// the same way and the result is identical to the one of an
+// `CascadeCalculator` using the matched abundance ratio model and an
+// integer number of stages. A lookup needs O(log(kIterMax)) comparisons
+// and no evaluation of the cascade equations.
+class ConversionTable {
+ public:
+  // Tabulates all stagings needed for product assays up to
+  // `max_product_assay` and tails assays down to `min_tails_assay`. A feed
+  // without U235 or U238 yields an empty table.
+  ConversionTable(const IsotopeArray& feed_composition, double gamma_235,
+                  EnrichmentProcess enrichment_process,
+                  double max_product_assay, double min_tails_assay);
+
+  // Returns true if the table has been built for the given feed
+  // composition (compared exactly), separation factor and process.
+  bool Covers(const IsotopeArray& feed_composition, double gamma_235,
+              EnrichmentProcess enrichment_process) const;
+
+  // Copies the design for the given target assays into `design`. Returns
+  // false if the staging is not covered by the table, e.g., because the
+  // targets lie outside of the tabulated range or because no staging
+  // reaches them. In this case, the calculator has to be used.
+  bool Find(double product_assay, double tails_assay,
+            CascadeDesign& design) const;
+
+  // Calculates the flows needed to deliver `product_qty` with unlimited
+  // feed and separative work, see `Find` for the return value.
+  bool Flows(double product_assay, double tails_assay, double product_qty,
+             bool use_downblending, CascadeFlows& flows) const;
+
+  // Number of designs stored.
+  int size() const;
+
+ private:
+  IsotopeArray feed_composition_;
+  double gamma_235_;
+  EnrichmentProcess enrichment_process_;
+
+  // enriching_assays_[n-1] is the U235 product assay of the cascade with
+  // n enriching and no stripping stages.
+  std::vector<double> enriching_assays_;
+  // designs_[n_e-1][n_s-1] is the design with n_e enriching and n_s
+  // stripping stages, its target product assay is set upon lookup.
+  std::vector<std::vector<CascadeDesign> > designs_;
+};
+
+}  // namespace misoenrichment
+
+#endif  // MISOENRICHMENT_SRC_CONVERSION_TABLE_H_
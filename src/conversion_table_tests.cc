@@ -0,0 +1,135 @@
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <vector>
+
+#include "composition.h"
+
+#include "cascade_cache.h"
+#include "cascade_design.h"
+#include "conversion_table.h"
+#include "core_error.h"
+#include "enrichment_calculator.h"
+#include "enrichment_process.h"
+#include "miso_helper.h"
+
+namespace misoenrichment {
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Product assays at which the number of enriching stages jumps, i.e., the
+// product assays of the cascades without stripping stages.
+std::vector<double> EnrichingJumps(const IsotopeArray& feed, int n_max) {
+  IsotopeArray alpha_star = AlphaStar(1.4, EnrichmentProcess::kCentrifuge);
+  IsotopeArray log_alpha_star;
+  for (int i = 0; i < kNumIsotopes; i++) {
+    log_alpha_star[i] = std::log(alpha_star[i]);
+  }
+  std::vector<double> jumps;
+  for (int n = 1; n <= n_max; n++) {
+    IsotopeArray product;
+    IsotopeArray tails;
+    double sum_e;
+    double sum_s;
+    CalculateConcentrations(log_alpha_star, feed, static_cast<double>(n), 0.,
+                            product, tails, sum_e, sum_s);
+    jumps.push_back(product[kIdx235]);
+  }
+  return jumps;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Checks that the table yields exactly the same flows as the calculator.
+// The cache is cleared as its quantised keys map assays that only differ
+// in the last bits (e.g., the ones next to a staging jump) onto the same
+// design. The targets must lie within the tabulated range, such that a
+// failed lookup means that the calculator rejects the targets as well.
+void ExpectSameFlows(const ConversionTable& table,
+                     cyclus::Composition::Ptr feed_comp, double product_assay,
+                     double tails_assay, bool use_downblending) {
+  const double product_qty = 7.;
+  CascadeFlows flows;
+  bool found = table.Flows(product_assay, tails_assay, product_qty,
+                           use_downblending, flows);
+  CascadeCache::Instance().Clear();
+  if (!found) {
+    EXPECT_THROW(EnrichmentCalculator e(feed_comp, product_assay,
+                                        tails_assay, 1.4,
+                                        EnrichmentProcess::kCentrifuge,
+                                        1e299, product_qty, 1e299,
+                                        use_downblending, true),
+                 Error)
+        << "product assay " << product_assay << ", tails assay "
+        << tails_assay;
+    return;
+  }
+  EnrichmentCalculator e(feed_comp, product_assay, tails_assay, 1.4,
+                         EnrichmentProcess::kCentrifuge, 1e299, product_qty,
+                         1e299, use_downblending, true);
+  EXPECT_EQ(e.SwuUsed(), flows.swu);
+  EXPECT_EQ(e.FeedUsed(), flows.feed_qty);
+  EXPECT_EQ(e.ProductProduced(), flows.product_qty);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST(ConversionTableTest, MatchesCalculator) {
+  for (cyclus::Composition::Ptr feed_comp : {misotest::comp_natU(),
+                                             misotest::comp_reprocessedU()}) {
+    IsotopeArray feed = CompMapToIsotopeArray(feed_comp->atom());
+    ConversionTable table(feed, 1.4, EnrichmentProcess::kCentrifuge, 0.9,
+                          0.001);
+    ASSERT_TRUE(table.Covers(feed, 1.4, EnrichmentProcess::kCentrifuge));
+
+    for (bool use_downblending : {true, false}) {
+      for (double tails_assay = 0.001; tails_assay < 0.0045;
+           tails_assay += 0.00037) {
+        for (double product_assay = 0.01; product_assay < 0.9;
+             product_assay *= 1.13) {
+          ExpectSameFlows(table, feed_comp, product_assay, tails_assay,
+                          use_downblending);
+        }
+      }
+    }
+
+    // The staging jumps must be reproduced exactly, i.e., also directly at
+    // and next to the jumps.
+    for (double jump : EnrichingJumps(feed, 40)) {
+      if (jump <= feed[kIdx235] || jump >= 0.9) {
+        continue;
+      }
+      for (double product_assay : {std::nextafter(jump, 0.), jump,
+                                   std::nextafter(jump, 1.)}) {
+        ExpectSameFlows(table, feed_comp, product_assay, 0.002, true);
+      }
+    }
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST(ConversionTableTest, Coverage) {
+  IsotopeArray feed = CompMapToIsotopeArray(misotest::comp_natU()->atom());
+  ConversionTable table(feed, 1.4, EnrichmentProcess::kCentrifuge, 0.2,
+                        0.002);
+  EXPECT_GT(table.size(), 0);
+
+  IsotopeArray other_feed = CompMapToIsotopeArray(
+      misotest::comp_reprocessedU()->atom());
+  EXPECT_FALSE(table.Covers(other_feed, 1.4,
+                            EnrichmentProcess::kCentrifuge));
+  EXPECT_FALSE(table.Covers(feed, 1.3, EnrichmentProcess::kCentrifuge));
+  EXPECT_FALSE(table.Covers(feed, 1.4, EnrichmentProcess::kDiffusion));
+
+  // Targets far outside of the tabulated range are left to the calculator.
+  CascadeDesign design;
+  EXPECT_TRUE(table.Find(0.2, 0.002, design));
+  EXPECT_FALSE(table.Find(0.9, 0.002, design));
+  EXPECT_FALSE(table.Find(0.2, 1e-7, design));
+
+  // A feed without U235 cannot be enriched.
+  IsotopeArray depleted = {0, 0, 0, 0, 0, 1};
+  ConversionTable empty(depleted, 1.4, EnrichmentProcess::kCentrifuge, 0.2,
+                        0.002);
+  EXPECT_EQ(0, empty.size());
+  EXPECT_FALSE(empty.Covers(depleted, 1.4, EnrichmentProcess::kCentrifuge));
+}
+
+}  // namespace misoenrichment
@@ -0,0 +1,44 @@
+#ifndef MISOENRICHMENT_SRC_CORE_ERROR_H_
+#define MISOENRICHMENT_SRC_CORE_ERROR_H_
+
+// Exceptions thrown by the cascade calculations of the Cyclus-free
+// `misoenrichment_core` library. They derive from std::exception and mirror
+// the Cyclus exceptions. The Cyclus module links against the library and
+// rethrows them as the Cyclus exceptions where its archetypes call into it
+// (see `CyclusErrors` in miso_helper.h), such that the kernel reports them
+// as for any other archetype.
+
+#include <exception>
+#include <string>
+
+namespace misoenrichment {
+
+class Error : public std::exception {
+ public:
+  Error() {}
+  explicit Error(std::string msg) : msg_(msg) {}
+  virtual ~Error() throw() {}
+
+  virtual const char* what() const throw() { return msg_.c_str(); }
+  std::string msg() const { return msg_; }
+  void msg(std::string msg) { msg_ = msg; }
+
+ protected:
+  std::string msg_;
+};
+
+// An invalid value has been passed, see cyclus::ValueError.
+class ValueError : public Error {
+ public:
+  explicit ValueError(std::string msg) : Error(msg) {}
+};
+
+// A key (e.g., a nuclide) could not be found, see cyclus::KeyError.
+class KeyError : public Error {
+ public:
+  explicit KeyError(std::string msg) : Error(msg) {}
+};
+
+}  // namespace misoenrichment
+
+#endif  // MISOENRICHMENT_SRC_CORE_ERROR_H_
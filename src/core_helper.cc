@@ -0,0 +1,71 @@
+#include "core_helper.h"
+
+#include "core_error.h"
+#include "enrichment_process.h"
+
+namespace misoenrichment {
+
+namespace {
+
+constexpr std::array<int, kNumIsotopes> UraniumNucIDs() {
+  std::array<int, kNumIsotopes> nuc_ids = {};
+  for (int i = 0; i < kNumIsotopes; i++) {
+    nuc_ids[i] = IsotopeNucID<UraniumIsotopes>(i);
+  }
+  return nuc_ids;
+}
+
+// Table returned by `IsotopesNucID`, filled at compile time.
+constexpr std::array<int, kNumIsotopes> kUraniumNucIDs = UraniumNucIDs();
+
+}  // namespace
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+const std::array<int, kNumIsotopes>& IsotopesNucID() {
+  return kUraniumNucIDs;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+int IsotopeToNucID(int isotope) {
+  int i = IsotopeIndex<UraniumIsotopes>(isotope);
+  if (i == -1) {
+    throw ValueError("Invalid (non-uranium) isotope!");
+  }
+  return IsotopeNucID<UraniumIsotopes>(i);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+int NucIDToIsotope(int nuc_id) {
+  int i = NucIDIndex<UraniumIsotopes>(nuc_id);
+  if (i == -1) {
+    throw ValueError("Invalid (non-uranium) isotope!");
+  }
+  return UraniumIsotopes::kMassNumbers[i];
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+std::map<int,double> CalculateSeparationFactor(double gamma_235,
+                                               std::string enrichment_process) {
+  const std::array<int, kNumIsotopes>& uranium_nuc_ids = IsotopesNucID();
+  IsotopeArray factors = SeparationFactors(
+      gamma_235, EnrichmentProcessFromString(enrichment_process));
+
+  std::map<int,double> separation_factors;
+  for (int i = 0; i < kNumIsotopes; i++) {
+    separation_factors[uranium_nuc_ids[i]] = factors[i];
+  }
+  return separation_factors;
+}
+
+namespace misotest {
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+IsotopeArray NaturalUranium() {
+  IsotopeArray composition = {0, 0, 5.594e-5, 7.2003e-3, 0, 0};
+  composition[kIdx238] = 1 - composition[2] - composition[kIdx235];
+  return composition;
+}
+
+}  // namespace misotest
+
+}  // namespace misoenrichment
@@ -0,0 +1,60 @@
+#ifndef MISOENRICHMENT_SRC_CORE_HELPER_H_
+#define MISOENRICHMENT_SRC_CORE_HELPER_H_
+
+#include <array>
+#include <map>
+#include <string>
+
+#include "isotope_set.h"
+
+// Helpers of the cascade calculations that do not depend on Cyclus, see
+// `miso_helper.h` for the ones operating on Cyclus compositions and
+// materials.
+
+namespace misoenrichment {
+
+const int kIterMax = 200;
+
+// Number of uranium isotopes tracked by the enrichment calculations and
+// positions of U-235 and U-238 in `IsotopesNucID`.
+const int kNumIsotopes = UraniumIsotopes::kNumIsotopes;
+const int kIdx235 = UraniumIsotopes::kIdxKey;
+const int kIdx238 = UraniumIsotopes::kIdxReference;
+
+// Fixed-width isotope vector, the entries follow the order given by
+// `IsotopesNucID`, i.e., U-232, U-233, U-234, U-235, U-236, U-238.
+typedef BasicIsotopeArray<UraniumIsotopes> IsotopeArray;
+
+// Returns the nuc ids of the uranium isotopes in the order of
+// `IsotopeArray`. The table is static, hence callers neither allocate nor
+// copy anything.
+const std::array<int, kNumIsotopes>& IsotopesNucID();
+int IsotopeToNucID(int isotope);
+int NucIDToIsotope(int nuc_id);
+
+// Calculates the stage separation factor for all isotopes starting from
+// the given U235 overall separation factor.
+//
+// Returns a map containing the stage separation factors for all U isotopes
+// with the keys being the isotopes' mass.
+//
+// Note that the stage separation factor is defined as the ratio of
+// abundance ratio in product to abundance ratio in tails. This method
+// follows Houston G. Wood 'Effects of Separation Processes on Minor
+// Uranium Isotopes in Enrichment Cascades'. In: Science and Global
+// Security, 16:26--36 (2008). ISSN: 0892-9882.
+// DOI: 10.1080/08929880802361796
+std::map<int,double> CalculateSeparationFactor(double gamma_235,
+                                               std::string enrichment_process);
+
+namespace misotest {
+
+// Atom fractions of natural uranium, i.e., of `comp_natU` (see
+// miso_helper.h), for the tests of the core.
+IsotopeArray NaturalUranium();
+
+}  // namespace misotest
+
+}  // namespace misoenrichment
+
+#endif  // MISOENRICHMENT_SRC_CORE_HELPER_H_
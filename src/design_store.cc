@@ -0,0 +1,414 @@
+#include "design_store.h"
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+#include "core_error.h"
+
+namespace misoenrichment {
+
+namespace {
+
+const char kDesignStoreMagic[8] = {'M', 'I', 'S', 'O', 'D', 'S', 'G', 'N'};
+// The records are written in native byte order, files written on a
+// machine with another byte order are ignored.
+const std::uint32_t kByteOrderMark = 0x01020304;
+
+struct Header {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t byte_order;
+  std::uint32_t record_size;
+  std::uint32_t reserved;
+  std::uint64_t n_records;
+};
+
+// One key together with its design, see `CascadeCache::Key` and
+// `CascadeDesign`.
+struct Record {
+  std::int64_t values[2*(kNumIsotopes+3)];
+  std::int32_t enrichment_process;
+  std::int32_t enrichment_model;
+  std::int32_t use_integer_stages;
+  std::int32_t use_downblending;
+  double fixed_n_enriching;
+  double fixed_n_stripping;
+
+  double n_enriching;
+  double n_stripping;
+  double feed_composition[kNumIsotopes];
+  double product_composition[kNumIsotopes];
+  double tails_composition[kNumIsotopes];
+  double target_product_assay;
+  double sum_e;
+  double sum_s;
+  double value_feed;
+  double value_product;
+  double value_tails;
+  double swu_per_feed;
+};
+static_assert(std::is_trivially_copyable<Record>::value,
+              "design store records are copied byte-wise");
+static_assert(sizeof(Header) % alignof(Record) == 0,
+              "the records following the header must be aligned");
+static_assert(sizeof(Record::values) / sizeof(std::int64_t)
+                  == 2*(kNumIsotopes+3)
+              && sizeof(CascadeCache::Key::values) / sizeof(long long)
+                  == 2*(kNumIsotopes+3),
+              "the record must hold the complete key");
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+Record ToRecord(const CascadeCache::Key& key, const CascadeDesign& design) {
+  Record record;
+  std::memset(&record, 0, sizeof(Record));
+  std::copy(key.values.begin(), key.values.end(), record.values);
+  record.enrichment_process = static_cast<int>(key.enrichment_process);
+  record.enrichment_model = static_cast<int>(key.enrichment_model);
+  record.use_integer_stages = key.use_integer_stages;
+  record.use_downblending = key.use_downblending;
+  record.fixed_n_enriching = key.fixed_n_enriching;
+  record.fixed_n_stripping = key.fixed_n_stripping;
+
+  record.n_enriching = design.n_enriching;
+  record.n_stripping = design.n_stripping;
+  for (int i = 0; i < kNumIsotopes; i++) {
+    record.feed_composition[i] = design.feed_composition[i];
+    record.product_composition[i] = design.product_composition[i];
+    record.tails_composition[i] = design.tails_composition[i];
+  }
+  record.target_product_assay = design.target_product_assay;
+  record.sum_e = design.sum_e;
+  record.sum_s = design.sum_s;
+  record.value_feed = design.value_feed;
+  record.value_product = design.value_product;
+  record.value_tails = design.value_tails;
+  record.swu_per_feed = design.swu_per_feed;
+  return record;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+CascadeCache::Key RecordKey(const Record& record) {
+  CascadeCache::Key key;
+  std::copy(record.values, record.values + key.values.size(),
+            key.values.begin());
+  key.enrichment_process = static_cast<EnrichmentProcess>(
+      record.enrichment_process);
+  key.enrichment_model = static_cast<EnrichmentModel>(
+      record.enrichment_model);
+  key.use_integer_stages = record.use_integer_stages != 0;
+  key.use_downblending = record.use_downblending != 0;
+  key.fixed_n_enriching = record.fixed_n_enriching;
+  key.fixed_n_stripping = record.fixed_n_stripping;
+  return key;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+CascadeDesign RecordDesign(const Record& record) {
+  CascadeDesign design;
+  design.n_enriching = record.n_enriching;
+  design.n_stripping = record.n_stripping;
+  for (int i = 0; i < kNumIsotopes; i++) {
+    design.feed_composition[i] = record.feed_composition[i];
+    design.product_composition[i] = record.product_composition[i];
+    design.tails_composition[i] = record.tails_composition[i];
+  }
+  design.target_product_assay = record.target_product_assay;
+  design.sum_e = record.sum_e;
+  design.sum_s = record.sum_s;
+  design.value_feed = record.value_feed;
+  design.value_product = record.value_product;
+  design.value_tails = record.value_tails;
+  design.swu_per_feed = record.swu_per_feed;
+  return design;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Returns the record of `key` in the sorted range [begin, end), or NULL.
+const Record* FindRecord(const Record* begin, const Record* end,
+                         const CascadeCache::Key& key) {
+  const Record* record = std::lower_bound(
+      begin, end, key,
+      [](const Record& r, const CascadeCache::Key& k) {
+        return RecordKey(r) < k;
+      });
+  if (record == end || key < RecordKey(*record)) {
+    return NULL;
+  }
+  return record;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+std::string SystemErrorMessage(const std::string& what,
+                               const std::string& path) {
+  return what + " '" + path + "': " + std::strerror(errno);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+bool WriteAll(int fd, const char* data, std::size_t size) {
+  while (size > 0) {
+    ssize_t written = write(fd, data, size);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data += written;
+    size -= written;
+  }
+  return true;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Writes the file to `path` and flushes it to disk, such that it is
+// complete before it gets renamed.
+void WriteStore(const std::string& path, const std::vector<Record>& records) {
+  Header header;
+  std::memset(&header, 0, sizeof(Header));
+  std::memcpy(header.magic, kDesignStoreMagic, sizeof(header.magic));
+  header.version = kDesignStoreVersion;
+  header.byte_order = kByteOrderMark;
+  header.record_size = sizeof(Record);
+  header.n_records = records.size();
+
+  int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    throw Error(SystemErrorMessage("Cannot create the cascade design store",
+                                   path));
+  }
+  bool written = WriteAll(fd, reinterpret_cast<const char*>(&header),
+                          sizeof(Header))
+                 && WriteAll(fd, reinterpret_cast<const char*>(
+                                     records.data()),
+                             records.size() * sizeof(Record))
+                 && fsync(fd) == 0;
+  std::string msg = SystemErrorMessage(
+      "Cannot write the cascade design store", path);
+  if (close(fd) != 0 || !written) {
+    unlink(path.c_str());
+    throw Error(msg);
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Exclusive lock of a lock file, held until destruction.
+class FileLock {
+ public:
+  explicit FileLock(const std::string& path) {
+    fd_ = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd_ < 0) {
+      throw Error(SystemErrorMessage("Cannot open the lock file", path));
+    }
+    while (flock(fd_, LOCK_EX) != 0) {
+      if (errno != EINTR) {
+        std::string msg = SystemErrorMessage("Cannot lock", path);
+        close(fd_);
+        throw Error(msg);
+      }
+    }
+  }
+  ~FileLock() {
+    flock(fd_, LOCK_UN);
+    close(fd_);
+  }
+
+ private:
+  FileLock(const FileLock&) = delete;
+  FileLock& operator=(const FileLock&) = delete;
+
+  int fd_;
+};
+
+}  // namespace
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+DesignStore::DesignStore(const std::string& path)
+    : path_(path), mapping_(NULL), mapping_size_(0) {
+  Map_();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+DesignStore::~DesignStore() {
+  try {
+    Flush();
+  } catch (...) {
+    // The designs are recalculated by the next run.
+  }
+  Unmap_();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+bool DesignStore::Find(const CascadeCache::Key& key, CascadeDesign& design) {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  std::map<CascadeCache::Key, CascadeDesign>::iterator it = pending_.find(
+      key);
+  if (it != pending_.end()) {
+    design = it->second;
+    return true;
+  }
+  const Record* records = static_cast<const Record*>(Records_());
+  const Record* record = FindRecord(records, records + NumMapped_(), key);
+  if (record == NULL) {
+    return false;
+  }
+  design = RecordDesign(*record);
+  return true;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void DesignStore::Insert(const CascadeCache::Key& key,
+                         const CascadeDesign& design) {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  const Record* records = static_cast<const Record*>(Records_());
+  if (FindRecord(records, records + NumMapped_(), key) == NULL) {
+    pending_.insert(std::make_pair(key, design));
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void DesignStore::Flush() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (pending_.empty()) {
+    return;
+  }
+  FileLock file_lock(path_ + ".lock");
+  // Other processes may have replaced the file since it was mapped.
+  Map_();
+
+  // Both the mapped records and the pending designs are sorted by key.
+  const Record* mapped = static_cast<const Record*>(Records_());
+  int n_mapped = NumMapped_();
+  std::vector<Record> records;
+  records.reserve(n_mapped + pending_.size());
+  int i = 0;
+  std::map<CascadeCache::Key, CascadeDesign>::iterator it;
+  for (it = pending_.begin(); it != pending_.end(); it++) {
+    while (i < n_mapped && RecordKey(mapped[i]) < it->first) {
+      records.push_back(mapped[i++]);
+    }
+    if (i < n_mapped && !(it->first < RecordKey(mapped[i]))) {
+      // Added by another process in the meantime.
+      continue;
+    }
+    records.push_back(ToRecord(it->first, it->second));
+  }
+  records.insert(records.end(), mapped + i, mapped + n_mapped);
+
+  std::string tmp_path = path_ + ".tmp";
+  WriteStore(tmp_path, records);
+  if (std::rename(tmp_path.c_str(), path_.c_str()) != 0) {
+    std::string msg = SystemErrorMessage(
+        "Cannot replace the cascade design store", path_);
+    unlink(tmp_path.c_str());
+    throw Error(msg);
+  }
+  pending_.clear();
+  Map_();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+int DesignStore::size() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return NumMapped_() + pending_.size();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+int DesignStore::pending() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return pending_.size();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void DesignStore::Map_() {
+  Unmap_();
+  int fd = open(path_.c_str(), O_RDONLY);
+  if (fd < 0) {
+    if (errno == ENOENT) {
+      return;
+    }
+    throw Error(SystemErrorMessage("Cannot open the cascade design store",
+                                   path_));
+  }
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0) {
+    std::string msg = SystemErrorMessage(
+        "Cannot read the cascade design store", path_);
+    close(fd);
+    throw Error(msg);
+  }
+  std::size_t size = file_stat.st_size;
+  if (size == 0) {
+    close(fd);
+    return;
+  }
+  // The mapping stays valid after closing the file and after the file has
+  // been replaced by another process, as it refers to the old file.
+  void* mapping = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  if (mapping == MAP_FAILED) {
+    std::string msg = SystemErrorMessage(
+        "Cannot map the cascade design store", path_);
+    close(fd);
+    throw Error(msg);
+  }
+  close(fd);
+  mapping_ = mapping;
+  mapping_size_ = size;
+
+  const Header* header = static_cast<const Header*>(mapping_);
+  if (size < sizeof(Header)
+      || std::memcmp(header->magic, kDesignStoreMagic,
+                     sizeof(header->magic)) != 0) {
+    Unmap_();
+    throw ValueError("'" + path_ + "' is not a cascade design store");
+  }
+  std::size_t records_size = size - sizeof(Header);
+  if (header->version != kDesignStoreVersion
+      || header->byte_order != kByteOrderMark
+      || header->record_size != sizeof(Record)
+      || records_size % sizeof(Record) != 0
+      || records_size / sizeof(Record) != header->n_records) {
+    // Written by another version, the file gets replaced by the next
+    // flush.
+    Unmap_();
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void DesignStore::Unmap_() {
+  if (mapping_ != NULL) {
+    munmap(mapping_, mapping_size_);
+  }
+  mapping_ = NULL;
+  mapping_size_ = 0;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+int DesignStore::NumMapped_() const {
+  if (mapping_ == NULL) {
+    return 0;
+  }
+  return static_cast<const Header*>(mapping_)->n_records;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+const void* DesignStore::Records_() const {
+  if (mapping_ == NULL) {
+    return NULL;
+  }
+  return static_cast<const char*>(mapping_) + sizeof(Header);
+}
+
+}  // namespace misoenrichment
@@ -0,0 +1,89 @@
+#ifndef MISOENRICHMENT_SRC_DESIGN_STORE_H_
+#define MISOENRICHMENT_SRC_DESIGN_STORE_H_
+
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include "cascade_cache.h"
+#include "cascade_design.h"
+
+namespace misoenrichment {
+
+// Version of the file format of `DesignStore`. Files written with another
+// version are ignored and replaced by the next `Flush`.
+const int kDesignStoreVersion = 3;
+
+// Persistent store of cascade designs, used to share the designs between
+// runs (and processes) evaluating the same scenario family, e.g., in a
+// parameter study. It complements the in-memory `CascadeCache` and uses
+// the same quantised keys, i.e., a design is reused for the same feed
+// composition, target assays, U235 separation factor, enrichment process,
+// staging options and enrichment model.
+//
+// The file consists of a header (magic number, format version, byte order
+// and record size) followed by fixed-size records sorted by key. It is
+// mapped into memory and looked up using a binary search, such that
+// opening a store does not read the designs that are not needed.
+//
+// New designs are kept in memory until `Flush` is called. A flush merges
+// them with the designs currently on disk (including the ones added by
+// other processes in the meantime) and writes a new file, which then
+// atomically replaces the old one. Flushes are serialised across
+// processes using an exclusive `flock` on '<path>.lock'. Readers never
+// need a lock: the file is never modified in place, a reader therefore
+// either sees the old or the new file, but never a partially written one.
+//
+// All member functions may be called concurrently.
+class DesignStore {
+ public:
+  // Maps the store at `path`. A missing or empty file yields an empty
+  // store, the file is then created by the first `Flush`. Throws a
+  // ValueError if the file exists but is not a design store and an Error
+  // if it cannot be read.
+  explicit DesignStore(const std::string& path);
+  // Flushes the new designs, errors are ignored as the store is a cache.
+  ~DesignStore();
+
+  // Returns true and copies the design into `design` if `key` is present.
+  bool Find(const CascadeCache::Key& key, CascadeDesign& design);
+  // Adds a design, which is written to disk by the next `Flush`.
+  void Insert(const CascadeCache::Key& key, const CascadeDesign& design);
+
+  // Writes the new designs to disk, does nothing if there are none. Throws
+  // an Error if the file cannot be written.
+  void Flush();
+
+  // Number of designs, including the ones not yet written to disk.
+  int size();
+  // Number of designs not yet written to disk.
+  int pending();
+  inline const std::string& path() const { return path_; }
+
+ private:
+  DesignStore(const DesignStore&) = delete;
+  DesignStore& operator=(const DesignStore&) = delete;
+
+  // (Re)maps the current file at `path_`. Must only be called while
+  // holding the lock.
+  void Map_();
+  void Unmap_();
+  // Number of records in the mapped file and pointer to the first one.
+  int NumMapped_() const;
+  const void* Records_() const;
+
+  std::string path_;
+
+  void* mapping_;
+  std::size_t mapping_size_;
+
+  // Designs inserted since the last flush.
+  std::map<CascadeCache::Key, CascadeDesign> pending_;
+
+  std::mutex mutex_;
+};
+
+}  // namespace misoenrichment
+
+#endif  // MISOENRICHMENT_SRC_DESIGN_STORE_H_
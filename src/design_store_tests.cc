@@ -0,0 +1,211 @@
+#include <gtest/gtest.h>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+#include "cascade_cache.h"
+#include "core_error.h"
+#include "design_store.h"
+#include "enrichment_calculator.h"
+#include "miso_helper.h"
+
+namespace misoenrichment {
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Returns a path in the temporary directory and removes any file left
+// there by a previous run.
+std::string StorePath(const std::string& name) {
+  std::string path = ::testing::TempDir() + "misoenrichment_" + name
+                     + ".designs";
+  std::remove(path.c_str());
+  std::remove((path + ".lock").c_str());
+  return path;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+CascadeCache::Key StoreKey(double product_assay) {
+  IsotopeArray feed = CompMapToIsotopeArray(misotest::comp_natU()->atom());
+  return CascadeCache::MakeKey(feed, product_assay, 0.003, 1.4,
+                               EnrichmentProcess::kCentrifuge, true, true);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+CascadeDesign StoreDesign(double n_enriching) {
+  CascadeDesign design;
+  design.n_enriching = n_enriching;
+  design.n_stripping = 2;
+  design.feed_composition.fill(0.1);
+  design.product_composition.fill(0.2);
+  design.tails_composition.fill(0.3);
+  design.target_product_assay = 0.05;
+  design.sum_e = 0.1;
+  design.sum_s = 0.9;
+  design.value_feed = 1;
+  design.value_product = 2;
+  design.value_tails = 3;
+  design.swu_per_feed = 4;
+  return design;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST(DesignStoreTest, Persistence) {
+  std::string path = StorePath("persistence");
+  CascadeDesign design;
+  {
+    DesignStore store(path);
+    EXPECT_EQ(store.size(), 0);
+    EXPECT_FALSE(store.Find(StoreKey(0.05), design));
+    store.Insert(StoreKey(0.05), StoreDesign(10));
+    store.Insert(StoreKey(0.04), StoreDesign(9));
+    EXPECT_EQ(store.pending(), 2);
+    ASSERT_TRUE(store.Find(StoreKey(0.05), design));
+    EXPECT_EQ(design.n_enriching, 10);
+
+    store.Flush();
+    EXPECT_EQ(store.pending(), 0);
+    EXPECT_EQ(store.size(), 2);
+    // Designs already on disk are not added again.
+    store.Insert(StoreKey(0.04), StoreDesign(9));
+    EXPECT_EQ(store.pending(), 0);
+    store.Insert(StoreKey(0.06), StoreDesign(11));
+  }
+  // The remaining design is written when the store is destroyed.
+  DesignStore store(path);
+  EXPECT_EQ(store.size(), 3);
+  EXPECT_FALSE(store.Find(StoreKey(0.07), design));
+  ASSERT_TRUE(store.Find(StoreKey(0.05), design));
+  CascadeDesign expected = StoreDesign(10);
+  EXPECT_EQ(design.n_enriching, expected.n_enriching);
+  EXPECT_EQ(design.n_stripping, expected.n_stripping);
+  EXPECT_EQ(design.feed_composition, expected.feed_composition);
+  EXPECT_EQ(design.product_composition, expected.product_composition);
+  EXPECT_EQ(design.tails_composition, expected.tails_composition);
+  EXPECT_EQ(design.target_product_assay, expected.target_product_assay);
+  EXPECT_EQ(design.sum_e, expected.sum_e);
+  EXPECT_EQ(design.sum_s, expected.sum_s);
+  EXPECT_EQ(design.value_feed, expected.value_feed);
+  EXPECT_EQ(design.value_product, expected.value_product);
+  EXPECT_EQ(design.value_tails, expected.value_tails);
+  EXPECT_EQ(design.swu_per_feed, expected.swu_per_feed);
+  ASSERT_TRUE(store.Find(StoreKey(0.06), design));
+  EXPECT_EQ(design.n_enriching, 11);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST(DesignStoreTest, InvalidFiles) {
+  std::string path = StorePath("invalid");
+  std::ofstream(path) << "not a design store";
+  EXPECT_THROW(DesignStore store(path), ValueError);
+
+  // A store of another version is ignored and replaced.
+  std::ofstream file(path, std::ios::binary);
+  file.write("MISODSGN", 8);
+  std::uint32_t header[6] = {kDesignStoreVersion + 1, 0, 0, 0, 0, 0};
+  file.write(reinterpret_cast<const char*>(header), sizeof(header));
+  file.close();
+  DesignStore store(path);
+  EXPECT_EQ(store.size(), 0);
+  store.Insert(StoreKey(0.05), StoreDesign(10));
+  store.Flush();
+  EXPECT_EQ(DesignStore(path).size(), 1);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST(DesignStoreTest, ConcurrentProcesses) {
+  std::string path = StorePath("processes");
+  const int n_processes = 4;
+  const int n_designs = 25;
+  DesignStore reader(path);
+  for (int p = 0; p < n_processes; p++) {
+    pid_t pid = fork();
+    ASSERT_GE(pid, 0);
+    if (pid == 0) {
+      DesignStore store(path);
+      for (int d = 0; d < n_designs; d++) {
+        store.Insert(StoreKey(0.01 + 0.001*(p*n_designs + d)),
+                     StoreDesign(d));
+        store.Flush();
+      }
+      _exit(store.size() >= n_designs ? 0 : 1);
+    }
+  }
+  for (int p = 0; p < n_processes; p++) {
+    int status;
+    wait(&status);
+    EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  }
+  // The designs of all processes are kept, while the reader still sees
+  // the file it mapped.
+  EXPECT_EQ(reader.size(), 0);
+  DesignStore store(path);
+  EXPECT_EQ(store.size(), n_processes * n_designs);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST(DesignStoreTest, Calculator) {
+  std::string path = StorePath("calculator");
+  IsotopeArray feed = CompMapToIsotopeArray(misotest::comp_natU()->atom());
+  CascadeCache& cache = CascadeCache::Instance();
+  cache.Clear();
+
+  EnrichmentInput input;
+  input.feed_composition = feed;
+  input.product_assay = 0.05;
+  input.tails_assay = 0.003;
+  input.product_qty = 10;
+  EnrichmentResult expected = EvaluateEnrichment(input);
+  {
+    DesignStore store(path);
+    input.design_store = &store;
+    // The design is taken from the in-memory cache and added to the store.
+    EnrichmentResult result = EvaluateEnrichment(input);
+    EXPECT_EQ(store.size(), 1);
+    EXPECT_EQ(result.flows.swu, expected.flows.swu);
+  }
+
+  // A new run with an empty cache uses the stored design.
+  cache.Clear();
+  DesignStore store(path);
+  input.design_store = &store;
+  EnrichmentResult result = EvaluateEnrichment(input);
+  EXPECT_EQ(cache.misses(), 1);
+  EXPECT_EQ(store.size(), 1);
+  EXPECT_EQ(result.flows.swu, expected.flows.swu);
+  EXPECT_EQ(result.flows.feed_qty, expected.flows.feed_qty);
+  EXPECT_EQ(result.n_enriching, expected.n_enriching);
+  EXPECT_EQ(result.tails_composition, expected.tails_composition);
+
+  // The design is taken from the store instead of being calculated.
+  cache.Clear();
+  CascadeDesign design = StoreDesign(42);
+  design.feed_composition = feed;
+  store.Insert(CascadeCache::MakeKey(feed, 0.06, 0.003, 1.4,
+                                     EnrichmentProcess::kCentrifuge, true,
+                                     true),
+               design);
+  EnrichmentCalculator calculator(misotest::comp_natU(), 0.05, 0.003, 1.4,
+                                  EnrichmentProcess::kCentrifuge, 1e299, 10,
+                                  1e299);
+  calculator.UseDesignStore(&store);
+  calculator.SetInput(misotest::comp_natU(), 0.06, 0.003, 1e299, 10, 1e299,
+                      1.4, EnrichmentProcess::kCentrifuge, true);
+  EXPECT_EQ(calculator.Design().n_enriching, 42);
+  EXPECT_EQ(calculator.Result().n_enriching, 42);
+  cache.Clear();
+}
+
+}  // namespace misoenrichment
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// required to get functionality in cyclus agent unit tests library
+#ifndef CYCLUS_AGENT_TESTS_CONNECTED
+int ConnectAgentTests();
+static int cyclus_agent_tests_connected = ConnectAgentTests();
+#define CYCLUS_AGENT_TESTS_CONNECTED cyclus_agent_tests_connected
+#endif  // CYCLUS_AGENT_TESTS_CONNECTED
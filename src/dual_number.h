@@ -0,0 +1,145 @@
+#ifndef MISOENRICHMENT_SRC_DUAL_NUMBER_H_
+#define MISOENRICHMENT_SRC_DUAL_NUMBER_H_
+
+#include <array>
+#include <cmath>
+
+namespace misoenrichment {
+
+// Dual number for forward-mode automatic differentiation with respect to
+// `N` parameters.
+//
+// A dual number carries a value and its gradient with respect to the
+// parameters. Evaluating a function template with dual numbers instead of
+// doubles yields the function value and all of its partial derivatives in
+// one pass. Comparisons only consider the value, i.e., branches are taken
+// as for the underlying doubles.
+template <int N>
+struct Dual {
+  double value;
+  std::array<double, N> gradient;
+
+  Dual() : value(0) { gradient.fill(0); }
+  // Implicit conversion such that doubles are treated as constants.
+  Dual(double value) : value(value) { gradient.fill(0); }
+
+  // Returns the `index`-th parameter with value `value`.
+  static Dual Variable(double value, int index) {
+    Dual variable(value);
+    variable.gradient[index] = 1;
+    return variable;
+  }
+
+  Dual& operator+=(const Dual& other) {
+    value += other.value;
+    for (int i = 0; i < N; i++) {
+      gradient[i] += other.gradient[i];
+    }
+    return *this;
+  }
+
+  Dual& operator-=(const Dual& other) {
+    value -= other.value;
+    for (int i = 0; i < N; i++) {
+      gradient[i] -= other.gradient[i];
+    }
+    return *this;
+  }
+
+  Dual& operator*=(const Dual& other) {
+    for (int i = 0; i < N; i++) {
+      gradient[i] = gradient[i]*other.value + value*other.gradient[i];
+    }
+    value *= other.value;
+    return *this;
+  }
+
+  Dual& operator/=(const Dual& other) {
+    value /= other.value;
+    for (int i = 0; i < N; i++) {
+      gradient[i] = (gradient[i] - value*other.gradient[i]) / other.value;
+    }
+    return *this;
+  }
+};
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Arithmetic operators, the overloads taking doubles are needed as
+// template argument deduction does not consider the implicit conversion.
+template <int N>
+Dual<N> operator-(const Dual<N>& x) {
+  Dual<N> result(-x.value);
+  for (int i = 0; i < N; i++) {
+    result.gradient[i] = -x.gradient[i];
+  }
+  return result;
+}
+
+#define MISOENRICHMENT_DUAL_OPERATOR(op)                                   \
+  template <int N>                                                         \
+  Dual<N> operator op(Dual<N> x, const Dual<N>& y) { return x op##= y; }   \
+  template <int N>                                                         \
+  Dual<N> operator op(Dual<N> x, double y) { return x op##= Dual<N>(y); }  \
+  template <int N>                                                         \
+  Dual<N> operator op(double x, const Dual<N>& y) {                        \
+    return Dual<N>(x) op##= y;                                             \
+  }
+MISOENRICHMENT_DUAL_OPERATOR(+)
+MISOENRICHMENT_DUAL_OPERATOR(-)
+MISOENRICHMENT_DUAL_OPERATOR(*)
+MISOENRICHMENT_DUAL_OPERATOR(/)
+#undef MISOENRICHMENT_DUAL_OPERATOR
+
+#define MISOENRICHMENT_DUAL_COMPARISON(op)                                 \
+  template <int N>                                                         \
+  bool operator op(const Dual<N>& x, const Dual<N>& y) {                   \
+    return x.value op y.value;                                             \
+  }                                                                        \
+  template <int N>                                                         \
+  bool operator op(const Dual<N>& x, double y) { return x.value op y; }    \
+  template <int N>                                                         \
+  bool operator op(double x, const Dual<N>& y) { return x op y.value; }
+MISOENRICHMENT_DUAL_COMPARISON(<)
+MISOENRICHMENT_DUAL_COMPARISON(>)
+MISOENRICHMENT_DUAL_COMPARISON(<=)
+MISOENRICHMENT_DUAL_COMPARISON(>=)
+#undef MISOENRICHMENT_DUAL_COMPARISON
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Elementary functions, found via argument-dependent lookup. Function
+// templates that should accept both doubles and dual numbers therefore
+// call them unqualified after `using std::log;` etc.
+template <int N>
+Dual<N> ChainRule(const Dual<N>& x, double value, double derivative) {
+  Dual<N> result(value);
+  for (int i = 0; i < N; i++) {
+    result.gradient[i] = derivative * x.gradient[i];
+  }
+  return result;
+}
+
+template <int N>
+Dual<N> log(const Dual<N>& x) {
+  return ChainRule(x, std::log(x.value), 1. / x.value);
+}
+
+template <int N>
+Dual<N> exp(const Dual<N>& x) {
+  double value = std::exp(x.value);
+  return ChainRule(x, value, value);
+}
+
+template <int N>
+Dual<N> expm1(const Dual<N>& x) {
+  return ChainRule(x, std::expm1(x.value), std::exp(x.value));
+}
+
+template <int N>
+Dual<N> sqrt(const Dual<N>& x) {
+  double value = std::sqrt(x.value);
+  return ChainRule(x, value, 0.5 / value);
+}
+
+}  // namespace misoenrichment
+
+#endif  // MISOENRICHMENT_SRC_DUAL_NUMBER_H_
@@ -1,13 +1,20 @@
 #include "enrichment_calculator_tests.h"
 
+#include <array>
 #include <cmath>
 #include <iostream>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 #include <gtest/gtest.h>
 
 #include "cyc_limits.h"
 #include "comp_math.h"
 
+#include "cascade_cache.h"
 #include "miso_helper.h"
 
 namespace misoenrichment {
@@ -113,7 +120,7 @@ TEST_F(EnrichmentCalculatorTest, DownblendingOptions) {
                          target_feed_qty,
                          target_product_qty, max_swu,
                          use_downblending, use_integer_stages),
-    cyclus::ValueError
+    ValueError
   );
 }
 
@@ -147,6 +154,419 @@ TEST_F(EnrichmentCalculatorTest, AssignmentOperator) {
   EXPECT_DOUBLE_EQ(n_stripping2, n_stripping);
 }
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST_F(EnrichmentCalculatorTest, CopyAndMove) {
+  // Copies and moves must neither recalculate the cascade nor use the
+  // cache.
+  CascadeCache& cache = CascadeCache::Instance();
+  long long hits = cache.hits();
+  long long misses = cache.misses();
+
+  EnrichmentCalculator copy(e);
+  EnrichmentCalculator moved(std::move(copy));
+  std::vector<EnrichmentCalculator> calculators;
+  calculators.push_back(moved);
+  calculators.push_back(std::move(moved));
+  EXPECT_EQ(cache.hits(), hits);
+  EXPECT_EQ(cache.misses(), misses);
+
+  cyclus::Composition::Ptr product_comp2, tails_comp2;
+  double feed_qty2, product_qty2, tails_qty2, swu_used2;
+  double n_enriching2, n_stripping2;
+  for (EnrichmentCalculator& calculator : calculators) {
+    calculator.EnrichmentOutput(product_comp2, tails_comp2, feed_qty2,
+                                swu_used2, product_qty2, tails_qty2,
+                                n_enriching2, n_stripping2);
+    EXPECT_TRUE(misotest::CompareCompMap(product_comp2->atom(),
+                                         product_comp->atom()));
+    EXPECT_DOUBLE_EQ(feed_qty2, feed_qty);
+    EXPECT_DOUBLE_EQ(swu_used2, swu_used);
+    EXPECT_DOUBLE_EQ(n_enriching2, n_enriching);
+    EXPECT_DOUBLE_EQ(n_stripping2, n_stripping);
+  }
+  EXPECT_TRUE(std::is_nothrow_move_constructible<EnrichmentCalculator>::value);
+  EXPECT_TRUE(std::is_nothrow_move_assignable<EnrichmentCalculator>::value);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST_F(EnrichmentCalculatorTest, SetInput) {
+  // Changing only the quantities (and the downblending option) must give
+  // the same results as designing the cascade from scratch.
+  double target_product_assay = MIsoAssay(weapons_grade_U()) - 0.001;
+  EnrichmentCalculator reference(compPtr_nat_U(), target_product_assay,
+                                 0.001, 1.3, "centrifuge", 1e299, 0.5, 100,
+                                 true);
+  EnrichmentCalculator e2(compPtr_nat_U(), target_product_assay, 0.001, 1.3,
+                          "centrifuge", 10, 1e299, 1e299, false);
+  e2.SetInput(compPtr_nat_U(), target_product_assay, 0.001, 1e299, 0.5, 100,
+              1.3, EnrichmentProcess::kCentrifuge, true);
+
+  cyclus::Composition::Ptr product_comp2, tails_comp2;
+  double feed_qty2, product_qty2, tails_qty2, swu_used2;
+  double n_enriching2, n_stripping2;
+  reference.EnrichmentOutput(product_comp, tails_comp, feed_qty, swu_used,
+                             product_qty, tails_qty, n_enriching,
+                             n_stripping);
+  e2.EnrichmentOutput(product_comp2, tails_comp2, feed_qty2, swu_used2,
+                      product_qty2, tails_qty2, n_enriching2, n_stripping2);
+
+  EXPECT_TRUE(misotest::CompareCompMap(product_comp2->atom(),
+                                       product_comp->atom()));
+  EXPECT_TRUE(misotest::CompareCompMap(tails_comp2->atom(),
+                                       tails_comp->atom()));
+  EXPECT_DOUBLE_EQ(feed_qty2, feed_qty);
+  EXPECT_DOUBLE_EQ(product_qty2, product_qty);
+  EXPECT_DOUBLE_EQ(swu_used2, swu_used);
+  EXPECT_DOUBLE_EQ(n_enriching2, n_enriching);
+  EXPECT_DOUBLE_EQ(n_stripping2, n_stripping);
+
+  // Changing the target assay requires a new staging.
+  e2.SetInput(compPtr_nat_U(), 0.2, 0.001, 1e299, 0.5, 100, 1.3,
+              EnrichmentProcess::kCentrifuge, false);
+  e2.EnrichmentOutput(product_comp2, tails_comp2, feed_qty2, swu_used2,
+                      product_qty2, tails_qty2, n_enriching2, n_stripping2);
+  EXPECT_TRUE(n_enriching2 < n_enriching);
+  EXPECT_TRUE(MIsoAtomAssay(product_comp2) >= 0.2);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST_F(EnrichmentCalculatorTest, EnrichBatch) {
+  // Every request of the batch must give the same result as an individual
+  // calculation, both for designs calculated by the batch and for cached
+  // ones.
+  std::vector<double> product_assays({0.2, 0.05, 0.9, 0.05});
+  std::vector<double> product_qtys({1, 2, 0.5, 100});
+  double feed_qty = 1000;
+  double max_swu = 1500;
+
+  EnrichmentCalculator e2;
+  double feed_used = e2.FeedUsed();
+  double n_enriching = e2.Design().n_enriching;
+  for (bool cached : {false, true}) {
+    if (!cached) {
+      CascadeCache::Instance().Clear();
+    }
+    BatchedFlows flows;
+    e2.EnrichBatch(compPtr_nat_U(), product_assays, product_qtys, 0.002,
+                   feed_qty, max_swu, 1.3, EnrichmentProcess::kCentrifuge,
+                   true, true, EnrichmentModel::kMatchedAbundanceRatio,
+                   flows);
+    ASSERT_EQ(flows.product_qty.size(), product_assays.size());
+    // The calculator keeps its state.
+    EXPECT_EQ(e2.FeedUsed(), feed_used);
+    EXPECT_EQ(e2.Design().n_enriching, n_enriching);
+
+    for (int r = 0; r < product_assays.size(); r++) {
+      CascadeCache::Instance().Clear();
+      EnrichmentCalculator single(compPtr_nat_U(), product_assays[r], 0.002,
+                                  1.3, "centrifuge", feed_qty,
+                                  product_qtys[r], max_swu, true, true);
+      EXPECT_EQ(flows.feed_qty[r], single.FeedUsed());
+      EXPECT_EQ(flows.swu[r], single.SwuUsed());
+
+      single.ProductOutput(product_comp, product_qty);
+      EXPECT_EQ(flows.product_qty[r], product_qty);
+      IsotopeArray composition = CompMapToIsotopeArray(product_comp->atom());
+      for (int i = 0; i < kNumIsotopes; i++) {
+        EXPECT_NEAR(flows.product_composition[i][r], composition[i], 1e-14);
+      }
+    }
+  }
+
+  // Designs which are not evaluated at once yield the same flows.
+  BatchedFlows flows;
+  e2.EnrichBatch(compPtr_nat_U(), product_assays, product_qtys, 0.002,
+                 feed_qty, max_swu, 1.3, EnrichmentProcess::kCentrifuge,
+                 true, true, EnrichmentModel::kStageByStage, flows);
+  for (int r = 0; r < product_assays.size(); r++) {
+    EnrichmentCalculator single(compPtr_nat_U(), product_assays[r], 0.002,
+                                1.3, EnrichmentProcess::kCentrifuge,
+                                feed_qty, product_qtys[r], max_swu, true,
+                                true, EnrichmentModel::kStageByStage);
+    EXPECT_EQ(flows.feed_qty[r], single.FeedUsed());
+    EXPECT_EQ(flows.swu[r], single.SwuUsed());
+  }
+
+  std::vector<double> too_few_qtys({1});
+  EXPECT_THROW(e2.EnrichBatch(compPtr_nat_U(), product_assays, too_few_qtys,
+                              0.002, feed_qty, max_swu, 1.3,
+                              EnrichmentProcess::kCentrifuge, true, true,
+                              EnrichmentModel::kMatchedAbundanceRatio,
+                              flows),
+               ValueError);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST_F(EnrichmentCalculatorTest, EvaluateEnrichment) {
+  // Evaluations from several threads must yield the same results as the
+  // calculator, with and without the designs being cached.
+  std::vector<EnrichmentInput> inputs;
+  for (double product_assay = 0.01; product_assay < 0.9;
+       product_assay *= 1.2) {
+    EnrichmentInput input;
+    input.feed_composition = CompMapToIsotopeArray(compPtr_nat_U()->atom());
+    input.product_assay = product_assay;
+    input.tails_assay = 0.002;
+    input.product_qty = 10;
+    input.max_swu = 500;
+    input.gamma_235 = 1.3;
+    inputs.push_back(input);
+    input.use_downblending = false;
+    input.use_integer_stages = false;
+    inputs.push_back(input);
+  }
+
+  for (bool cached : {false, true}) {
+    if (!cached) {
+      CascadeCache::Instance().Clear();
+    }
+    const int n_threads = 4;
+    std::vector<std::vector<EnrichmentResult> > results(n_threads);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < n_threads; t++) {
+      threads.emplace_back([&inputs, &results, t]() {
+        for (const EnrichmentInput& input : inputs) {
+          results[t].push_back(EvaluateEnrichment(input));
+        }
+      });
+    }
+    for (std::thread& thread : threads) {
+      thread.join();
+    }
+
+    for (int r = 0; r < inputs.size(); r++) {
+      const EnrichmentInput& input = inputs[r];
+      EnrichmentCalculator single(
+          compPtr_nat_U(), input.product_assay, input.tails_assay, 1.3,
+          EnrichmentProcess::kCentrifuge, input.feed_qty, input.product_qty,
+          input.max_swu, input.use_downblending, input.use_integer_stages);
+      single.EnrichmentOutput(product_comp, tails_comp, feed_qty, swu_used,
+                              product_qty, tails_qty, n_enriching,
+                              n_stripping);
+      for (int t = 0; t < n_threads; t++) {
+        const EnrichmentResult& result = results[t][r];
+        EXPECT_DOUBLE_EQ(feed_qty, result.flows.feed_qty);
+        EXPECT_DOUBLE_EQ(swu_used, result.flows.swu);
+        EXPECT_DOUBLE_EQ(product_qty, result.flows.product_qty);
+        EXPECT_DOUBLE_EQ(tails_qty, result.flows.tails_qty);
+        EXPECT_DOUBLE_EQ(n_enriching, result.n_enriching);
+        EXPECT_DOUBLE_EQ(n_stripping, result.n_stripping);
+      }
+    }
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST_F(EnrichmentCalculatorTest, FixedStaging) {
+  const EnrichmentProcess centrifuge = EnrichmentProcess::kCentrifuge;
+  EnrichmentCalculator searched(compPtr_nat_U(), 0.05, 0.002, 1.3,
+                                centrifuge, 1e299, 10, 1e299, true, true);
+  searched.EnrichmentOutput(product_comp, tails_comp, feed_qty, swu_used,
+                            product_qty, tails_qty, n_enriching,
+                            n_stripping);
+
+  // Fixing the staging that the search yields does not change anything.
+  EnrichmentCalculator fixed(compPtr_nat_U(), 0.05, 0.002, 1.3, centrifuge,
+                             1e299, 10, 1e299, true, true);
+  fixed.FixStaging(n_enriching, n_stripping);
+  EXPECT_TRUE(fixed.HasFixedStaging());
+  EXPECT_DOUBLE_EQ(searched.FeedUsed(), fixed.FeedUsed());
+  EXPECT_DOUBLE_EQ(searched.SwuUsed(), fixed.SwuUsed());
+
+  // The tails assay follows from the hardware, hence the target tails
+  // assay has no effect. Lower product assays are obtained by
+  // downblending.
+  fixed.SetInput(compPtr_nat_U(), 0.03, 0.001, 1e299, 10, 1e299, 1.3,
+                 centrifuge, true, true);
+  double n_enriching2, n_stripping2;
+  cyclus::Composition::Ptr product_comp2;
+  cyclus::Composition::Ptr tails_comp2;
+  fixed.EnrichmentOutput(product_comp2, tails_comp2, feed_qty, swu_used,
+                         product_qty, tails_qty, n_enriching2, n_stripping2);
+  EXPECT_DOUBLE_EQ(n_enriching, n_enriching2);
+  EXPECT_DOUBLE_EQ(n_stripping, n_stripping2);
+  EXPECT_NEAR(MIsoAtomAssay(product_comp2), 0.03, 1e-12);
+  EXPECT_DOUBLE_EQ(MIsoAtomAssay(tails_comp), MIsoAtomAssay(tails_comp2));
+  EXPECT_DOUBLE_EQ(product_qty, 10);
+
+  // The same enrichment is obtained in one go.
+  EnrichmentInput input;
+  input.feed_composition = CompMapToIsotopeArray(compPtr_nat_U()->atom());
+  input.product_assay = 0.03;
+  input.tails_assay = 0.001;
+  input.product_qty = 10;
+  input.gamma_235 = 1.3;
+  input.fixed_n_enriching = n_enriching;
+  input.fixed_n_stripping = n_stripping;
+  EnrichmentResult result = EvaluateEnrichment(input);
+  EXPECT_DOUBLE_EQ(feed_qty, result.flows.feed_qty);
+  EXPECT_DOUBLE_EQ(swu_used, result.flows.swu);
+
+  // The hardware cannot deliver a product assay above the one of its
+  // cascade.
+  CascadeDesign design = FixedStagingDesign(input);
+  EXPECT_GT(design.product_composition[kIdx235], 0.05);
+  EXPECT_DOUBLE_EQ(design.tails_composition[kIdx235],
+                   MIsoAtomAssay(tails_comp));
+  input.product_assay = design.product_composition[kIdx235];
+  EXPECT_NO_THROW(EvaluateEnrichment(input));
+  input.product_assay = 0.9;
+  EXPECT_THROW(EvaluateEnrichment(input), ValueError);
+  input.fixed_n_enriching = 0;
+  EXPECT_THROW(FixedStagingDesign(input), ValueError);
+
+  EnrichmentCalculator small(compPtr_nat_U(), 0.03, 0.002, 1.3, centrifuge,
+                             1e299, 10, 1e299, true, true);
+  small.FixStaging(10, 5);
+  EXPECT_THROW(small.SetInput(compPtr_nat_U(), 0.9, 0.002, 1e299, 10,
+                              1e299, 1.3, centrifuge, true, true),
+               ValueError);
+
+  // Reverting to searching the staging
+  fixed.FixStaging(0, 0);
+  EXPECT_FALSE(fixed.HasFixedStaging());
+  EXPECT_LT(fixed.Design().n_enriching, n_enriching);
+
+  EXPECT_THROW(fixed.FixStaging(10.5, 3), ValueError);
+  EXPECT_THROW(fixed.FixStaging(10, -1), ValueError);
+  EXPECT_FALSE(fixed.HasFixedStaging());
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST_F(EnrichmentCalculatorTest, StageByStageModel) {
+  const EnrichmentProcess centrifuge = EnrichmentProcess::kCentrifuge;
+  EnrichmentCalculator ideal(compPtr_nat_U(), 0.05, 0.002, 1.3, centrifuge,
+                             1e299, 10, 1e299, true, true);
+  EnrichmentCalculator stages(compPtr_nat_U(), 0.05, 0.002, 1.3, centrifuge,
+                              1e299, 10, 1e299, true, true,
+                              EnrichmentModel::kStageByStage);
+  double n_enriching2, n_stripping2;
+  ideal.EnrichmentOutput(product_comp, tails_comp, feed_qty, swu_used,
+                         product_qty, tails_qty, n_enriching, n_stripping);
+  stages.EnrichmentOutput(product_comp, tails_comp, feed_qty, swu_used,
+                          product_qty, tails_qty, n_enriching2,
+                          n_stripping2);
+
+  // Same staging and same separative work per unit of feed, but less
+  // separation due to the mixing in the stages.
+  EXPECT_DOUBLE_EQ(n_enriching, n_enriching2);
+  EXPECT_DOUBLE_EQ(n_stripping, n_stripping2);
+  CascadeDesign ideal_design = ideal.Design();
+  CascadeDesign stage_design = stages.Design();
+  EXPECT_NEAR(stage_design.swu_per_feed, ideal_design.swu_per_feed,
+              1e-9*ideal_design.swu_per_feed);
+  EXPECT_LT(StreamSwuPerFeed(stage_design), stage_design.swu_per_feed);
+  EXPECT_LT(stage_design.sum_e, ideal_design.sum_e);
+  EXPECT_GT(stage_design.tails_composition[kIdx235],
+            ideal_design.tails_composition[kIdx235]);
+
+  EXPECT_NEAR(MIsoAtomAssay(product_comp), 0.05, 1e-12);
+  EXPECT_DOUBLE_EQ(product_qty, 10);
+  EXPECT_NEAR(feed_qty, product_qty + tails_qty, 1e-12*feed_qty);
+
+  EXPECT_THROW(EnrichmentCalculator(compPtr_nat_U(), 0.05, 0.002, 1.3,
+                                    centrifuge, 1e299, 10, 1e299, false,
+                                    false, EnrichmentModel::kStageByStage),
+               ValueError);
+
+  // The ideal cascade reaches both target assays. Keeping its staging, the
+  // mixing losses lead to a too high tails assay, and more feed and SWU are
+  // needed for the same product, which is still downblended to the target.
+  ideal.SetInput(compPtr_nat_U(), 0.9, 0.003, 1e299, 1, 1e299, 1.3,
+                 centrifuge, true, true,
+                 EnrichmentModel::kMatchedAbundanceRatio);
+  stages.SetInput(compPtr_nat_U(), 0.9, 0.003, 1e299, 1, 1e299, 1.3,
+                  centrifuge, true, true, EnrichmentModel::kStageByStage);
+  EXPECT_NEAR(ideal.Result().flows.product_composition[kIdx235], 0.9,
+              1e-12);
+  EXPECT_LE(ideal.Result().tails_composition[kIdx235], 0.003);
+  EXPECT_NEAR(stages.Result().flows.product_composition[kIdx235], 0.9,
+              1e-12);
+  EXPECT_GT(stages.Result().tails_composition[kIdx235], 0.003);
+  EXPECT_GT(stages.Result().flows.feed_qty, ideal.Result().flows.feed_qty);
+  EXPECT_GT(stages.Result().flows.swu, ideal.Result().flows.swu);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Returns the SWU, the feed and the U234 product fraction of an
+// enrichment of natural uranium, see the Sensitivities test.
+std::array<double, 3> SensitivityOutputs(
+    const std::array<double, kNumSensitivityParameters>& parameters,
+    bool use_integer_stages) {
+  IsotopeArray feed;
+  for (int i = 0; i < kNumIsotopes; i++) {
+    feed[i] = parameters[kSensitivityFeed + i];
+  }
+  cyclus::Composition::Ptr feed_comp = cyclus::Composition::CreateFromAtom(
+      IsotopeArrayToCompMap(feed));
+  EnrichmentCalculator e(feed_comp, parameters[kSensitivityProductAssay],
+                         parameters[kSensitivityTailsAssay],
+                         parameters[kSensitivityGamma235], "centrifuge", 1e299,
+                         10, 1e299, use_integer_stages, use_integer_stages);
+  cyclus::Composition::Ptr product_comp;
+  double product_qty;
+  e.ProductOutput(product_comp, product_qty);
+  IsotopeArray product = CompMapToIsotopeArray(product_comp->atom());
+  return {e.SwuUsed(), e.FeedUsed(), product[kIdx235-1]};
+}
+
+TEST_F(EnrichmentCalculatorTest, Sensitivities) {
+  // Compare the derivatives with central finite differences. An integer
+  // staging (with downblending) and a non-integer staging are checked.
+  std::array<double, kNumSensitivityParameters> parameters;
+  parameters[kSensitivityProductAssay] = 0.05;
+  parameters[kSensitivityTailsAssay] = 0.002;
+  parameters[kSensitivityGamma235] = 1.3;
+  IsotopeArray feed = CompMapToIsotopeArray(compPtr_nat_U()->atom());
+  for (int i = 0; i < kNumIsotopes; i++) {
+    parameters[kSensitivityFeed + i] = feed[i];
+  }
+
+  for (bool use_integer_stages : {true, false}) {
+    IsotopeArray feed_array;
+    for (int i = 0; i < kNumIsotopes; i++) {
+      feed_array[i] = parameters[kSensitivityFeed + i];
+    }
+    EnrichmentCalculator e2(
+        cyclus::Composition::CreateFromAtom(IsotopeArrayToCompMap(feed_array)),
+        0.05, 0.002, 1.3, "centrifuge", 1e299, 10, 1e299, use_integer_stages,
+        use_integer_stages);
+    FlowSensitivities sensitivities = e2.Sensitivities();
+    EXPECT_DOUBLE_EQ(sensitivities.swu.value, e2.SwuUsed());
+    EXPECT_DOUBLE_EQ(sensitivities.feed_qty.value, e2.FeedUsed());
+
+    for (int k = 0; k < kNumSensitivityParameters; k++) {
+      if (!(parameters[k] > 0)) {
+        continue;
+      }
+      double h = 1e-6 * parameters[k];
+      std::array<double, kNumSensitivityParameters> shifted(parameters);
+      shifted[k] = parameters[k] + h;
+      std::array<double, 3> upper = SensitivityOutputs(shifted,
+                                                       use_integer_stages);
+      shifted[k] = parameters[k] - h;
+      std::array<double, 3> lower = SensitivityOutputs(shifted,
+                                                       use_integer_stages);
+
+      std::array<double, 3> derivatives = {
+          sensitivities.swu.gradient[k], sensitivities.feed_qty.gradient[k],
+          sensitivities.product_composition[kIdx235-1].gradient[k]};
+      for (int j = 0; j < 3; j++) {
+        double finite_difference = (upper[j]-lower[j]) / (2*h);
+        EXPECT_NEAR(derivatives[j], finite_difference,
+                    1e-4*std::abs(finite_difference) + 1e-8)
+            << "parameter " << k << ", output " << j << ", integer stages "
+            << use_integer_stages;
+      }
+    }
+  }
+  // With an integer staging, the tails assay does not change the flows.
+  EnrichmentCalculator e3(compPtr_nat_U(), 0.05, 0.002, 1.3, "centrifuge",
+                          1e299, 10, 1e299, true, true);
+  EXPECT_DOUBLE_EQ(e3.Sensitivities().feed_qty.gradient[
+      kSensitivityTailsAssay], 0);
+}
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 TEST_F(EnrichmentCalculatorTest, Concentrations) {
   EXPECT_TRUE(misotest::CompareCompMap(expect_product_comp,
@@ -172,6 +592,19 @@ TEST_F(EnrichmentCalculatorTest, NumberStages) {
   EXPECT_DOUBLE_EQ(expect_n_stripping, n_stripping);
 }
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST_F(EnrichmentCalculatorTest, NumberStagesLargeCascade) {
+  // A small separation factor requires a large number of stages. The
+  // expected values have been obtained by adding one stage at a time.
+  EnrichmentCalculator e2(compPtr_nat_U(), 0.9, 0.0005, 1.1, "centrifuge",
+                          100, 1e299, 1e299, false, true);
+  e2.EnrichmentOutput(product_comp, tails_comp, feed_qty, swu_used,
+                      product_qty, tails_qty, n_enriching, n_stripping);
+
+  EXPECT_DOUBLE_EQ(153, n_enriching);
+  EXPECT_DOUBLE_EQ(55, n_stripping);
+}
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 TEST_F(EnrichmentCalculatorTest, Downblending) {
   double target_product_assay = MIsoAssay(weapons_grade_U()) - 0.001;
@@ -244,6 +677,74 @@ TEST_F(EnrichmentCalculatorTest, NonIntegerStagesNumbers) {
   EXPECT_TRUE(misotest::CompareCompMap(tails_cm, expected_tails_comp));
 }
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST_F(EnrichmentCalculatorTest, DecimalStagingSolver) {
+  bool use_downblending = false;
+  bool use_integer_stages = false;
+  std::vector<double> product_assays({0.008, 0.05, 0.2, 0.9});
+  std::vector<double> gammas({1.1, 1.3, 2.});
+
+  for (double product_assay : product_assays) {
+    for (double gamma : gammas) {
+      EnrichmentCalculator e2(compPtr_nat_U(), product_assay, 0.002, gamma,
+                              "centrifuge", 1, 1e299, 1e299,
+                              use_downblending, use_integer_stages);
+      e2.EnrichmentOutput(product_comp, tails_comp, feed_qty, swu_used,
+                          product_qty, tails_qty, n_enriching, n_stripping);
+      EXPECT_NEAR(MIsoAssay(product_comp->atom()), product_assay,
+                  1e-6*product_assay);
+      EXPECT_NEAR(MIsoAssay(tails_comp->atom()), 0.002, 1e-6*0.002);
+      EXPECT_TRUE(n_enriching > 0);
+      EXPECT_TRUE(n_stripping > 0);
+    }
+  }
+
+  // The tails assay cannot exceed the feed assay. The failure is reported
+  // in the exception only, nothing is printed.
+  testing::internal::CaptureStdout();
+  std::string msg;
+  try {
+    EnrichmentCalculator(compPtr_nat_U(), 0.05, 0.01, 1.3, "centrifuge", 1,
+                         1e299, 1e299, use_downblending, use_integer_stages);
+  } catch (Error& e) {
+    msg = e.what();
+  }
+  EXPECT_EQ(testing::internal::GetCapturedStdout(), "");
+  EXPECT_NE(msg.find("target tails assay 0.01"), std::string::npos) << msg;
+  EXPECT_NE(msg.find("residuals"), std::string::npos) << msg;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST_F(EnrichmentCalculatorTest, DecimalStagingWarmStart) {
+  // Starting from the previous staging must yield the same staging as
+  // starting from scratch. The cache gets cleared such that the staging is
+  // always determined by the solver.
+  bool use_downblending = false;
+  bool use_integer_stages = false;
+  EnrichmentCalculator warm(compPtr_nat_U(), 0.05, 0.002, 1.3, "centrifuge",
+                            1, 1e299, 1e299, use_downblending,
+                            use_integer_stages);
+  for (double product_assay : {0.051, 0.06, 0.2, 0.04}) {
+    CascadeCache::Instance().Clear();
+    EnrichmentCalculator cold(compPtr_nat_U(), product_assay, 0.002, 1.3,
+                              "centrifuge", 1, 1e299, 1e299,
+                              use_downblending, use_integer_stages);
+    CascadeCache::Instance().Clear();
+    warm.SetInput(compPtr_nat_U(), product_assay, 0.002, 1, 1e299, 1e299,
+                  1.3, EnrichmentProcess::kCentrifuge, use_downblending,
+                  use_integer_stages);
+
+    double n_enriching_cold, n_stripping_cold;
+    warm.EnrichmentOutput(product_comp, tails_comp, feed_qty, swu_used,
+                          product_qty, tails_qty, n_enriching, n_stripping);
+    cold.EnrichmentOutput(product_comp, tails_comp, feed_qty, swu_used,
+                          product_qty, tails_qty, n_enriching_cold,
+                          n_stripping_cold);
+    EXPECT_NEAR(n_enriching, n_enriching_cold, 1e-8*n_enriching_cold);
+    EXPECT_NEAR(n_stripping, n_stripping_cold, 1e-8*n_stripping_cold);
+  }
+}
+
 }  // namespace misoenrichment
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -0,0 +1,346 @@
+#include "enrichment_ensemble.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <exception>
+#include <limits>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#include "error.h"
+#include "pyne.h"  // pyne::atomic_mass, pyne::nucname::isnuclide
+
+#include "cascade_design.h"
+#include "enrichment_process.h"
+
+namespace misoenrichment {
+
+// Number of samples claimed at once by a thread of `ParallelFor`.
+const int kEnsembleChunkSize = 64;
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// SplitMix64 finaliser, see S. Vigna, 'Further scramblings of Marsaglia's
+// xorshift generators'. Decorrelates the seeds of neighbouring samples.
+std::uint64_t MixSeed(std::uint64_t x) {
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void CheckDistribution(const Distribution& distribution) {
+  const std::vector<double>& parameters = distribution.second;
+  if (distribution.first == "uniform") {
+    if (parameters.size() != 2) {
+      throw cyclus::KeyError(
+          "'uniform' distribution needs exactly two parameters: lower and "
+          "upper bounds."
+      );
+    }
+    if (!(parameters[0] <= parameters[1])) {
+      throw cyclus::ValueError(
+          "The lower bound of a 'uniform' distribution must not exceed the "
+          "upper bound.");
+    }
+  } else if (distribution.first == "normal") {
+    if (parameters.size() != 4) {
+      throw cyclus::KeyError(
+          "'normal' distribution needs exactly four parameters: mean, "
+          "standard deviation, lower bound and upper bound."
+      );
+    }
+    if (!(parameters[1] > 0) || !(parameters[2] <= parameters[3])) {
+      throw cyclus::ValueError(
+          "A 'normal' distribution needs a positive standard deviation and "
+          "its lower bound must not exceed the upper bound.");
+    }
+  } else {
+    throw cyclus::ValueError("Distributions must be 'uniform' or 'normal'.");
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+EnrichmentSampler::EnrichmentSampler(const EnrichmentInput& base_input,
+                                     const VarRecipe& var_feed_recipe,
+                                     const Distribution& gamma_235)
+    : base_input_(base_input),
+      var_feed_recipe_(var_feed_recipe),
+      gamma_235_(gamma_235),
+      normalisation_nuc_id_(0) {
+  bool mass_fractions = var_feed_recipe.first == "mass";
+  if (!mass_fractions && var_feed_recipe.first != "atom") {
+    throw cyclus::ValueError("'mass_or_atom' must be 'mass' or 'atom'");
+  }
+  int n_normalisation_distributions = 0;
+  for (auto const& [nuc_id, distribution] : var_feed_recipe.second) {
+    if (!pyne::nucname::isnuclide(nuc_id)) {
+      std::stringstream ss;
+      ss << "Nuclide id '" << nuc_id << "' is not a valid nuclide!";
+      throw cyclus::ValueError(ss.str());
+    }
+    if (distribution.first == "normalisation") {
+      n_normalisation_distributions++;
+      normalisation_nuc_id_ = nuc_id;
+    } else {
+      CheckDistribution(distribution);
+    }
+    molar_masses_[nuc_id] = mass_fractions ? pyne::atomic_mass(nuc_id) : 1.;
+  }
+  if (n_normalisation_distributions != 1) {
+    throw cyclus::ValueError(
+        "Exactly one distribution must be 'normalisation'");
+  }
+  if (!gamma_235.first.empty()) {
+    CheckDistribution(gamma_235);
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+EnrichmentInput EnrichmentSampler::Sample(std::uint64_t seed,
+                                          std::uint64_t sample) const {
+  std::mt19937_64 rng(MixSeed(MixSeed(seed) ^ sample));
+
+  // Same sampling as in `VarRecipeSource::CreateRandomComposition_`.
+  double normalisation = 1.;
+  std::map<int, double> fractions;
+  for (auto const& [nuc_id, distribution] : var_feed_recipe_.second) {
+    if (nuc_id == normalisation_nuc_id_) {
+      continue;
+    }
+    fractions[nuc_id] = Draw_(distribution, rng);
+    normalisation -= fractions[nuc_id];
+  }
+  fractions[normalisation_nuc_id_] = normalisation;
+
+  // Only uranium enters the cascade, `CompMapToIsotopeArray` normalises to
+  // the uranium content.
+  EnrichmentInput input(base_input_);
+  IsotopeArray& feed = input.feed_composition;
+  feed.fill(0.);
+  double uranium_atom_frac = 0;
+  for (auto const& [nuc_id, fraction] : fractions) {
+    int i = NucIDIndex<UraniumIsotopes>(nuc_id);
+    if (i != -1) {
+      feed[i] = fraction / molar_masses_.at(nuc_id);
+      uranium_atom_frac += feed[i];
+    }
+  }
+  if (uranium_atom_frac > 0) {
+    for (double& x : feed) {
+      x /= uranium_atom_frac;
+    }
+  }
+
+  if (!gamma_235_.first.empty()) {
+    input.gamma_235 = Draw_(gamma_235_, rng);
+  }
+  return input;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+double EnrichmentSampler::Draw_(const Distribution& distribution,
+                                std::mt19937_64& rng) const {
+  const std::vector<double>& parameters = distribution.second;
+  if (distribution.first == "uniform") {
+    std::uniform_real_distribution<double> uniform(parameters[0],
+                                                   parameters[1]);
+    return uniform(rng);
+  }
+  // Truncated normal distribution, obtained by rejection as done by
+  // cyclus::RandomNumberGenerator::random_normal_real.
+  std::normal_distribution<double> normal(parameters[0], parameters[1]);
+  double value;
+  do {
+    value = normal(rng);
+  } while (value < parameters[2] || value > parameters[3]);
+  return value;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+EnrichmentResult EvaluateSample(const EnrichmentInput& input) {
+  if (input.enrichment_model != EnrichmentModel::kMatchedAbundanceRatio
+      || !input.use_integer_stages || input.fixed_n_enriching != 0) {
+    return EvaluateEnrichment(input);
+  }
+  const IsotopeArray& feed = input.feed_composition;
+  if (!(feed[kIdx235] > 0) || !(feed[kIdx238] > 0)) {
+    throw KeyError(
+        "No U-235 or U-238 present in the feed composition of a sample.");
+  }
+  MarcKernel<UraniumIsotopes> kernel(
+      SeparationFactors(input.gamma_235, input.enrichment_process));
+  CascadeDesign design;
+  if (!kernel.IntegerStagesCascade(feed, input.product_assay,
+                                   input.tails_assay, design)) {
+    throw Error("Unable to determine the number of stages!");
+  }
+
+  EnrichmentResult result;
+  result.flows = CalculateFlows(design, input.feed_qty, input.product_qty,
+                                input.max_swu, input.use_downblending);
+  result.tails_composition = design.tails_composition;
+  result.n_enriching = design.n_enriching;
+  result.n_stripping = design.n_stripping;
+  return result;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void ResizeArrays(int n_samples, EnsembleArrays& arrays) {
+  for (std::vector<double>* v : {&arrays.gamma_235, &arrays.feed_qty,
+                                 &arrays.product_qty, &arrays.tails_qty,
+                                 &arrays.swu, &arrays.n_enriching,
+                                 &arrays.n_stripping}) {
+    v->resize(n_samples);
+  }
+  for (int i = 0; i < kNumIsotopes; i++) {
+    arrays.feed_composition[i].resize(n_samples);
+    arrays.product_composition[i].resize(n_samples);
+    arrays.tails_composition[i].resize(n_samples);
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void StoreSample(int sample, const EnrichmentInput& input,
+                 const EnrichmentResult& result, EnsembleArrays& arrays) {
+  arrays.gamma_235[sample] = input.gamma_235;
+  arrays.feed_qty[sample] = result.flows.feed_qty;
+  arrays.product_qty[sample] = result.flows.product_qty;
+  arrays.tails_qty[sample] = result.flows.tails_qty;
+  arrays.swu[sample] = result.flows.swu;
+  arrays.n_enriching[sample] = result.n_enriching;
+  arrays.n_stripping[sample] = result.n_stripping;
+  for (int i = 0; i < kNumIsotopes; i++) {
+    arrays.feed_composition[i][sample] = input.feed_composition[i];
+    arrays.product_composition[i][sample] =
+        result.flows.product_composition[i];
+    arrays.tails_composition[i][sample] = result.tails_composition[i];
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Calls `evaluate(s)` for all samples s < n_samples using a pool of
+// `n_threads` threads claiming chunks of samples in ascending order. If a
+// sample throws, no further chunks are started beyond it. All chunks below
+// are completed, such that the rethrown exception is the one of the
+// smallest failing sample, as in a serial evaluation.
+template <typename Evaluate>
+void ParallelFor(int n_samples, int n_threads, Evaluate evaluate) {
+  if (n_threads <= 0) {
+    n_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  int n_chunks = (n_samples+kEnsembleChunkSize-1) / kEnsembleChunkSize;
+  n_threads = std::max(1, std::min(n_threads, n_chunks));
+
+  std::atomic<int> next_chunk(0);
+  std::atomic<int> failed_sample(std::numeric_limits<int>::max());
+  std::mutex exception_mutex;
+  std::exception_ptr exception;
+
+  auto work = [&]() {
+    for (int chunk = next_chunk++; chunk < n_chunks; chunk = next_chunk++) {
+      int begin = chunk * kEnsembleChunkSize;
+      if (begin > failed_sample) {
+        return;
+      }
+      int end = std::min(begin+kEnsembleChunkSize, n_samples);
+      for (int s = begin; s < end; s++) {
+        try {
+          evaluate(s);
+        } catch (...) {
+          std::lock_guard<std::mutex> lock(exception_mutex);
+          if (s < failed_sample) {
+            failed_sample = s;
+            exception = std::current_exception();
+          }
+          break;
+        }
+      }
+    }
+  };
+  std::vector<std::thread> pool;
+  for (int t = 1; t < n_threads; t++) {
+    pool.emplace_back(work);
+  }
+  work();
+  for (std::thread& thread : pool) {
+    thread.join();
+  }
+  if (exception) {
+    std::rethrow_exception(exception);
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+EnsembleArrays EvaluateEnsemble(const std::vector<EnrichmentInput>& inputs,
+                                int n_threads) {
+  int n_samples = inputs.size();
+  EnsembleArrays arrays;
+  ResizeArrays(n_samples, arrays);
+  ParallelFor(n_samples, n_threads, [&](int s) {
+    StoreSample(s, inputs[s], EvaluateSample(inputs[s]), arrays);
+  });
+  return arrays;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+EnsembleArrays EvaluateEnsemble(const EnrichmentSampler& sampler,
+                                int n_samples, std::uint64_t seed,
+                                int n_threads) {
+  EnsembleArrays arrays;
+  ResizeArrays(n_samples, arrays);
+  ParallelFor(n_samples, n_threads, [&](int s) {
+    EnrichmentInput input = sampler.Sample(seed, s);
+    StoreSample(s, input, EvaluateSample(input), arrays);
+  });
+  return arrays;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+SampleStatistics Statistics(const std::vector<double>& values) {
+  SampleStatistics statistics = {0, 0, 0, 0};
+  if (values.empty()) {
+    return statistics;
+  }
+  // Two-pass algorithm, avoiding the cancellation of the textbook formula.
+  double sum = 0;
+  statistics.min = values[0];
+  statistics.max = values[0];
+  for (double x : values) {
+    sum += x;
+    statistics.min = std::min(statistics.min, x);
+    statistics.max = std::max(statistics.max, x);
+  }
+  statistics.mean = sum / values.size();
+  if (values.size() > 1) {
+    double sum_squares = 0;
+    for (double x : values) {
+      sum_squares += (x-statistics.mean) * (x-statistics.mean);
+    }
+    statistics.standard_deviation = std::sqrt(sum_squares
+                                              / (values.size()-1));
+  }
+  return statistics;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+EnsembleSummary SummariseEnsemble(const EnsembleArrays& arrays) {
+  EnsembleSummary summary;
+  summary.n_samples = arrays.swu.size();
+  summary.feed_qty = Statistics(arrays.feed_qty);
+  summary.product_qty = Statistics(arrays.product_qty);
+  summary.tails_qty = Statistics(arrays.tails_qty);
+  summary.swu = Statistics(arrays.swu);
+  summary.n_enriching = Statistics(arrays.n_enriching);
+  summary.n_stripping = Statistics(arrays.n_stripping);
+  for (int i = 0; i < kNumIsotopes; i++) {
+    summary.product_composition[i] = Statistics(
+        arrays.product_composition[i]);
+    summary.tails_composition[i] = Statistics(arrays.tails_composition[i]);
+  }
+  return summary;
+}
+
+}  // namespace misoenrichment
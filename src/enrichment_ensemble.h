@@ -0,0 +1,124 @@
+#ifndef MISOENRICHMENT_SRC_ENRICHMENT_ENSEMBLE_H_
+#define MISOENRICHMENT_SRC_ENRICHMENT_ENSEMBLE_H_
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "enrichment_calculator.h"
+#include "miso_helper.h"
+
+namespace misoenrichment {
+
+// Distribution of a sampled quantity, using the format of the distributions
+// of 'var_out_recipe' in `VarRecipeSource`:
+//   * 'normal': mean, standard deviation, minimum, maximum. Values outside
+//     of the bounds are rejected and drawn again.
+//   * 'uniform': minimum, maximum.
+//   * 'normalisation' (feed nuclides only): any parameters, the nuclide
+//     gets the fraction needed to normalise the composition to 1.
+typedef std::pair<std::string, std::vector<double> > Distribution;
+
+// Variable feed recipe, same format as 'var_out_recipe' in
+// `VarRecipeSource`: 'mass' or 'atom' and the distribution of each
+// nuclide, exactly one of which must be 'normalisation'.
+typedef std::pair<std::string, std::map<int, Distribution> > VarRecipe;
+
+// Draws the inputs of a Monte Carlo ensemble of enrichments with an
+// uncertain feed composition and (optionally) an uncertain U235
+// separation factor. All other parameters are taken from a base input.
+//
+// Every sample uses its own random number stream, seeded from the
+// ensemble seed and the sample index. A sample is thus independent of the
+// order in which the samples are drawn and of the number of threads used.
+class EnrichmentSampler {
+ public:
+  // An empty `gamma_235` distribution means that the separation factor of
+  // `base_input` is used for all samples. Throws a cyclus::ValueError or a
+  // cyclus::KeyError if a distribution is invalid, using the same checks
+  // as `VarRecipeSource`.
+  EnrichmentSampler(const EnrichmentInput& base_input,
+                    const VarRecipe& var_feed_recipe,
+                    const Distribution& gamma_235=Distribution());
+
+  // Returns the input of the `sample`-th sample of the ensemble `seed`.
+  EnrichmentInput Sample(std::uint64_t seed, std::uint64_t sample) const;
+
+ private:
+  double Draw_(const Distribution& distribution, std::mt19937_64& rng) const;
+
+  EnrichmentInput base_input_;
+  VarRecipe var_feed_recipe_;
+  Distribution gamma_235_;
+  int normalisation_nuc_id_;
+  // Molar masses used to convert mass into atom fractions, obtained once
+  // as pyne is not safe to call concurrently.
+  std::map<int, double> molar_masses_;
+};
+
+// Results of all samples stored as a structure of arrays, element s of
+// each vector belongs to the s-th sample. The product composition is the
+// one delivered, i.e., after downblending.
+struct EnsembleArrays {
+  std::vector<double> gamma_235;
+  std::array<std::vector<double>, kNumIsotopes> feed_composition;
+
+  std::vector<double> feed_qty;
+  std::vector<double> product_qty;
+  std::vector<double> tails_qty;
+  std::vector<double> swu;
+  std::vector<double> n_enriching;
+  std::vector<double> n_stripping;
+  std::array<std::vector<double>, kNumIsotopes> product_composition;
+  std::array<std::vector<double>, kNumIsotopes> tails_composition;
+};
+
+struct SampleStatistics {
+  double mean;
+  // Sample standard deviation, zero for a single sample.
+  double standard_deviation;
+  double min;
+  double max;
+};
+
+struct EnsembleSummary {
+  int n_samples;
+  SampleStatistics feed_qty;
+  SampleStatistics product_qty;
+  SampleStatistics tails_qty;
+  SampleStatistics swu;
+  SampleStatistics n_enriching;
+  SampleStatistics n_stripping;
+  std::array<SampleStatistics, kNumIsotopes> product_composition;
+  std::array<SampleStatistics, kNumIsotopes> tails_composition;
+};
+
+// Evaluates the given inputs on `n_threads` threads (0 meaning one per
+// hardware thread). The results are identical for any number of threads.
+// If a sample cannot be evaluated, the exception of the sample with the
+// smallest index is rethrown.
+//
+// Matched abundance ratio cascades with an integer number of stages are
+// designed using `MarcKernel` instead of `EvaluateEnrichment`, yielding
+// the same results without going through the `CascadeCache`: the samples
+// hardly ever share a design, such that they would only contend for the
+// lock of the cache and evict the designs used by the simulation.
+EnsembleArrays EvaluateEnsemble(const std::vector<EnrichmentInput>& inputs,
+                                int n_threads=0);
+
+// Same as above, with the inputs drawn (concurrently) by `sampler`.
+EnsembleArrays EvaluateEnsemble(const EnrichmentSampler& sampler,
+                                int n_samples, std::uint64_t seed,
+                                int n_threads=0);
+
+// Summary statistics of all samples, accumulated in the order of the
+// samples such that they do not depend on the number of threads.
+EnsembleSummary SummariseEnsemble(const EnsembleArrays& arrays);
+
+}  // namespace misoenrichment
+
+#endif  // MISOENRICHMENT_SRC_ENRICHMENT_ENSEMBLE_H_
@@ -0,0 +1,180 @@
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <vector>
+
+#include "composition.h"
+#include "error.h"
+
+#include "cascade_cache.h"
+#include "enrichment_calculator.h"
+#include "enrichment_ensemble.h"
+#include "miso_helper.h"
+
+namespace misoenrichment {
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Natural uranium with uncertain U234 and U235 mass fractions.
+VarRecipe UncertainNaturalUranium() {
+  VarRecipe recipe;
+  recipe.first = "mass";
+  recipe.second[922340000] = Distribution("uniform", {5e-5, 6e-5});
+  recipe.second[922350000] = Distribution("normal",
+                                          {0.00711, 0.0001, 0.007, 0.0072});
+  recipe.second[922380000] = Distribution("normalisation", {1});
+  return recipe;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+EnrichmentInput EnsembleBaseInput() {
+  EnrichmentInput input;
+  input.product_assay = 0.045;
+  input.tails_assay = 0.0025;
+  input.product_qty = 10.;
+  return input;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST(EnrichmentEnsembleTest, Sampler) {
+  EnrichmentSampler sampler(EnsembleBaseInput(), UncertainNaturalUranium(),
+                            Distribution("normal", {1.4, 0.05, 1.3, 1.5}));
+  for (int s = 0; s < 100; s++) {
+    EnrichmentInput input = sampler.Sample(7, s);
+    EXPECT_GE(input.gamma_235, 1.3);
+    EXPECT_LE(input.gamma_235, 1.5);
+    EXPECT_DOUBLE_EQ(input.product_assay, 0.045);
+
+    // The mass fractions are converted as done for a recipe.
+    cyclus::CompMap compmap = IsotopeArrayToCompMap(input.feed_composition);
+    cyclus::CompMap mass = cyclus::Composition::CreateFromAtom(compmap)
+                               ->mass();
+    double mass_235 = mass[922350000] / (mass[922340000] + mass[922350000]
+                                         + mass[922380000]);
+    EXPECT_GE(mass_235, 0.007);
+    EXPECT_LE(mass_235, 0.0072);
+  }
+
+  // Each sample has its own random number stream.
+  EnrichmentInput input = sampler.Sample(7, 3);
+  EXPECT_EQ(input.feed_composition, sampler.Sample(7, 3).feed_composition);
+  EXPECT_EQ(input.gamma_235, sampler.Sample(7, 3).gamma_235);
+  EXPECT_NE(input.gamma_235, sampler.Sample(7, 4).gamma_235);
+  EXPECT_NE(input.gamma_235, sampler.Sample(8, 3).gamma_235);
+
+  // Without a distribution, the separation factor is not sampled.
+  EnrichmentSampler fixed_gamma(EnsembleBaseInput(),
+                                UncertainNaturalUranium());
+  EXPECT_EQ(1.4, fixed_gamma.Sample(7, 3).gamma_235);
+
+  VarRecipe invalid = UncertainNaturalUranium();
+  invalid.second[922340000] = Distribution("uniform", {5e-5});
+  EXPECT_THROW(EnrichmentSampler(EnsembleBaseInput(), invalid),
+               cyclus::KeyError);
+  invalid = UncertainNaturalUranium();
+  invalid.second[922340000] = Distribution("normalisation", {1});
+  EXPECT_THROW(EnrichmentSampler(EnsembleBaseInput(), invalid),
+               cyclus::ValueError);
+  EXPECT_THROW(EnrichmentSampler(EnsembleBaseInput(),
+                                 UncertainNaturalUranium(),
+                                 Distribution("lognormal", {1.4, 0.1})),
+               cyclus::ValueError);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST(EnrichmentEnsembleTest, MatchesEvaluateEnrichment) {
+  EnrichmentSampler sampler(EnsembleBaseInput(), UncertainNaturalUranium(),
+                            Distribution("uniform", {1.3, 1.5}));
+  std::vector<EnrichmentInput> inputs;
+  for (int s = 0; s < 20; s++) {
+    inputs.push_back(sampler.Sample(1, s));
+  }
+  // Non-integer stages are evaluated by the calculator.
+  inputs[5].use_integer_stages = false;
+  inputs[5].use_downblending = false;
+  EnsembleArrays arrays = EvaluateEnsemble(inputs, 2);
+
+  CascadeCache::Instance().Clear();
+  for (int s = 0; s < inputs.size(); s++) {
+    EnrichmentResult expected = EvaluateEnrichment(inputs[s]);
+    EXPECT_EQ(expected.flows.swu, arrays.swu[s]);
+    EXPECT_EQ(expected.flows.feed_qty, arrays.feed_qty[s]);
+    EXPECT_EQ(expected.flows.product_qty, arrays.product_qty[s]);
+    EXPECT_EQ(expected.n_enriching, arrays.n_enriching[s]);
+    EXPECT_EQ(expected.n_stripping, arrays.n_stripping[s]);
+    EXPECT_EQ(inputs[s].gamma_235, arrays.gamma_235[s]);
+    for (int i = 0; i < kNumIsotopes; i++) {
+      EXPECT_EQ(expected.flows.product_composition[i],
+                arrays.product_composition[i][s]);
+      EXPECT_EQ(expected.tails_composition[i],
+                arrays.tails_composition[i][s]);
+    }
+  }
+  CascadeCache::Instance().Clear();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST(EnrichmentEnsembleTest, Deterministic) {
+  EnrichmentSampler sampler(EnsembleBaseInput(), UncertainNaturalUranium(),
+                            Distribution("normal", {1.4, 0.05, 1.3, 1.5}));
+  EnsembleArrays serial = EvaluateEnsemble(sampler, 1000, 42, 1);
+  EnsembleArrays parallel = EvaluateEnsemble(sampler, 1000, 42, 4);
+  EXPECT_EQ(serial.swu, parallel.swu);
+  EXPECT_EQ(serial.feed_qty, parallel.feed_qty);
+  EXPECT_EQ(serial.product_composition, parallel.product_composition);
+  EXPECT_EQ(serial.tails_composition, parallel.tails_composition);
+
+  EnsembleSummary summary = SummariseEnsemble(parallel);
+  EXPECT_EQ(summary.n_samples, 1000);
+  EXPECT_DOUBLE_EQ(summary.product_qty.mean, 10.);
+  EXPECT_NEAR(summary.product_qty.standard_deviation, 0, 1e-12);
+  EXPECT_GT(summary.swu.standard_deviation, 0);
+  EXPECT_LE(summary.swu.min, summary.swu.mean);
+  EXPECT_GE(summary.swu.max, summary.swu.mean);
+  // The product is downblended to the requested assay.
+  EXPECT_GE(summary.product_composition[kIdx235].min, 0.045 - 1e-12);
+  EXPECT_LT(summary.product_composition[kIdx235].max, 0.04505);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST(EnrichmentEnsembleTest, Summary) {
+  EnsembleArrays arrays;
+  arrays.swu = {1., 2., 3., 6.};
+  EnsembleSummary summary = SummariseEnsemble(arrays);
+  EXPECT_EQ(summary.n_samples, 4);
+  EXPECT_DOUBLE_EQ(summary.swu.mean, 3.);
+  EXPECT_DOUBLE_EQ(summary.swu.standard_deviation, std::sqrt(14. / 3.));
+  EXPECT_DOUBLE_EQ(summary.swu.min, 1.);
+  EXPECT_DOUBLE_EQ(summary.swu.max, 6.);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST(EnrichmentEnsembleTest, FailingSample) {
+  EnrichmentSampler sampler(EnsembleBaseInput(), UncertainNaturalUranium());
+  std::vector<EnrichmentInput> inputs(300, sampler.Sample(0, 0));
+  inputs[250].feed_composition.fill(0.);
+  inputs[250].feed_composition[kIdx238] = 1.;
+  inputs[100].product_assay = 0.9999999;
+  // The failure of the smallest sample is reported, as for a serial
+  // evaluation.
+  bool staging_error = false;
+  try {
+    EvaluateEnsemble(inputs, 3);
+  } catch (KeyError& e) {
+  } catch (Error& e) {
+    staging_error = true;
+  }
+  EXPECT_TRUE(staging_error);
+  inputs[100].product_assay = 0.045;
+  EXPECT_THROW(EvaluateEnsemble(inputs, 3), KeyError);
+}
+
+}  // namespace misoenrichment
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// required to get functionality in cyclus agent unit tests library
+#ifndef CYCLUS_AGENT_TESTS_CONNECTED
+int ConnectAgentTests();
+static int cyclus_agent_tests_connected = ConnectAgentTests();
+#define CYCLUS_AGENT_TESTS_CONNECTED cyclus_agent_tests_connected
+#endif  // CYCLUS_AGENT_TESTS_CONNECTED
@@ -0,0 +1,55 @@
+#include "enrichment_process.h"
+
+#include <sstream>
+
+#include "core_error.h"
+
+namespace misoenrichment {
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+EnrichmentProcess EnrichmentProcessFromString(const std::string& name) {
+  if (name == "centrifuge") {
+    return EnrichmentProcess::kCentrifuge;
+  } else if (name == "diffusion") {
+    return EnrichmentProcess::kDiffusion;
+  }
+  std::stringstream ss;
+  ss << "'enrichment_process' is " << name
+     << ". However, it must be either 'centrifuge' or 'diffusion'.";
+  throw ValueError(ss.str());
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+std::string EnrichmentProcessName(EnrichmentProcess process) {
+  switch (process) {
+    case EnrichmentProcess::kCentrifuge:
+      return "centrifuge";
+    case EnrichmentProcess::kDiffusion:
+      return "diffusion";
+  }
+  throw ValueError("Unknown enrichment process.");
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+IsotopeArray SeparationFactors(double gamma_235, EnrichmentProcess process) {
+  switch (process) {
+    case EnrichmentProcess::kCentrifuge:
+      return SeparationFactors<CentrifugeProcess>(gamma_235);
+    case EnrichmentProcess::kDiffusion:
+      return SeparationFactors<DiffusionProcess>(gamma_235);
+  }
+  throw ValueError("Unknown enrichment process.");
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+IsotopeArray AlphaStar(double gamma_235, EnrichmentProcess process) {
+  switch (process) {
+    case EnrichmentProcess::kCentrifuge:
+      return AlphaStar<CentrifugeProcess>(gamma_235);
+    case EnrichmentProcess::kDiffusion:
+      return AlphaStar<DiffusionProcess>(gamma_235);
+  }
+  throw ValueError("Unknown enrichment process.");
+}
+
+}  // namespace misoenrichment
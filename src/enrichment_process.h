@@ -0,0 +1,96 @@
+#ifndef MISOENRICHMENT_SRC_ENRICHMENT_PROCESS_H_
+#define MISOENRICHMENT_SRC_ENRICHMENT_PROCESS_H_
+
+#include <array>
+#include <cmath>
+#include <string>
+
+#include "core_helper.h"
+
+namespace misoenrichment {
+
+// Enrichment processes supported by the enrichment calculator. The process
+// is parsed once (e.g., when a facility enters the simulation) such that
+// no string handling is needed when enriching.
+enum class EnrichmentProcess { kCentrifuge, kDiffusion };
+
+// Converts 'centrifuge' or 'diffusion' into the corresponding process.
+// Throws a ValueError for any other name.
+EnrichmentProcess EnrichmentProcessFromString(const std::string& name);
+std::string EnrichmentProcessName(EnrichmentProcess process);
+
+// Mass numbers of the uranium isotopes, following the order given by
+// `IsotopesNucID`.
+constexpr std::array<int, kNumIsotopes> kIsotopeMassNumbers =
+    UraniumIsotopes::kMassNumbers;
+
+// Process policies providing the stage separation factor of the i-th
+// isotope of an isotope set (see `isotope_set.h`) with respect to its
+// reference isotope. See `CalculateSeparationFactor` for the reference.
+// The scalar type `T` is double, except when calculating sensitivities.
+struct CentrifugeProcess {
+  // The separation factor scales with the mass difference, `gamma` being
+  // the one of the key isotope.
+  template <typename Isotopes, typename T>
+  static T SeparationFactor(const T& gamma, int i) {
+    constexpr int kReferenceMass =
+        Isotopes::kMassNumbers[Isotopes::kIdxReference];
+    constexpr int kKeyMass = Isotopes::kMassNumbers[Isotopes::kIdxKey];
+    static_assert(kKeyMass < kReferenceMass,
+                  "The key isotope must be lighter than the reference one");
+    double delta_mass = kReferenceMass - Isotopes::kMassNumbers[i];
+    double delta_key_mass = kReferenceMass - kKeyMass;
+    return 1. + delta_mass*(gamma-1.) / delta_key_mass;
+  }
+};
+
+struct DiffusionProcess {
+  // The separation factor is given by the ratio of the molecular masses of
+  // the process gas, the U235 separation factor is not used.
+  template <typename Isotopes, typename T>
+  static T SeparationFactor(const T& /*gamma*/, int i) {
+    double molecular_mass = Isotopes::kMassNumbers[i]
+                            + Isotopes::kCarrierMass;
+    double reference_mass =
+        Isotopes::kMassNumbers[Isotopes::kIdxReference]
+        + Isotopes::kCarrierMass;
+    return T(std::sqrt(reference_mass / molecular_mass));
+  }
+};
+
+template <typename Process, typename Isotopes = UraniumIsotopes,
+          typename T>
+BasicIsotopeArray<Isotopes, T> BasicSeparationFactors(const T& gamma) {
+  BasicIsotopeArray<Isotopes, T> separation_factors;
+  for (int i = 0; i < Isotopes::kNumIsotopes; i++) {
+    separation_factors[i] =
+        Process::template SeparationFactor<Isotopes>(gamma, i);
+  }
+  return separation_factors;
+}
+
+template <typename Process, typename Isotopes = UraniumIsotopes>
+BasicIsotopeArray<Isotopes> SeparationFactors(double gamma) {
+  return BasicSeparationFactors<Process, Isotopes>(gamma);
+}
+
+// E. von Halle Eq. (15)
+template <typename Process, typename Isotopes = UraniumIsotopes>
+BasicIsotopeArray<Isotopes> AlphaStar(double gamma) {
+  BasicIsotopeArray<Isotopes> alpha_star =
+      SeparationFactors<Process, Isotopes>(gamma);
+  double sqrt_alpha_key = std::sqrt(alpha_star[Isotopes::kIdxKey]);
+  for (int i = 0; i < Isotopes::kNumIsotopes; i++) {
+    alpha_star[i] /= sqrt_alpha_key;
+  }
+  return alpha_star;
+}
+
+// Dispatches to the process policies at runtime. Only to be used when the
+// separation factor or the process change, not in any inner loop.
+IsotopeArray SeparationFactors(double gamma_235, EnrichmentProcess process);
+IsotopeArray AlphaStar(double gamma_235, EnrichmentProcess process);
+
+}  // namespace misoenrichment
+
+#endif  // MISOENRICHMENT_SRC_ENRICHMENT_PROCESS_H_
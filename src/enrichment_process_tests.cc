@@ -0,0 +1,88 @@
+#include <gtest/gtest.h>
+
+#include <array>
+#include <cmath>
+#include <map>
+
+#include "core_error.h"
+#include "core_helper.h"
+#include "enrichment_process.h"
+#include "isotope_set.h"
+
+namespace misoenrichment {
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST(EnrichmentProcessTest, FromString) {
+  EXPECT_EQ(EnrichmentProcessFromString("centrifuge"),
+            EnrichmentProcess::kCentrifuge);
+  EXPECT_EQ(EnrichmentProcessFromString("diffusion"),
+            EnrichmentProcess::kDiffusion);
+  EXPECT_THROW(EnrichmentProcessFromString("test"), ValueError);
+
+  EXPECT_EQ(EnrichmentProcessName(EnrichmentProcess::kCentrifuge),
+            "centrifuge");
+  EXPECT_EQ(EnrichmentProcessName(EnrichmentProcess::kDiffusion),
+            "diffusion");
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST(EnrichmentProcessTest, MassNumbers) {
+  const std::array<int, kNumIsotopes>& isotopes = IsotopesNucID();
+  for (int i = 0; i < kNumIsotopes; i++) {
+    EXPECT_EQ(IsotopeToNucID(kIsotopeMassNumbers[i]), isotopes[i]);
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST(EnrichmentProcessTest, AlphaStar) {
+  double gamma_235 = 1.6;
+  IsotopeArray factors = SeparationFactors<CentrifugeProcess>(gamma_235);
+  IsotopeArray alpha_star = AlphaStar(gamma_235,
+                                      EnrichmentProcess::kCentrifuge);
+  EXPECT_DOUBLE_EQ(factors[kIdx238], 1.);
+  EXPECT_DOUBLE_EQ(factors[kIdx235], gamma_235);
+
+  // E. von Halle Eq. (15), alpha*_235 and alpha*_238 are reciprocal.
+  EXPECT_DOUBLE_EQ(alpha_star[kIdx235], std::sqrt(gamma_235));
+  EXPECT_DOUBLE_EQ(alpha_star[kIdx235] * alpha_star[kIdx238], 1.);
+  for (int i = 0; i < kNumIsotopes; i++) {
+    EXPECT_DOUBLE_EQ(alpha_star[i],
+                     factors[i] / std::sqrt(factors[kIdx235]));
+  }
+
+  IsotopeArray diffusion = SeparationFactors(gamma_235,
+                                             EnrichmentProcess::kDiffusion);
+  std::map<int,double> expected = CalculateSeparationFactor(gamma_235,
+                                                            "diffusion");
+  const std::array<int, kNumIsotopes>& isotopes = IsotopesNucID();
+  for (int i = 0; i < kNumIsotopes; i++) {
+    EXPECT_DOUBLE_EQ(diffusion[i], expected[isotopes[i]]);
+  }
+}
+
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST(EnrichmentProcessTest, IsotopeSets) {
+  EXPECT_EQ(IsotopeNucID<XenonIsotopes>(0), 541240000);
+  EXPECT_EQ(IsotopeIndex<MolybdenumIsotopes>(100), 6);
+  EXPECT_EQ(IsotopeIndex<MolybdenumIsotopes>(99), -1);
+  EXPECT_EQ(NucIDIndex<ZincIsotopes>(300700000), 4);
+  EXPECT_EQ(NucIDIndex<ZincIsotopes>(300700001), -1);
+  EXPECT_EQ(NucIDIndex<UraniumIsotopes>(922350000), kIdx235);
+  EXPECT_EQ(NucIDIndex<UraniumIsotopes>(942390000), -1);
+  EXPECT_EQ(NucIDToIsotope(922340000), 234);
+  EXPECT_THROW(NucIDToIsotope(922350001), ValueError);
+  EXPECT_THROW(IsotopeToNucID(239), ValueError);
+
+  BasicIsotopeArray<XenonIsotopes> factors =
+      SeparationFactors<CentrifugeProcess, XenonIsotopes>(1.3);
+  EXPECT_DOUBLE_EQ(factors[XenonIsotopes::kIdxKey], 1.3);
+  EXPECT_DOUBLE_EQ(factors[XenonIsotopes::kIdxReference], 1.);
+  EXPECT_DOUBLE_EQ(factors[4], 1. + 0.3*(136.-130.)/(136.-124.));
+
+  // Xenon is processed as elemental gas.
+  factors = SeparationFactors<DiffusionProcess, XenonIsotopes>(1.3);
+  EXPECT_DOUBLE_EQ(factors[0], std::sqrt(136. / 124.));
+}
+
+}  // namespace misoenrichment
@@ -0,0 +1,109 @@
+#ifndef MISOENRICHMENT_SRC_ISOTOPE_SET_H_
+#define MISOENRICHMENT_SRC_ISOTOPE_SET_H_
+
+#include <array>
+
+namespace misoenrichment {
+
+// Compile-time descriptions of the isotopes of one element separated in a
+// multicomponent cascade. The cascade kernel (see `cascade_design.h` and
+// `MarcKernel`) is templated on these traits, such that the number of
+// isotopes and their masses are known at compile time and no runtime
+// vectors or lookups are needed.
+//
+// An isotope set provides:
+//   kAtomicNumber  atomic number of the element,
+//   kNumIsotopes   number of isotopes tracked,
+//   kMassNumbers   mass numbers of the isotopes in ascending order,
+//   kIdxKey        position of the key isotope whose assay is targeted,
+//                  it is enriched in the product,
+//   kIdxReference  position of the heavy reference isotope, the separation
+//                  factors are given with respect to it,
+//   kCarrierMass   mass of the non-isotopic part of the process gas
+//                  molecule (e.g., F6 in UF6), used by gaseous diffusion.
+
+// U-232, U-233, U-234, U-235, U-236 and U-238 processed as UF6.
+struct UraniumIsotopes {
+  static constexpr int kAtomicNumber = 92;
+  static constexpr int kNumIsotopes = 6;
+  static constexpr std::array<int, kNumIsotopes> kMassNumbers = {
+      232, 233, 234, 235, 236, 238};
+  static constexpr int kIdxKey = 3;
+  static constexpr int kIdxReference = 5;
+  static constexpr double kCarrierMass = 6 * 19;
+};
+
+// Stable xenon isotopes processed as elemental gas, e.g., Xe-124 enriched
+// for the production of I-125.
+struct XenonIsotopes {
+  static constexpr int kAtomicNumber = 54;
+  static constexpr int kNumIsotopes = 9;
+  static constexpr std::array<int, kNumIsotopes> kMassNumbers = {
+      124, 126, 128, 129, 130, 131, 132, 134, 136};
+  static constexpr int kIdxKey = 0;
+  static constexpr int kIdxReference = 8;
+  static constexpr double kCarrierMass = 0;
+};
+
+// Stable molybdenum isotopes processed as MoF6. Enriching Mo-92 in the
+// product concentrates the heavy isotopes (e.g., Mo-100 for accelerator
+// based Tc-99m production) in the tails.
+struct MolybdenumIsotopes {
+  static constexpr int kAtomicNumber = 42;
+  static constexpr int kNumIsotopes = 7;
+  static constexpr std::array<int, kNumIsotopes> kMassNumbers = {
+      92, 94, 95, 96, 97, 98, 100};
+  static constexpr int kIdxKey = 0;
+  static constexpr int kIdxReference = 6;
+  static constexpr double kCarrierMass = 6 * 19;
+};
+
+// Stable zinc isotopes processed as diethylzinc, Zn(C2H5)2. The tails
+// depleted in Zn-64 are used in the water chemistry of reactors, the
+// product serves the production of Cu-64.
+struct ZincIsotopes {
+  static constexpr int kAtomicNumber = 30;
+  static constexpr int kNumIsotopes = 5;
+  static constexpr std::array<int, kNumIsotopes> kMassNumbers = {
+      64, 66, 67, 68, 70};
+  static constexpr int kIdxKey = 0;
+  static constexpr int kIdxReference = 4;
+  static constexpr double kCarrierMass = 2 * (2*12 + 5*1);
+};
+
+// Fixed-width isotope vector of an isotope set, the entries follow the
+// order of `Isotopes::kMassNumbers`.
+template <typename Isotopes, typename T = double>
+using BasicIsotopeArray = std::array<T, Isotopes::kNumIsotopes>;
+
+// Returns the nuc id (ZZZAAAMMMM) of the i-th isotope of the set.
+template <typename Isotopes>
+constexpr int IsotopeNucID(int i) {
+  return (Isotopes::kAtomicNumber*1000 + Isotopes::kMassNumbers[i]) * 10000;
+}
+
+// Returns the position of the isotope with the given mass number in the
+// set, or -1 if it is not part of it.
+template <typename Isotopes>
+constexpr int IsotopeIndex(int mass_number) {
+  for (int i = 0; i < Isotopes::kNumIsotopes; i++) {
+    if (Isotopes::kMassNumbers[i] == mass_number) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// Returns the position of the isotope with the given nuc id in the set,
+// or -1 if it is not part of it (including metastable states).
+template <typename Isotopes>
+constexpr int NucIDIndex(int nuc_id) {
+  if (nuc_id % 10000 != 0 || nuc_id / 10000000 != Isotopes::kAtomicNumber) {
+    return -1;
+  }
+  return IsotopeIndex<Isotopes>(nuc_id/10000 % 1000);
+}
+
+}  // namespace misoenrichment
+
+#endif  // MISOENRICHMENT_SRC_ISOTOPE_SET_H_
@@ -3,16 +3,112 @@
 #include <algorithm>
 #include <cmath>
 #include <iterator>
+#include <limits>
 #include <map>
 #include <sstream>
 #include <vector>
 
 #include "toolkit/timeseries.h"
 
+#include "cascade_cache.h"
+#include "enrichment_process.h"
 #include "miso_helper.h"
 
 namespace misoenrichment {
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+double TailsAssay(const IsotopeArray& feed_composition, double product_assay,
+                  double product_qty, double tails_assay,
+                  const TailsAssaySearch& tails_search, double feed_qty,
+                  double max_swu, double gamma_235,
+                  EnrichmentProcess enrichment_process,
+                  bool use_downblending, bool use_integer_stages,
+                  EnrichmentModel enrichment_model,
+                  DesignStore* design_store) {
+  if (!tails_search.enabled) {
+    return tails_assay;
+  }
+  EnrichmentInput input;
+  input.feed_composition = feed_composition;
+  input.product_assay = product_assay;
+  input.feed_qty = feed_qty;
+  input.product_qty = product_qty;
+  input.max_swu = max_swu;
+  input.gamma_235 = gamma_235;
+  input.enrichment_process = enrichment_process;
+  input.use_downblending = use_downblending;
+  input.use_integer_stages = use_integer_stages;
+  input.enrichment_model = enrichment_model;
+  input.design_store = design_store;
+  EnrichmentResult result;
+  return CyclusErrors([&]() {
+    return OptimalTailsAssay(tails_search, input, result);
+  });
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+std::shared_ptr<const ConversionTable> TableForFeed(
+    std::shared_ptr<const ConversionTable> conversion_table,
+    cyclus::Composition::Ptr feed_comp, double gamma_235,
+    EnrichmentProcess enrichment_process, bool use_integer_stages,
+    EnrichmentModel enrichment_model) {
+  if (!conversion_table || !use_integer_stages
+      || enrichment_model != EnrichmentModel::kMatchedAbundanceRatio
+      || !conversion_table->Covers(CompMapToIsotopeArray(feed_comp->atom()),
+                                   gamma_235, enrichment_process)) {
+    return std::shared_ptr<const ConversionTable>();
+  }
+  return conversion_table;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+CascadeFlows ConstraintFlows(const IsotopeArray& feed_composition,
+                             double product_assay, double tails_assay,
+                             double product_qty, double gamma_235,
+                             EnrichmentProcess enrichment_process,
+                             bool use_downblending, bool use_integer_stages,
+                             EnrichmentModel enrichment_model,
+                             double fixed_n_enriching,
+                             double fixed_n_stripping,
+                             const ConversionTable* conversion_table,
+                             const CascadeNetwork* cascade_network,
+                             DesignStore* design_store) {
+  if (cascade_network != NULL) {
+    try {
+      return cascade_network->Flows(feed_composition, product_assay,
+                                    tails_assay, 1e299, product_qty, 1e299,
+                                    use_downblending);
+    } catch (Error& e) {
+      // The network cannot be solved for these assays, hence no capacity
+      // suffices to serve the request.
+      CascadeFlows flows = CascadeFlows();
+      flows.feed_qty = std::numeric_limits<double>::infinity();
+      flows.swu = std::numeric_limits<double>::infinity();
+      return flows;
+    }
+  }
+  CascadeFlows flows;
+  if (conversion_table != NULL && fixed_n_enriching == 0
+      && conversion_table->Flows(product_assay, tails_assay, product_qty,
+                                 use_downblending, flows)) {
+    return flows;
+  }
+  EnrichmentInput input;
+  input.feed_composition = feed_composition;
+  input.product_assay = product_assay;
+  input.tails_assay = tails_assay;
+  input.product_qty = product_qty;
+  input.gamma_235 = gamma_235;
+  input.enrichment_process = enrichment_process;
+  input.use_downblending = use_downblending;
+  input.use_integer_stages = use_integer_stages;
+  input.enrichment_model = enrichment_model;
+  input.fixed_n_enriching = fixed_n_enriching;
+  input.fixed_n_stripping = fixed_n_stripping;
+  input.design_store = design_store;
+  return CyclusErrors([&input]() { return EvaluateEnrichment(input).flows; });
+}
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 MIsoEnrich::MIsoEnrich(cyclus::Context* ctx)
     : cyclus::Facility(ctx),
@@ -32,7 +128,17 @@ MIsoEnrich::MIsoEnrich(cyclus::Context* ctx)
       longitude(0.0),
       coordinates(latitude, longitude),
       use_integer_stages(true),
-      use_downblending(true) {}
+      use_downblending(true),
+      enrichment_model("matched_abundance_ratio"),
+      optimize_tails_assay(false),
+      min_tails_assay(0.001),
+      max_tails_assay(0.005),
+      feed_cost(0),
+      swu_cost(0),
+      use_conversion_table(true),
+      fixed_n_enriching(0),
+      fixed_n_stripping(0),
+      design_store("") {}
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 MIsoEnrich::~MIsoEnrich() {}
@@ -51,6 +157,70 @@ void MIsoEnrich::EnterNotify() {
   using cyclus::Material;
 
   cyclus::Facility::EnterNotify();
+  process = CyclusErrors([this]() {
+    return EnrichmentProcessFromString(enrichment_process);
+  });
+  model = CyclusErrors([this]() {
+    return EnrichmentModelFromString(enrichment_model);
+  });
+  tails_search.enabled = optimize_tails_assay;
+  tails_search.min_tails_assay = min_tails_assay;
+  tails_search.max_tails_assay = max_tails_assay;
+  tails_search.feed_cost = feed_cost;
+  tails_search.swu_cost = swu_cost;
+  if (model == EnrichmentModel::kStageByStage && !use_integer_stages) {
+    throw cyclus::ValueError(
+      "'use_integer_stages' must be 'true' if 'enrichment_model' is "
+      "'stage_by_stage'"
+    );
+  }
+  if (n_enriching_vals.size() != n_stripping_vals.size()) {
+    throw cyclus::ValueError(
+      "'n_enriching_vals' and 'n_stripping_vals' must have the same size"
+    );
+  }
+  bool fixed_staging = !n_enriching_vals.empty();
+  if (fixed_staging) {
+    if (tails_search.enabled) {
+      throw cyclus::ValueError(
+        "'optimize_tails_assay' cannot be used with a fixed staging"
+      );
+    }
+    if (staging_times[0]==-1) {
+      n_enriching_flexible = FlexibleInput<int>(this, n_enriching_vals);
+      n_stripping_flexible = FlexibleInput<int>(this, n_stripping_vals);
+    } else {
+      n_enriching_flexible = FlexibleInput<int>(this, n_enriching_vals,
+                                                staging_times);
+      n_stripping_flexible = FlexibleInput<int>(this, n_stripping_vals,
+                                                staging_times);
+    }
+  }
+  if (!cascade_network.empty()) {
+    if (tails_search.enabled || fixed_staging
+        || model != EnrichmentModel::kMatchedAbundanceRatio) {
+      throw cyclus::ValueError(
+        "'cascade_network' cannot be used with 'optimize_tails_assay', a "
+        "fixed staging or the 'stage_by_stage' enrichment model"
+      );
+    }
+    network = CyclusErrors([this]() {
+      return std::make_shared<const CascadeNetwork>(
+          ParseCascadeNetwork(cascade_network), gamma_235, process,
+          use_integer_stages);
+    });
+  }
+  if (!design_store.empty()) {
+    store = CyclusErrors([this]() {
+      return std::make_shared<DesignStore>(design_store);
+    });
+    enrichment_calc.UseDesignStore(store.get());
+  }
+  // The table is only built once the feed recipe is bid with, see
+  // `ConversionTable_`.
+  tabulate_designs = use_conversion_table && use_integer_stages
+                     && !fixed_staging && !network
+                     && model == EnrichmentModel::kMatchedAbundanceRatio;
 
   if (swu_capacity_times[0]==-1) {
     swu_flexible = FlexibleInput<double>(this, swu_capacity_vals);
@@ -140,6 +310,20 @@ void MIsoEnrich::Tick() {
 
   swu_capacity = swu_flexible.UpdateValue(copy_ptr);
   current_swu_capacity = swu_capacity;
+
+  if (!n_enriching_vals.empty()) {
+    double n_enriching = n_enriching_flexible.UpdateValue(copy_ptr);
+    double n_stripping = n_stripping_flexible.UpdateValue(copy_ptr);
+    // The cascade only gets redesigned if the hardware changes.
+    if (n_enriching != fixed_n_enriching
+        || n_stripping != fixed_n_stripping) {
+      fixed_n_enriching = n_enriching;
+      fixed_n_stripping = n_stripping;
+      CyclusErrors([this]() {
+        enrichment_calc.FixStaging(fixed_n_enriching, fixed_n_stripping);
+      });
+    }
+  }
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -156,6 +340,25 @@ void MIsoEnrich::Tock() {
                                                  intra_timestep_feed);
   RecordTimeSeries<double>("demand"+feed_commod, this,
                            intra_timestep_feed);
+
+  CascadeCache& cache = CascadeCache::Instance();
+  LOG(cyclus::LEV_DEBUG1, "MIsoEn") << "Cascade design cache holds "
+                                    << cache.size() << " designs ("
+                                    << cache.hits() << " hits, "
+                                    << cache.misses() << " misses)";
+
+  if (store && store->pending() > 0) {
+    LOG(cyclus::LEV_DEBUG1, "MIsoEn") << "Writing " << store->pending()
+                                      << " new cascade designs to '"
+                                      << store->path() << "'";
+    // The store only avoids recalculations, hence the simulation goes on
+    // if it cannot be written.
+    try {
+      store->Flush();
+    } catch (Error& e) {
+      LOG(cyclus::LEV_WARN, "MIsoEn") << e.what();
+    }
+  }
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -243,24 +446,39 @@ std::set<cyclus::BidPortfolio<cyclus::Material>::Ptr>
 
     std::vector<Request<Material>*>& commod_requests =
         out_requests[product_commod];
+    std::vector<Request<Material>*> valid_requests;
+    MatVec requested_mats;
     std::vector<Request<Material>*>::iterator it;
     for (it = commod_requests.begin(); it != commod_requests.end(); it++) {
       Request<Material>* req = *it;
       Material::Ptr req_mat = req->target();
-      if (ValidReq_(req_mat)) {
-        Material::Ptr offer = Offer_(req_mat);
-        commod_port->AddBid(req, offer, this);
+      if (CyclusErrors([&]() { return ValidReq_(req_mat); })) {
+        valid_requests.push_back(req);
+        requested_mats.push_back(req_mat);
       }
     }
+    MatVec offers = CyclusErrors([&]() { return Offers_(requested_mats); });
+    for (int i = 0; i < static_cast<int>(offers.size()); i++) {
+      commod_port->AddBid(valid_requests[i], offers[i], this);
+    }
 
     cyclus::Composition::Ptr feed_comp = feed_inv_comp[feed_idx];
+    double feed_qty = feed_inv[feed_idx].quantity();
+    std::shared_ptr<const ConversionTable> table = CyclusErrors([&]() {
+      return ConversionTable_(feed_comp);
+    });
     cyclus::Converter<Material>::Ptr swu_converter(
-        new SwuConverter(feed_comp, tails_assay, gamma_235, enrichment_process,
-                         use_downblending, use_integer_stages));
+        new SwuConverter(feed_comp, tails_assay, gamma_235, process,
+                         use_downblending, use_integer_stages, model,
+                         tails_search, feed_qty, swu_capacity, table,
+                         fixed_n_enriching, fixed_n_stripping, network,
+                         store));
     cyclus::Converter<Material>::Ptr feed_converter(
-        new FeedConverter(feed_comp, tails_assay, gamma_235,
-                          enrichment_process,
-                          use_downblending, use_integer_stages));
+        new FeedConverter(feed_comp, tails_assay, gamma_235, process,
+                          use_downblending, use_integer_stages, model,
+                          tails_search, feed_qty, swu_capacity, table,
+                          fixed_n_enriching, fixed_n_stripping, network,
+                          store));
     CapacityConstraint<Material> swu_constraint(swu_capacity,
                                                 swu_converter);
     CapacityConstraint<Material> feed_constraint(
@@ -280,20 +498,98 @@ std::set<cyclus::BidPortfolio<cyclus::Material>::Ptr>
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-cyclus::Material::Ptr MIsoEnrich::Offer_(
-    cyclus::Material::Ptr mat) {
-  cyclus::Composition::Ptr product_comp;
+std::shared_ptr<const ConversionTable> MIsoEnrich::ConversionTable_(
+    cyclus::Composition::Ptr feed_comp) {
+  if (!conversion_table && tabulate_designs) {
+    IsotopeArray recipe_composition = CompMapToIsotopeArray(
+        context()->GetRecipe(feed_recipe)->atom());
+    if (CompMapToIsotopeArray(feed_comp->atom()) != recipe_composition) {
+      return conversion_table;
+    }
+    double lowest_tails_assay = tails_search.enabled
+                                ? tails_search.min_tails_assay : tails_assay;
+    conversion_table = std::make_shared<const ConversionTable>(
+        recipe_composition, gamma_235, process, max_enrich,
+        lowest_tails_assay);
+  }
+  return conversion_table;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+cyclus::toolkit::MatVec MIsoEnrich::Offers_(
+    const cyclus::toolkit::MatVec& reqs) {
+  std::vector<double> product_assays;
+  std::vector<double> product_qtys;
+  for (int i = 0; i < static_cast<int>(reqs.size()); i++) {
+    product_assays.push_back(MIsoAtomAssay(reqs[i]));
+    product_qtys.push_back(reqs[i]->quantity());
+  }
   double feed_qty = feed_inv[feed_idx].quantity();
-  double product_assay = MIsoAtomAssay(mat);
-  double product_qty = mat->quantity();
 
-  EnrichmentCalculator e(feed_inv_comp[feed_idx], product_assay,
-                         tails_assay, gamma_235,
-                         enrichment_process, feed_qty, product_qty,
-                         swu_capacity, use_downblending, use_integer_stages);
-  e.ProductOutput(product_comp, product_qty);
+  cyclus::toolkit::MatVec offers;
+  if (network) {
+    // The whole network acts as a single cascade.
+    IsotopeArray feed_composition = CompMapToIsotopeArray(
+        feed_inv_comp[feed_idx]->atom());
+    for (int r = 0; r < static_cast<int>(reqs.size()); r++) {
+      CascadeFlows flows = network->Flows(
+          feed_composition, product_assays[r], tails_assay, feed_qty,
+          product_qtys[r], swu_capacity, use_downblending);
+      cyclus::Composition::Ptr product_comp =
+          cyclus::Composition::CreateFromAtom(
+              IsotopeArrayToCompMap(flows.product_composition));
+      offers.push_back(cyclus::Material::CreateUntracked(flows.product_qty,
+                                                         product_comp));
+    }
+    return offers;
+  }
+  if (tails_search.enabled) {
+    // Every request gets its own tails assay, hence the requests cannot be
+    // evaluated as a batch.
+    EnrichmentInput input;
+    input.feed_composition = CompMapToIsotopeArray(
+        feed_inv_comp[feed_idx]->atom());
+    input.feed_qty = feed_qty;
+    input.max_swu = swu_capacity;
+    input.gamma_235 = gamma_235;
+    input.enrichment_process = process;
+    input.use_downblending = use_downblending;
+    input.use_integer_stages = use_integer_stages;
+    input.enrichment_model = model;
+    input.design_store = store.get();
+    for (int r = 0; r < static_cast<int>(reqs.size()); r++) {
+      input.product_assay = product_assays[r];
+      input.product_qty = product_qtys[r];
+      EnrichmentResult result;
+      OptimalTailsAssay(tails_search, input, result);
+      cyclus::Composition::Ptr product_comp =
+          cyclus::Composition::CreateFromAtom(
+              IsotopeArrayToCompMap(result.flows.product_composition));
+      offers.push_back(cyclus::Material::CreateUntracked(
+          result.flows.product_qty, product_comp));
+    }
+    return offers;
+  }
 
-  return cyclus::Material::CreateUntracked(product_qty, product_comp);
+  BatchedFlows flows;
+  enrichment_calc.EnrichBatch(feed_inv_comp[feed_idx], product_assays,
+                              product_qtys, tails_assay, feed_qty,
+                              swu_capacity, gamma_235, process,
+                              use_downblending, use_integer_stages, model,
+                              flows);
+
+  for (int r = 0; r < static_cast<int>(reqs.size()); r++) {
+    IsotopeArray product_composition;
+    for (int i = 0; i < kNumIsotopes; i++) {
+      product_composition[i] = flows.product_composition[i][r];
+    }
+    cyclus::Composition::Ptr product_comp =
+        cyclus::Composition::CreateFromAtom(
+            IsotopeArrayToCompMap(product_composition));
+    offers.push_back(cyclus::Material::CreateUntracked(flows.product_qty[r],
+                                                       product_comp));
+  }
+  return offers;
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -302,8 +598,48 @@ bool MIsoEnrich::ValidReq_(const cyclus::Material::Ptr& req_mat) {
   double u_238 = MIsoAtomFrac(req_mat, IsotopeToNucID(238));
 
   bool u_238_present = u_238 > 0;
-  bool not_depleted = u_235 > tails_assay;
-  bool possible_enrichment = u_235 < max_enrich;
+  double lowest_tails_assay = tails_search.enabled
+                              ? tails_search.min_tails_assay : tails_assay;
+  bool product_reachable = true;
+  if (fixed_n_enriching > 0) {
+    // The target tails assay is not used with a fixed staging, both assays
+    // follow from the hardware and the current feed. Requests above the
+    // product assay of the cascade cannot be served (downblending only
+    // lowers the assay), such that they do not reach `Offers_`.
+    EnrichmentInput input;
+    input.feed_composition = CompMapToIsotopeArray(
+        feed_inv_comp[feed_idx]->atom());
+    input.tails_assay = tails_assay;
+    input.gamma_235 = gamma_235;
+    input.enrichment_process = process;
+    input.use_integer_stages = use_integer_stages;
+    input.enrichment_model = model;
+    input.fixed_n_enriching = fixed_n_enriching;
+    input.fixed_n_stripping = fixed_n_stripping;
+    input.design_store = store.get();
+    CascadeDesign design = FixedStagingDesign(input);
+    lowest_tails_assay = design.tails_composition[kIdx235];
+    product_reachable = !(u_235 > design.product_composition[kIdx235]);
+  }
+  if (network) {
+    // The product assays of the cascades of the network are fixed, such
+    // that only some requests can be served. The stagings must also
+    // converge, which is only known once the network is solved. The
+    // solution is memoised, such that `Offers_`, the converters and
+    // `Enrich_` reuse it.
+    product_reachable = network->ValidAssays(u_235, tails_assay);
+    if (product_reachable) {
+      try {
+        network->Solve(
+            CompMapToIsotopeArray(feed_inv_comp[feed_idx]->atom()),
+            u_235, tails_assay);
+      } catch (Error& e) {
+        product_reachable = false;
+      }
+    }
+  }
+  bool not_depleted = u_235 > lowest_tails_assay;
+  bool possible_enrichment = u_235 < max_enrich && product_reachable;
 
   return u_238_present && not_depleted && possible_enrichment;
 }
@@ -389,7 +725,9 @@ void MIsoEnrich::GetMatlTrades(
                                        << " just received an order for "
                                        << it->amt << " of "
                                        << product_commod;
-      response = Enrich_(it->bid->offer(), qty);
+      response = CyclusErrors([&]() {
+        return Enrich_(it->bid->offer(), qty);
+      });
     }
     responses.push_back(std::make_pair(*it, response));
   }
@@ -452,15 +790,36 @@ cyclus::Material::Ptr MIsoEnrich::Enrich_(
   double feed_qty = feed_inv[feed_idx].quantity();
   double product_assay = MIsoAtomAssay(mat);
 
-  // In the following line, the enrichment is calculated but it is not yet
-  // performed!
-  EnrichmentCalculator e(feed_inv_comp[feed_idx], product_assay,
-                         tails_assay, gamma_235, enrichment_process,
-                         feed_qty, request_qty,
-                         swu_capacity, use_downblending, use_integer_stages);
-  e.EnrichmentOutput(product_comp, tails_comp, feed_required,
-                                   swu_required, product_qty, tails_qty,
-                                   n_enriching, n_stripping);
+  double trade_tails_assay = TailsAssay(
+      CompMapToIsotopeArray(feed_inv_comp[feed_idx]->atom()), product_assay,
+      request_qty, tails_assay, tails_search, feed_qty, swu_capacity,
+      gamma_235, process, use_downblending, use_integer_stages, model,
+      store.get());
+
+  // In the following lines, the enrichment is calculated but it is not
+  // yet performed!
+  if (network) {
+    CascadeFlows flows = network->Flows(
+        CompMapToIsotopeArray(feed_inv_comp[feed_idx]->atom()),
+        product_assay, trade_tails_assay, feed_qty, request_qty,
+        swu_capacity, use_downblending);
+    product_comp = cyclus::Composition::CreateFromAtom(
+        IsotopeArrayToCompMap(flows.product_composition));
+    feed_required = flows.feed_qty;
+    swu_required = flows.swu;
+    product_qty = flows.product_qty;
+    tails_qty = flows.tails_qty;
+  } else {
+    enrichment_calc.SetInput(feed_inv_comp[feed_idx], product_assay,
+                             trade_tails_assay, feed_qty, request_qty,
+                             swu_capacity,
+                             gamma_235, process, use_downblending,
+                             use_integer_stages, model);
+    enrichment_calc.EnrichmentOutput(product_comp, tails_comp,
+                                     feed_required, swu_required,
+                                     product_qty, tails_qty, n_enriching,
+                                     n_stripping);
+  }
   // Now, perform the enrichment by popping the feed and converting it to
   // product and tails.
   cyclus::Material::Ptr pop_mat;
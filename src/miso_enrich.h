@@ -1,26 +1,100 @@
 #ifndef MISOENRICHMENT_SRC_MISO_ENRICH_H_
 #define MISOENRICHMENT_SRC_MISO_ENRICH_H_
 
+#include <array>
+#include <memory>
 #include <string>
 #include <vector>
 
 #include "cyclus.h"
 
+#include "cascade_network.h"
+#include "conversion_table.h"
+#include "design_store.h"
 #include "enrichment_calculator.h"
+#include "enrichment_process.h"
 #include "flexible_input.cc"
 #include "miso_helper.h"
+#include "stage_cascade.h"
+#include "tails_assay_search.h"
 
 namespace misoenrichment {
 
+// Returns `tails_assay` or, if the search is enabled, the optimal tails
+// assay for the given product and constraints, see `OptimalTailsAssay`.
+// The search uses `design_store` unless it is NULL. The feed is given as
+// in `EnrichmentInput`. As the search only evaluates enrichments using
+// `EvaluateEnrichment`, the function may be called concurrently. Errors
+// of the search are rethrown as Cyclus exceptions, see `CyclusErrors`.
+double TailsAssay(const IsotopeArray& feed_composition, double product_assay,
+                  double product_qty, double tails_assay,
+                  const TailsAssaySearch& tails_search, double feed_qty,
+                  double max_swu, double gamma_235,
+                  EnrichmentProcess enrichment_process,
+                  bool use_downblending, bool use_integer_stages,
+                  EnrichmentModel enrichment_model,
+                  DesignStore* design_store);
+
+// Returns `conversion_table` if it can be used to evaluate enrichments of
+// `feed_comp`, else a null pointer. The table only contains designs of the
+// matched abundance ratio model with an integer number of stages.
+std::shared_ptr<const ConversionTable> TableForFeed(
+    std::shared_ptr<const ConversionTable> conversion_table,
+    cyclus::Composition::Ptr feed_comp, double gamma_235,
+    EnrichmentProcess enrichment_process, bool use_integer_stages,
+    EnrichmentModel enrichment_model);
+
+// Returns the flows needed to deliver `product_qty` at `product_assay`
+// with unlimited feed and separative work. If `cascade_network` is not
+// NULL, then the flows are the ones of the network, with infinite feed and
+// separative work if the network cannot be solved. Else, the designs are
+// taken from `conversion_table` (may be NULL) if it covers the targets and
+// if the staging is not fixed, or they are calculated using
+// `EvaluateEnrichment` with `design_store` (may be NULL). The function has
+// no side effects apart from adding designs to the store. Together with
+// `TailsAssay`, this allows evaluating the converters concurrently, also
+// if the tails assay is searched for. Errors of the enrichment calculations
+// are rethrown as Cyclus exceptions, see `CyclusErrors`.
+CascadeFlows ConstraintFlows(const IsotopeArray& feed_composition,
+                             double product_assay, double tails_assay,
+                             double product_qty, double gamma_235,
+                             EnrichmentProcess enrichment_process,
+                             bool use_downblending, bool use_integer_stages,
+                             EnrichmentModel enrichment_model,
+                             double fixed_n_enriching,
+                             double fixed_n_stripping,
+                             const ConversionTable* conversion_table,
+                             const CascadeNetwork* cascade_network,
+                             DesignStore* design_store);
+
 class SwuConverter : public cyclus::Converter<cyclus::Material> {
  public:
   SwuConverter(cyclus::Composition::Ptr feed_comp, double tails_assay,
-               double gamma_235, std::string enrichment_process,
-               bool use_downblending, bool use_integer_stages)
-      : feed_comp_(feed_comp), gamma_235_(gamma_235),
+               double gamma_235, EnrichmentProcess enrichment_process,
+               bool use_downblending, bool use_integer_stages,
+               EnrichmentModel enrichment_model,
+               const TailsAssaySearch& tails_search, double feed_qty,
+               double max_swu,
+               std::shared_ptr<const ConversionTable> conversion_table,
+               double fixed_n_enriching, double fixed_n_stripping,
+               std::shared_ptr<const CascadeNetwork> cascade_network,
+               std::shared_ptr<DesignStore> design_store)
+      : feed_comp_(feed_comp),
+        feed_composition_(CompMapToIsotopeArray(feed_comp->atom())),
+        gamma_235_(gamma_235),
         enrichment_process_(enrichment_process),
+        enrichment_model_(enrichment_model),
+        tails_search_(tails_search), feed_qty_(feed_qty), max_swu_(max_swu),
         tails_assay_(tails_assay), use_downblending(use_downblending),
-        use_integer_stages(use_integer_stages) {}
+        use_integer_stages(use_integer_stages),
+        conversion_table_(TableForFeed(conversion_table, feed_comp,
+                                       gamma_235, enrichment_process,
+                                       use_integer_stages,
+                                       enrichment_model)),
+        fixed_n_enriching_(fixed_n_enriching),
+        fixed_n_stripping_(fixed_n_stripping),
+        cascade_network_(cascade_network),
+        design_store_(design_store) {}
 
   virtual ~SwuConverter() {}
 
@@ -31,13 +105,20 @@ class SwuConverter : public cyclus::Converter<cyclus::Material> {
 
     double product_qty = m->quantity();
     double product_assay = MIsoAtomAssay(m);
-    EnrichmentCalculator e(feed_comp_, product_assay, tails_assay_, gamma_235_,
-                           enrichment_process_,
-                           1e299, product_qty, 1e299, use_downblending,
-                           use_integer_stages);
-    double swu_used = e.SwuUsed();
-
-    return swu_used;
+    double tails_assay = TailsAssay(feed_composition_, product_assay,
+                                    product_qty, tails_assay_, tails_search_,
+                                    feed_qty_, max_swu_, gamma_235_,
+                                    enrichment_process_, use_downblending,
+                                    use_integer_stages, enrichment_model_,
+                                    design_store_.get());
+    CascadeFlows flows = ConstraintFlows(
+        feed_composition_, product_assay, tails_assay, product_qty,
+        gamma_235_, enrichment_process_, use_downblending,
+        use_integer_stages, enrichment_model_, fixed_n_enriching_,
+        fixed_n_stripping_, conversion_table_.get(),
+        cascade_network_.get(), design_store_.get());
+
+    return flows.swu;
   }
 
   virtual bool operator==(Converter& other) const {
@@ -56,21 +137,57 @@ class SwuConverter : public cyclus::Converter<cyclus::Material> {
   bool use_downblending;
   bool use_integer_stages;
   cyclus::Composition::Ptr feed_comp_;
+  // Converted once such that `convert` does not access `feed_comp_` for
+  // the enrichment calculation and the tails assay search.
+  IsotopeArray feed_composition_;
   double gamma_235_;
-  std::string enrichment_process_;
+  EnrichmentProcess enrichment_process_;
+  EnrichmentModel enrichment_model_;
+  // The feed and SWU constraints are only used to find the tails assay.
+  TailsAssaySearch tails_search_;
+  double feed_qty_;
+  double max_swu_;
   double tails_assay_;
+  // Only set if the table yields the designs used for this feed.
+  std::shared_ptr<const ConversionTable> conversion_table_;
+  // Staging of the facility if fixed, else zero.
+  double fixed_n_enriching_;
+  double fixed_n_stripping_;
+  // Only set if the facility consists of a cascade network.
+  std::shared_ptr<const CascadeNetwork> cascade_network_;
+  // Only set if the facility uses a persistent design store.
+  std::shared_ptr<DesignStore> design_store_;
 };
 
 class FeedConverter : public cyclus::Converter<cyclus::Material> {
  public:
   FeedConverter(cyclus::Composition::Ptr feed_comp, double tails_assay,
-                double gamma_235, std::string enrichment_process,
+                double gamma_235, EnrichmentProcess enrichment_process,
                 bool use_downblending,
-                bool use_integer_stages)
-      : feed_comp_(feed_comp), gamma_235_(gamma_235),
+                bool use_integer_stages,
+                EnrichmentModel enrichment_model,
+                const TailsAssaySearch& tails_search, double feed_qty,
+                double max_swu,
+                std::shared_ptr<const ConversionTable> conversion_table,
+                double fixed_n_enriching, double fixed_n_stripping,
+                std::shared_ptr<const CascadeNetwork> cascade_network,
+                std::shared_ptr<DesignStore> design_store)
+      : feed_comp_(feed_comp),
+        feed_composition_(CompMapToIsotopeArray(feed_comp->atom())),
+        gamma_235_(gamma_235),
         enrichment_process_(enrichment_process),
+        enrichment_model_(enrichment_model),
+        tails_search_(tails_search), feed_qty_(feed_qty), max_swu_(max_swu),
         tails_assay_(tails_assay), use_downblending(use_downblending),
-        use_integer_stages(use_integer_stages) {}
+        use_integer_stages(use_integer_stages),
+        conversion_table_(TableForFeed(conversion_table, feed_comp,
+                                       gamma_235, enrichment_process,
+                                       use_integer_stages,
+                                       enrichment_model)),
+        fixed_n_enriching_(fixed_n_enriching),
+        fixed_n_stripping_(fixed_n_stripping),
+        cascade_network_(cascade_network),
+        design_store_(design_store) {}
 
   virtual ~FeedConverter() {}
 
@@ -81,14 +198,22 @@ class FeedConverter : public cyclus::Converter<cyclus::Material> {
 
     double product_qty = m->quantity();
     double product_assay = MIsoAtomAssay(m);
-    EnrichmentCalculator e(feed_comp_, product_assay, tails_assay_, gamma_235_,
-                           enrichment_process_,
-                           1e299, product_qty, 1e299, use_downblending,
-                           use_integer_stages);
-    double feed_used = e.FeedUsed();
+    double tails_assay = TailsAssay(feed_composition_, product_assay,
+                                    product_qty, tails_assay_, tails_search_,
+                                    feed_qty_, max_swu_, gamma_235_,
+                                    enrichment_process_, use_downblending,
+                                    use_integer_stages, enrichment_model_,
+                                    design_store_.get());
+    CascadeFlows flows = ConstraintFlows(
+        feed_composition_, product_assay, tails_assay, product_qty,
+        gamma_235_, enrichment_process_, use_downblending,
+        use_integer_stages, enrichment_model_, fixed_n_enriching_,
+        fixed_n_stripping_, conversion_table_.get(),
+        cascade_network_.get(), design_store_.get());
+    double feed_used = flows.feed_qty;
 
     cyclus::toolkit::MatQuery mq(m);
-    std::vector<int> isotopes(IsotopesNucID());
+    const std::array<int, kNumIsotopes>& isotopes = IsotopesNucID();
     std::set<int> nucs(isotopes.begin(), isotopes.end());
     double feed_uranium_frac = mq.atom_frac(nucs);
 
@@ -111,9 +236,26 @@ class FeedConverter : public cyclus::Converter<cyclus::Material> {
   bool use_downblending;
   bool use_integer_stages;
   cyclus::Composition::Ptr feed_comp_;
+  // Converted once such that `convert` does not access `feed_comp_` for
+  // the enrichment calculation and the tails assay search.
+  IsotopeArray feed_composition_;
   double gamma_235_;
-  std::string enrichment_process_;
+  EnrichmentProcess enrichment_process_;
+  EnrichmentModel enrichment_model_;
+  // The feed and SWU constraints are only used to find the tails assay.
+  TailsAssaySearch tails_search_;
+  double feed_qty_;
+  double max_swu_;
   double tails_assay_;
+  // Only set if the table yields the designs used for this feed.
+  std::shared_ptr<const ConversionTable> conversion_table_;
+  // Staging of the facility if fixed, else zero.
+  double fixed_n_enriching_;
+  double fixed_n_stripping_;
+  // Only set if the facility consists of a cascade network.
+  std::shared_ptr<const CascadeNetwork> cascade_network_;
+  // Only set if the facility uses a persistent design store.
+  std::shared_ptr<DesignStore> design_store_;
 };
 
 /// @class MIsoEnrich
@@ -168,11 +310,20 @@ class MIsoEnrich : public cyclus::Facility,
 
   cyclus::Material::Ptr Request_();
 
-  // The Offer function only considers U235 content that needs to be
+  // Returns the conversion table if it covers `feed_comp`, else a null
+  // pointer. The table of the feed recipe is built upon the first call
+  // with the feed recipe, such that facilities that never bid with it do
+  // not tabulate any designs.
+  std::shared_ptr<const ConversionTable> ConversionTable_(
+      cyclus::Composition::Ptr feed_comp);
+
+  // The Offers function only considers U235 content that needs to be
   // achieved and it ignores the minor isotopes. This has the advantage
   // that the evolution of minor isotopes does not need to be taken into
-  // account when performing requests to a MIsoEnrich facility.
-  cyclus::Material::Ptr Offer_(cyclus::Material::Ptr req);
+  // account when performing requests to a MIsoEnrich facility. All
+  // requests of one timestep are evaluated at once, the i-th offer
+  // belongs to the i-th request.
+  cyclus::toolkit::MatVec Offers_(const cyclus::toolkit::MatVec& reqs);
 
   cyclus::Material::Ptr Enrich_(cyclus::Material::Ptr mat, double qty);
 
@@ -261,6 +412,69 @@ class MIsoEnrich : public cyclus::Facility,
   }
   double max_enrich;
 
+  #pragma cyclus var { \
+    "default": 0, \
+    "tooltip": "Optimise the tails assay", \
+    "uilabel": "Optimise the tails assay for each enrichment", \
+    "doc": "If set to true, then the tails assay is chosen for each bid " \
+           "and each trade between 'min_tails_assay' and " \
+           "'max_tails_assay' such that the product is maximised under " \
+           "the current feed and SWU constraints or, if 'feed_cost' or " \
+           "'swu_cost' is positive, such that the cost per unit of " \
+           "product is minimised. Else, 'tails_assay' is used." \
+  }
+  bool optimize_tails_assay;
+
+  #pragma cyclus var { \
+    "default": 0.001, \
+    "tooltip": "Lowest tails assay (atom fraction)", \
+    "uilabel": "Lowest tails assay considered (atom fraction)", \
+    "doc": "Lowest tails assay considered if 'optimize_tails_assay' is " \
+           "true." \
+  }
+  double min_tails_assay;
+
+  #pragma cyclus var { \
+    "default": 0.005, \
+    "tooltip": "Highest tails assay (atom fraction)", \
+    "uilabel": "Highest tails assay considered (atom fraction)", \
+    "doc": "Highest tails assay considered if 'optimize_tails_assay' is " \
+           "true. Tails assays at or above the feed assay are never used." \
+  }
+  double max_tails_assay;
+
+  #pragma cyclus var { \
+    "default": 0, \
+    "tooltip": "Cost per kg of feed", \
+    "uilabel": "Cost per kg of feed", \
+    "doc": "Cost per kg of feed, only used if 'optimize_tails_assay' is " \
+           "true." \
+  }
+  double feed_cost;
+
+  #pragma cyclus var { \
+    "default": 0, \
+    "tooltip": "Cost per kg SWU", \
+    "uilabel": "Cost per kg SWU", \
+    "doc": "Cost per kg SWU, only used if 'optimize_tails_assay' is true." \
+  }
+  double swu_cost;
+
+  #pragma cyclus var { \
+    "default": 1, \
+    "userlevel": 10, \
+    "tooltip": "Precompute the cascade designs of the feed recipe", \
+    "uilabel": "Precompute the cascade designs of the feed recipe", \
+    "doc": "If set to true (default), then the cascade designs of the " \
+           "feed recipe are tabulated when the facility first bids with " \
+           "feed of the recipe and used to evaluate the SWU and feed " \
+           "constraints of the bids. The results are identical to the " \
+           "ones without table. The table is only used with an integer " \
+           "number of stages and the 'matched_abundance_ratio' enrichment " \
+           "model." \
+  }
+  bool use_conversion_table;
+
   #pragma cyclus var { \
     "default": 1,	\
     "userlevel": 10, \
@@ -286,12 +500,51 @@ class MIsoEnrich : public cyclus::Facility,
   }
   std::string enrichment_process;
 
+  #pragma cyclus var { \
+    "default": "matched_abundance_ratio", \
+    "tooltip": "Enrichment model, 'matched_abundance_ratio' or " \
+               "'stage_by_stage'", \
+    "uilabel": "Enrichment model", \
+    "doc": "Model used to calculate the product and tails compositions. " \
+           "'matched_abundance_ratio' (default) uses an ideal matched " \
+           "abundance ratio cascade. 'stage_by_stage' keeps its staging " \
+           "and separative work but resolves the cascade stage by stage, " \
+           "with all stages operating at the same cut. Due to the mixing " \
+           "losses, the product and tails assays may then miss the " \
+           "requested ones and more feed and SWU are needed. It requires " \
+           "'use_integer_stages' to be 'true'.", \
+  }
+  std::string enrichment_model;
+
   double swu_capacity;
   double current_swu_capacity;
 
   double intra_timestep_swu;
   double intra_timestep_feed;
 
+  // Calculator reused for all enrichments of this facility such that the
+  // cascade only gets redesigned if the feed or the assays change.
+  EnrichmentCalculator enrichment_calc;
+  // Parsed from `enrichment_process` when entering the simulation.
+  EnrichmentProcess process;
+  // Parsed from `enrichment_model` when entering the simulation.
+  EnrichmentModel model;
+  // Built from the tails assay search variables when entering the
+  // simulation.
+  TailsAssaySearch tails_search;
+  // Cascade designs of the feed recipe used by the SWU and feed converters,
+  // built by `ConversionTable_` if `tabulate_designs` is true.
+  std::shared_ptr<const ConversionTable> conversion_table;
+  // Set when entering the simulation if `use_conversion_table` is true and
+  // the designs of the facility can be tabulated.
+  bool tabulate_designs;
+  // Built from `cascade_network` when entering the simulation, NULL if the
+  // facility consists of a single cascade.
+  std::shared_ptr<const CascadeNetwork> network;
+  // Opened from `design_store` when entering the simulation, NULL if no
+  // path is given.
+  std::shared_ptr<DesignStore> store;
+
   // TODO think about how to include these variables in preprocessor
   //#pragma cyclus var {}
   std::vector<cyclus::toolkit::ResBuf<cyclus::Material> > feed_inv;
@@ -366,6 +619,87 @@ class MIsoEnrich : public cyclus::Facility,
            "the desired product and tails assays are obtained."  \
   }
   bool use_integer_stages;
+
+  #pragma cyclus var {  \
+    "default": [],  \
+    "tooltip": "Fixed number of enriching stages",  \
+    "uilabel": "Fixed number of enriching stages",  \
+    "doc": "Number of enriching stages of the cascade hardware. If given, "  \
+           "then the cascade is not designed for every enrichment. "  \
+           "Instead, the product and tails compositions follow from the "  \
+           "fixed staging, the product is downblended if it exceeds the "  \
+           "requested assay and 'tails_assay' is not used. Requests above "  \
+           "the product assay of the cascade are not served. The list "  \
+           "contains the staging of each period of 'staging_times'. It "  \
+           "requires 'n_stripping_vals' of the same size and it cannot be "  \
+           "combined with 'optimize_tails_assay'."  \
+  }
+  std::vector<int> n_enriching_vals;
+
+  #pragma cyclus var {  \
+    "default": [],  \
+    "tooltip": "Fixed number of stripping stages",  \
+    "uilabel": "Fixed number of stripping stages",  \
+    "doc": "Number of stripping stages of the cascade hardware, see "  \
+           "'n_enriching_vals'."  \
+  }
+  std::vector<int> n_stripping_vals;
+
+  #pragma cyclus var {  \
+    "default": [-1],  \
+    "tooltip": "Staging change times in timesteps from beginning of "  \
+               "deployment",  \
+    "uilabel": "Staging change times",  \
+    "doc": "list of timesteps where the fixed staging is changed, see "  \
+           "'swu_capacity_times'. If not given, then the i-th staging is "  \
+           "used in the i-th timestep after deployment, the last one "  \
+           "remaining in use."  \
+  }
+  std::vector<int> staging_times;
+  FlexibleInput<int> n_enriching_flexible;
+  FlexibleInput<int> n_stripping_flexible;
+  // Current fixed staging, zero if the staging follows the targets.
+  double fixed_n_enriching;
+  double fixed_n_stripping;
+
+  #pragma cyclus var {  \
+    "default": [],  \
+    "tooltip": "Cascades of the facility and their connections",  \
+    "uilabel": "Cascade network",  \
+    "doc": "If given, then the facility consists of several cascades "  \
+           "connected in series, e.g., a cascade enriching natural "  \
+           "uranium to LEU followed by a cascade enriching the LEU to HEU, "  \
+           "possibly with the tails of the second cascade recycled into "  \
+           "the first one. All flows of the network are solved at once. "  \
+           "Each entry describes one cascade as '<product assay> <tails "  \
+           "assay> <product destination> <tails destination>'. An assay "  \
+           "of 0 stands for the requested product assay and for "  \
+           "'tails_assay', respectively. A destination is either "  \
+           "'product', 'tails' or the (zero-based) index of the cascade "  \
+           "receiving the stream. The feed enters the first cascade. "  \
+           "Requests that the network cannot deliver, e.g., below the "  \
+           "product assay of a cascade feeding another one, are not "  \
+           "served. Cannot be combined with 'optimize_tails_assay', a fixed "  \
+           "staging or the 'stage_by_stage' enrichment model."  \
+  }
+  std::vector<std::string> cascade_network;
+
+  #pragma cyclus var {  \
+    "default": "",  \
+    "userlevel": 10,  \
+    "tooltip": "File storing the cascade designs across simulations",  \
+    "uilabel": "Cascade design store",  \
+    "doc": "Path of a file in which the cascade designs are stored such "  \
+           "that repeated simulations (e.g., of a parameter study) do not "  \
+           "redesign the same cascades. The designs are looked up before "  \
+           "a staging is determined and new designs are written at the "  \
+           "end of each timestep. The file is created if it does not "  \
+           "exist yet and may be shared by several facilities and by "  \
+           "simulations running at the same time. The results are "  \
+           "identical to the ones without store. No store is used if "  \
+           "empty (default)."  \
+  }
+  std::string design_store;
 };
 
 }  // namespace misoenrichment
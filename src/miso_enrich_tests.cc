@@ -1,6 +1,8 @@
 #include "miso_enrich_tests.h"
 
+#include <memory>
 #include <set>
+#include <thread>
 #include <vector>
 
 #include "agent_tests.h"
@@ -12,6 +14,7 @@
 #include "pyhooks.h"
 #include "query_backend.h"
 
+#include "cascade_cache.h"
 #include "miso_helper.h"
 
 using cyclus::Cond;
@@ -153,6 +156,182 @@ TEST_F(MIsoEnrichTest, BidPrefs) {
   misotest::CompareCompMap(actual, cm);
 }
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST_F(MIsoEnrichTest, CascadeNetwork) {
+  // The feed is enriched to 20% U235 in the first cascade and to the
+  // requested assay in the second one, whose tails are recycled into the
+  // first cascade. Weapon-grade uranium is served, while requests for 10%
+  // U235 lie below the product assay of the first cascade.
+  std::string config =
+    "   <feed_commod>feed_U</feed_commod> "
+    "   <feed_recipe>feed_recipe</feed_recipe> "
+    "   <initial_feed>100000</initial_feed> "
+    "   <product_commod>enriched_U</product_commod> "
+    "   <tails_commod>depleted_U</tails_commod> "
+    "   <enrichment_process>centrifuge</enrichment_process> "
+    "   <swu_capacity_times><val>0</val></swu_capacity_times> "
+    "   <swu_capacity_vals><val>1000000</val></swu_capacity_vals> "
+    "   <use_downblending>1</use_downblending> "
+    "   <use_integer_stages>1</use_integer_stages> "
+    "   <cascade_network> "
+    "     <val>0.2 0 1 tails</val> "
+    "     <val>0 0.02 product 0</val> "
+    "   </cascade_network> ";
+
+  cyclus::CompMap cm;
+  cm[922350000] = 10;
+  cm[922380000] = 90;
+  for (bool weapongrade : {true, false}) {
+    cyclus::Composition::Ptr product_comp =
+        weapongrade ? misotest::comp_weapongradeU()
+                    : cyclus::Composition::CreateFromMass(cm);
+    int simdur = 1;
+    cyclus::MockSim sim(cyclus::AgentSpec(":misoenrichment:MIsoEnrich"),
+                        config, simdur);
+    sim.AddRecipe(feed_recipe, recipe);
+    sim.AddRecipe("enriched_U_recipe", product_comp);
+    sim.AddSink("enriched_U").recipe("enriched_U_recipe")
+                             .capacity(10)
+                             .Finalize();
+    int id = sim.Run();
+
+    std::vector<Cond> conds;
+    conds.push_back(Cond("Commodity", "==", std::string("enriched_U")));
+    QueryResult qr = sim.db().Query("Transactions", &conds);
+    if (weapongrade) {
+      ASSERT_EQ(qr.rows.size(), 1);
+      Material::Ptr m = sim.GetMaterial(qr.GetVal<int>("ResourceId"));
+      EXPECT_NEAR(m->quantity(), 10, 1e-10);
+      EXPECT_NEAR(MIsoAtomAssay(m), MIsoAtomAssay(product_comp), 1e-10);
+    } else {
+      EXPECT_EQ(qr.rows.size(), 0);
+    }
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST_F(MIsoEnrichTest, ConcurrentConverters) {
+  // The converters search the optimal tails assay of each request. Their
+  // evaluations from several threads must yield the same results as the
+  // serial ones, which use the designs at the optimal tails assay.
+  TailsAssaySearch search;
+  search.enabled = true;
+  search.min_tails_assay = 0.001;
+  search.max_tails_assay = 0.004;
+  search.feed_cost = 0;
+  search.swu_cost = 0;
+  const double feed_qty = 100;
+  const double max_swu = 300;
+  cyclus::Composition::Ptr feed_comp = misotest::comp_natU();
+  SwuConverter swu_converter(
+      feed_comp, tails_assay, gamma_235, EnrichmentProcess::kCentrifuge,
+      true, true, EnrichmentModel::kMatchedAbundanceRatio, search, feed_qty,
+      max_swu, std::shared_ptr<const ConversionTable>(), 0, 0,
+      std::shared_ptr<const CascadeNetwork>(), std::shared_ptr<DesignStore>());
+  FeedConverter feed_converter(
+      feed_comp, tails_assay, gamma_235, EnrichmentProcess::kCentrifuge,
+      true, true, EnrichmentModel::kMatchedAbundanceRatio, search, feed_qty,
+      max_swu, std::shared_ptr<const ConversionTable>(), 0, 0,
+      std::shared_ptr<const CascadeNetwork>(), std::shared_ptr<DesignStore>());
+
+  // The compositions are given as atom fractions, such that they are not
+  // converted lazily while the threads read them.
+  IsotopeArray feed_composition = CompMapToIsotopeArray(feed_comp->atom());
+  std::vector<Material::Ptr> requests;
+  std::vector<double> expected_swu;
+  for (double product_assay = 0.01; product_assay < 0.3;
+       product_assay *= 1.4) {
+    cyclus::CompMap cm;
+    cm[922350000] = product_assay;
+    cm[922380000] = 1 - product_assay;
+    requests.push_back(Material::CreateUntracked(
+        10, cyclus::Composition::CreateFromAtom(cm)));
+    double optimal_tails_assay = TailsAssay(
+        feed_composition, product_assay, 10, tails_assay, search, feed_qty,
+        max_swu, gamma_235, EnrichmentProcess::kCentrifuge, true, true,
+        EnrichmentModel::kMatchedAbundanceRatio, NULL);
+    expected_swu.push_back(ConstraintFlows(
+        feed_composition, product_assay, optimal_tails_assay, 10, gamma_235,
+        EnrichmentProcess::kCentrifuge, true, true,
+        EnrichmentModel::kMatchedAbundanceRatio, 0, 0, NULL, NULL,
+        NULL).swu);
+  }
+  std::vector<double> expected_feed;
+  for (const Material::Ptr& request : requests) {
+    expected_feed.push_back(feed_converter.convert(request));
+  }
+
+  CascadeCache::Instance().Clear();
+  const int n_threads = 4;
+  std::vector<std::vector<double> > swu(n_threads);
+  std::vector<std::vector<double> > feed(n_threads);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < n_threads; t++) {
+    threads.emplace_back([&, t]() {
+      for (const Material::Ptr& request : requests) {
+        swu[t].push_back(swu_converter.convert(request));
+        feed[t].push_back(feed_converter.convert(request));
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  for (int t = 0; t < n_threads; t++) {
+    for (int r = 0; r < static_cast<int>(requests.size()); r++) {
+      EXPECT_EQ(expected_swu[r], swu[t][r]);
+      EXPECT_EQ(expected_feed[r], feed[t][r]);
+    }
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST_F(MIsoEnrichTest, EnrichmentModel) {
+  // Same setup as in the FeedConstraint test. With the stage-by-stage
+  // model, the mixing losses in the cascade lead to less product with a
+  // lower assay being obtained from the 100 kg of feed available.
+  std::vector<double> product_qtys;
+  std::vector<double> product_assays;
+  for (std::string model : {"matched_abundance_ratio", "stage_by_stage"}) {
+    std::string config =
+      "   <feed_commod>feed_U</feed_commod> "
+      "   <feed_recipe>feed_recipe</feed_recipe> "
+      "   <initial_feed>100</initial_feed> "
+      "   <product_commod>enriched_U</product_commod> "
+      "   <tails_commod>depleted_U</tails_commod> "
+      "   <tails_assay>0.002</tails_assay> "
+      "   <enrichment_process>centrifuge</enrichment_process> "
+      "   <enrichment_model>" + model + "</enrichment_model> "
+      "   <swu_capacity_times><val>0</val></swu_capacity_times> "
+      "   <swu_capacity_vals><val>10000</val></swu_capacity_vals> "
+      "   <use_downblending>0</use_downblending> "
+      "   <use_integer_stages>1</use_integer_stages> ";
+
+    int simdur = 1;
+    cyclus::MockSim sim(cyclus::AgentSpec(":misoenrichment:MIsoEnrich"),
+                        config, simdur);
+    sim.AddRecipe(feed_recipe, recipe);
+    sim.AddRecipe("enriched_U_recipe", misotest::comp_weapongradeU());
+    sim.AddSink("enriched_U").recipe("enriched_U_recipe")
+                             .Finalize();
+    int id = sim.Run();
+
+    std::vector<Cond> conds;
+    conds.push_back(Cond("Commodity", "==", std::string("enriched_U")));
+    QueryResult qr = sim.db().Query("Transactions", &conds);
+    ASSERT_EQ(qr.rows.size(), 1);
+    Material::Ptr m = sim.GetMaterial(qr.GetVal<int>("ResourceId"));
+    product_qtys.push_back(m->quantity());
+    product_assays.push_back(MIsoAtomAssay(m));
+  }
+  EXPECT_NEAR(product_qtys[0], 0.5754, 1e-4);
+  EXPECT_GE(product_assays[0],
+            MIsoAtomAssay(misotest::comp_weapongradeU()));
+  EXPECT_GT(product_qtys[1], 0);
+  EXPECT_LT(product_qtys[1], product_qtys[0]);
+  EXPECT_LT(product_assays[1], product_assays[0]);
+}
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 TEST_F(MIsoEnrichTest, FeedConstraint) {
   // Check that the feed constraint is evaluated correctly. Only 100 kg of
@@ -188,6 +367,57 @@ TEST_F(MIsoEnrichTest, FeedConstraint) {
   EXPECT_NEAR(m->quantity(),0.5754, 1e-4);
 }
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST_F(MIsoEnrichTest, FixedStaging) {
+  // A cascade with 10 enriching and 5 stripping stages delivers 3.75%
+  // U235. Requests for 3% U235 are served (after downblending), while the
+  // hardware cannot reach weapon-grade uranium.
+  std::string config =
+    "   <feed_commod>feed_U</feed_commod> "
+    "   <feed_recipe>feed_recipe</feed_recipe> "
+    "   <initial_feed>1000</initial_feed> "
+    "   <product_commod>enriched_U</product_commod> "
+    "   <tails_commod>depleted_U</tails_commod> "
+    "   <enrichment_process>centrifuge</enrichment_process> "
+    "   <swu_capacity_times><val>0</val></swu_capacity_times> "
+    "   <swu_capacity_vals><val>10000</val></swu_capacity_vals> "
+    "   <use_downblending>1</use_downblending> "
+    "   <use_integer_stages>1</use_integer_stages> "
+    "   <n_enriching_vals><val>10</val></n_enriching_vals> "
+    "   <n_stripping_vals><val>5</val></n_stripping_vals> ";
+
+  cyclus::CompMap cm;
+  cm[922350000] = 3;
+  cm[922380000] = 97;
+  for (bool weapongrade : {false, true}) {
+    int simdur = 1;
+    cyclus::MockSim sim(cyclus::AgentSpec(":misoenrichment:MIsoEnrich"),
+                        config, simdur);
+    sim.AddRecipe(feed_recipe, recipe);
+    sim.AddRecipe("enriched_U_recipe",
+                  weapongrade ? misotest::comp_weapongradeU()
+                              : cyclus::Composition::CreateFromMass(cm));
+    sim.AddSink("enriched_U").recipe("enriched_U_recipe")
+                             .capacity(10)
+                             .Finalize();
+    int id = sim.Run();
+
+    std::vector<Cond> conds;
+    conds.push_back(Cond("Commodity", "==", std::string("enriched_U")));
+    QueryResult qr = sim.db().Query("Transactions", &conds);
+    if (weapongrade) {
+      EXPECT_EQ(qr.rows.size(), 0);
+    } else {
+      ASSERT_EQ(qr.rows.size(), 1);
+      Material::Ptr m = sim.GetMaterial(qr.GetVal<int>("ResourceId"));
+      EXPECT_NEAR(m->quantity(), 10, 1e-10);
+      EXPECT_NEAR(MIsoAtomAssay(m),
+                  MIsoAtomAssay(cyclus::Composition::CreateFromMass(cm)),
+                  1e-10);
+    }
+  }
+}
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 TEST_F(MIsoEnrichTest, GetMatlBids) {
   // Test the bidding. At first no bids are expected because there are
@@ -360,6 +590,44 @@ TEST_F(MIsoEnrichTest, RequestSim) {
   EXPECT_NEAR(m->quantity(), 100, 1e-10);
 }
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST_F(MIsoEnrichTest, TailsAssaySearch) {
+  // Same setup as in the FeedConstraint test, which yields 0.5754 kg of
+  // weapon-grade uranium at a tails assay of 0.2%. With ample separative
+  // work, searching the tails assay extracts more U235 from the feed.
+  std::string config =
+    "   <feed_commod>feed_U</feed_commod> "
+    "   <feed_recipe>feed_recipe</feed_recipe> "
+    "   <initial_feed>100</initial_feed> "
+    "   <product_commod>enriched_U</product_commod> "
+    "   <tails_commod>depleted_U</tails_commod> "
+    "   <tails_assay>0.002</tails_assay> "
+    "   <enrichment_process>centrifuge</enrichment_process> "
+    "   <swu_capacity_times><val>0</val></swu_capacity_times> "
+    "   <swu_capacity_vals><val>10000</val></swu_capacity_vals> "
+    "   <use_downblending>0</use_downblending> "
+    "   <use_integer_stages>1</use_integer_stages> "
+    "   <optimize_tails_assay>1</optimize_tails_assay> "
+    "   <min_tails_assay>0.001</min_tails_assay> "
+    "   <max_tails_assay>0.004</max_tails_assay> ";
+
+  int simdur = 1;
+  cyclus::MockSim sim(cyclus::AgentSpec(":misoenrichment:MIsoEnrich"),
+                      config, simdur);
+  sim.AddRecipe(feed_recipe, recipe);
+  sim.AddRecipe("enriched_U_recipe", misotest::comp_weapongradeU());
+  sim.AddSink("enriched_U").recipe("enriched_U_recipe")
+                           .Finalize();
+  int id = sim.Run();
+
+  std::vector<Cond> conds;
+  conds.push_back(Cond("Commodity", "==", std::string("enriched_U")));
+  QueryResult qr = sim.db().Query("Transactions", &conds);
+  ASSERT_EQ(qr.rows.size(), 1);
+  Material::Ptr m = sim.GetMaterial(qr.GetVal<int>("ResourceId"));
+  EXPECT_GT(m->quantity(), 0.5755);
+}
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 TEST_F(MIsoEnrichTest, TailsTrade) {
   std::string config =
@@ -14,13 +14,11 @@ namespace misotest {
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 bool CompareCompMap(cyclus::CompMap cm1, cyclus::CompMap cm2) {
-  std::vector<int> isotopes(IsotopesNucID());
-  std::vector<int>::iterator it;
   // The following for-loop has been added to ensure that the all of the
   // uranium keys are present in both compmaps, else the comparison fails.
-  for (it = isotopes.begin(); it != isotopes.end(); it++) {
-    cm1[*it] += 1e-299;
-    cm2[*it] += 1e-299;
+  for (int nuc_id : IsotopesNucID()) {
+    cm1[nuc_id] += 1e-299;
+    cm2[nuc_id] += 1e-299;
   }
 
   bool result = cyclus::compmath::AlmostEq(cm1, cm2, kEpsCompMap);
@@ -96,40 +94,6 @@ cyclus::Material::Ptr mat_natU() {
 
 }  // namespace misotest
 
-// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-const std::vector<int> IsotopesNucID() {
-  int iso[6] = {232, 233, 234, 235, 236, 238};
-  std::vector<int> isotopes(iso, iso + sizeof(iso)/sizeof(int));
-  for (int& i : isotopes) {
-    i = (92*1000 + i) * 10000;
-  }
-  return isotopes;
-}
-
-// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-int IsotopeToNucID(int isotope) {
-  std::vector<int> isotopes = {232, 233, 234, 235, 236, 238};
-  std::vector<int>::iterator it;
-
-  it = std::find(isotopes.begin(), isotopes.end(), isotope);
-  if (it == isotopes.end()) {
-    throw cyclus::ValueError("Invalid (non-uranium) isotope!");
-  }
-  return (92*1000 + isotope) * 10000;
-}
-
-// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-int NucIDToIsotope(int nuc_id) {
-  std::vector<int> isotopes(IsotopesNucID());
-  std::vector<int>::iterator it;
-
-  it = std::find(isotopes.begin(), isotopes.end(), nuc_id);
-  if (it == isotopes.end()) {
-    throw cyclus::ValueError("Invalid (non-uranium) isotope!");
-  }
-  return nuc_id/10000 - 92*1000;
-}
-
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 int ResBufIdx(
     const std::vector<cyclus::Composition::Ptr>& buf_compositions,
@@ -198,8 +162,6 @@ double MIsoAssay(cyclus::CompMap compmap) {
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 double MIsoFrac(cyclus::CompMap compmap, int isotope) {
-  std::vector<int> isotopes(IsotopesNucID());
-
   double isotope_assay = 0;
   double uranium_atom_frac = 0;
 
@@ -210,11 +172,13 @@ double MIsoFrac(cyclus::CompMap compmap, int isotope) {
   }
   // Get total uranium mole fraction, all non-uranium elements are not
   // considered here as they are directly sent to the tails.
-  for (int i : isotopes) {
-    if (compmap.find(i) != compmap.end()) {
-      uranium_atom_frac += compmap.at(i);
+  for (int idx = 0; idx < kNumIsotopes; idx++) {
+    int i = IsotopeNucID<UraniumIsotopes>(idx);
+    cyclus::CompMap::const_iterator it = compmap.find(i);
+    if (it != compmap.end()) {
+      uranium_atom_frac += it->second;
       if (i==isotope) {
-        isotope_assay = compmap.at(i);
+        isotope_assay = it->second;
       }
     }
   }
@@ -223,34 +187,38 @@ double MIsoFrac(cyclus::CompMap compmap, int isotope) {
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-std::map<int,double> CalculateSeparationFactor(double gamma_235,
-                                               std::string enrichment_process) {
-  std::vector<int> uranium_nuc_ids(IsotopesNucID());
-  std::map<int,double> separation_factors;
-
-  const double mass_hexafluoride = 6 * 19;
-
-  // We consider U-238 to be the key component hence the mass differences
-  // are calculated with respect to this isotope.
-  if (enrichment_process == "centrifuge") {
-    for (int n : uranium_nuc_ids) {
-      double delta_mass = 238. - NucIDToIsotope(n);
-      double gamma = 1. + delta_mass*(gamma_235-1.) / (238.-235.);
-      separation_factors[n] = gamma;
+IsotopeArray CompMapToIsotopeArray(const cyclus::CompMap& compmap) {
+  IsotopeArray isotope_array;
+  isotope_array.fill(0.);
+
+  double uranium_atom_frac = 0;
+  for (int i = 0; i < kNumIsotopes; i++) {
+    cyclus::CompMap::const_iterator it = compmap.find(
+        IsotopeNucID<UraniumIsotopes>(i));
+    if (it != compmap.end()) {
+      isotope_array[i] = it->second;
+      uranium_atom_frac += it->second;
     }
-  } else if (enrichment_process == "diffusion") {
-    for (int n : uranium_nuc_ids) {
-      double uranium_mass = NucIDToIsotope(n) + mass_hexafluoride;
-      double key_isotope_mass = 238. + mass_hexafluoride;
-      separation_factors[n] = std::sqrt(key_isotope_mass / uranium_mass);
+  }
+  if (uranium_atom_frac > 0) {
+    for (double& x : isotope_array) {
+      x /= uranium_atom_frac;
     }
-  } else {
-    std::stringstream ss;
-    ss << "'enrichment_process' is " << enrichment_process
-       << ". However, it must be either 'centrifuge' or 'diffusion'.";
-    throw cyclus::ValueError(ss.str());
   }
-  return separation_factors;
+  return isotope_array;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+cyclus::CompMap IsotopeArrayToCompMap(const IsotopeArray& isotope_array,
+                                      bool drop_zeros) {
+  cyclus::CompMap compmap;
+  for (int i = 0; i < kNumIsotopes; i++) {
+    if (drop_zeros && !(isotope_array[i] > 0)) {
+      continue;
+    }
+    compmap[IsotopeNucID<UraniumIsotopes>(i)] = isotope_array[i];
+  }
+  return compmap;
 }
 
 } // namespace misoenrichment
@@ -1,13 +1,18 @@
 #ifndef MISOENRICHMENT_SRC_MISO_HELPER_H_
 #define MISOENRICHMENT_SRC_MISO_HELPER_H_
 
+#include <array>
 #include <map>
 #include <string>
 #include <vector>
 
 #include "composition.h"
+#include "error.h"
 #include "material.h"
 
+#include "core_error.h"
+#include "core_helper.h"
+
 namespace misoenrichment {
 
 namespace misotest {
@@ -23,11 +28,7 @@ cyclus::Material::Ptr mat_natU();
 
 const double kEpsDouble = 1e-5;
 const double kEpsCompMap = 1e-5;
-const int kIterMax = 200;
 
-const std::vector<int> IsotopesNucID();
-int IsotopeToNucID(int isotope);
-int NucIDToIsotope(int nuc_id);
 int ResBufIdx(
     const std::vector<cyclus::Composition::Ptr>& buf_compositions,
     const cyclus::Composition::Ptr& in_comp);
@@ -48,20 +49,32 @@ double MIsoMassFrac(cyclus::Material::Ptr rsrc, int isotope);
 double MIsoAssay(cyclus::CompMap compmap);
 double MIsoFrac(cyclus::CompMap compmap, int isotope);
 
-// Calculates the stage separation factor for all isotopes starting from
-// the given U235 overall separation factor.
-//
-// Returns a map containing the stage separation factors for all U isotopes
-// with the keys being the isotopes' mass.
-//
-// Note that the stage separation factor is defined as the ratio of
-// abundance ratio in product to abundance ratio in tails. This method
-// follows Houston G. Wood 'Effects of Separation Processes on Minor
-// Uranium Isotopes in Enrichment Cascades'. In: Science and Global
-// Security, 16:26--36 (2008). ISSN: 0892-9882.
-// DOI: 10.1080/08929880802361796
-std::map<int,double> CalculateSeparationFactor(double gamma_235,
-                                               std::string enrichment_process);
+// Converts a CompMap into an IsotopeArray containing the uranium fractions
+// normalised to the total uranium content. All non-uranium nuclides are
+// ignored.
+IsotopeArray CompMapToIsotopeArray(const cyclus::CompMap& compmap);
+
+// Converts an IsotopeArray into a CompMap. If `drop_zeros` is true, then
+// isotopes with a zero fraction are not added to the CompMap.
+cyclus::CompMap IsotopeArrayToCompMap(const IsotopeArray& isotope_array,
+                                      bool drop_zeros=false);
+
+// Returns `f()` and rethrows the exceptions of the Cyclus-free core (see
+// core_error.h) as the corresponding Cyclus exceptions. The archetypes use
+// it where they call into the core, such that the kernel reports the
+// errors as for any other archetype.
+template <typename F>
+auto CyclusErrors(F f) -> decltype(f()) {
+  try {
+    return f();
+  } catch (const KeyError& e) {
+    throw cyclus::KeyError(e.msg());
+  } catch (const ValueError& e) {
+    throw cyclus::ValueError(e.msg());
+  } catch (const Error& e) {
+    throw cyclus::Error(e.msg());
+  }
+}
 
 }  // namespace misoenrichment
 
@@ -25,7 +25,7 @@ TEST(MIsoHelperTest, ChooseCorrectResBuf) {
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 TEST(MIsoHelperTest, NucIDConversion) {
-  std::vector<int> isotopes(IsotopesNucID());
+  const std::array<int, kNumIsotopes>& isotopes = IsotopesNucID();
 
   for (int i : isotopes) {
     int isotope = NucIDToIsotope(i);
@@ -64,9 +64,29 @@ TEST(MIsoHelperTest, CheckFractionsMaterial) {
   EXPECT_DOUBLE_EQ(MIsoMassFrac(mat, 922350000), expected_mass235);
 }
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST(MIsoHelperTest, IsotopeArrayConversion) {
+  cyclus::CompMap cm;
+  cm[10010000] = 0.5;
+  cm[922350000] = 0.1;
+  cm[922380000] = 0.4;
+
+  IsotopeArray isotope_array = CompMapToIsotopeArray(cm);
+  EXPECT_DOUBLE_EQ(isotope_array[kIdx235], 0.2);
+  EXPECT_DOUBLE_EQ(isotope_array[kIdx238], 0.8);
+  EXPECT_DOUBLE_EQ(isotope_array[0], 0.);
+
+  cyclus::CompMap all_isotopes = IsotopeArrayToCompMap(isotope_array);
+  cyclus::CompMap non_zero = IsotopeArrayToCompMap(isotope_array, true);
+  EXPECT_EQ(all_isotopes.size(), kNumIsotopes);
+  EXPECT_EQ(non_zero.size(), 2);
+  EXPECT_DOUBLE_EQ(non_zero[922350000], 0.2);
+  EXPECT_DOUBLE_EQ(MIsoAssay(all_isotopes), MIsoAssay(cm));
+}
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 TEST(MIsoHelperTest, SeparationFactorInput) {
-  EXPECT_THROW(CalculateSeparationFactor(1.0, "test"), cyclus::ValueError);
+  EXPECT_THROW(CalculateSeparationFactor(1.0, "test"), ValueError);
   EXPECT_NO_THROW(CalculateSeparationFactor(1.0, "diffusion"));
   EXPECT_NO_THROW(CalculateSeparationFactor(1.0, "centrifuge"));
 }
@@ -79,7 +99,7 @@ TEST(MIsoHelperTest, SeparationFactorCentrifuge) {
   std::map<int,double> separation_factor = CalculateSeparationFactor(
       gamma_235, method);
 
-  std::vector<int> isotopes(IsotopesNucID());
+  const std::array<int, kNumIsotopes>& isotopes = IsotopesNucID();
   std::map<int,double> expected;
   expected[922320000] = 2.2;
   expected[922330000] = 2.0;
@@ -100,7 +120,7 @@ TEST(MIsoHelperTest, SeparationFactorDiffusion) {
   std::map<int,double> separation_factor = CalculateSeparationFactor(
       gamma_235, method);
 
-  std::vector<int> isotopes(IsotopesNucID());
+  const std::array<int, kNumIsotopes>& isotopes = IsotopesNucID();
   std::map<int,double> expected;
 
   expected[922320000] = 1.008633253697;
@@ -0,0 +1,360 @@
+#include "stage_cascade.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <sstream>
+
+#include "cascade_design.h"
+#include "core_error.h"
+
+namespace misoenrichment {
+
+// The stage compositions are considered converged once none of them
+// changes by more than this relative amount within one iteration.
+const double kStageCompositionTol = 1e-12;
+const int kMaxStageIterations = 10000;
+// The search for the cut stops once the bracket or the relative deviation
+// of the separative work is smaller than this value.
+const double kStageCutTol = 1e-10;
+const int kMaxStageCutIterations = 100;
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+EnrichmentModel EnrichmentModelFromString(const std::string& name) {
+  if (name == "matched_abundance_ratio") {
+    return EnrichmentModel::kMatchedAbundanceRatio;
+  } else if (name == "stage_by_stage") {
+    return EnrichmentModel::kStageByStage;
+  }
+  std::stringstream ss;
+  ss << "'enrichment_model' is " << name << ". However, it must be either "
+     << "'matched_abundance_ratio' or 'stage_by_stage'.";
+  throw ValueError(ss.str());
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+std::string EnrichmentModelName(EnrichmentModel model) {
+  switch (model) {
+    case EnrichmentModel::kMatchedAbundanceRatio:
+      return "matched_abundance_ratio";
+    case EnrichmentModel::kStageByStage:
+      return "stage_by_stage";
+  }
+  throw ValueError("Unknown enrichment model.");
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void SolveTridiagonal(const std::vector<double>& lower,
+                      const std::vector<double>& diag,
+                      const std::vector<double>& upper,
+                      std::vector<double>& rhs,
+                      std::vector<double>& scratch) {
+  int n = rhs.size();
+  if (n == 0) {
+    return;
+  }
+  scratch.resize(n);
+
+  // Forward elimination, `scratch` holds the modified upper diagonal.
+  scratch[0] = n > 1 ? upper[0] / diag[0] : 0;
+  rhs[0] /= diag[0];
+  for (int k = 1; k < n; k++) {
+    double pivot = diag[k] - lower[k]*scratch[k-1];
+    scratch[k] = k < n-1 ? upper[k] / pivot : 0;
+    rhs[k] = (rhs[k] - lower[k]*rhs[k-1]) / pivot;
+  }
+  // Back substitution
+  for (int k = n-2; k >= 0; k--) {
+    rhs[k] -= scratch[k] * rhs[k+1];
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Calculates the fractions `heads_fractions` of each isotope entering a
+// stage with `composition` that leave the stage via the heads.
+//
+// With y and x being the heads and tails compositions, y_i / x_i = alpha_i
+// / S must hold for all isotopes, where S follows from the normalisation
+// of both streams:
+//   sum_i alpha_i z_i / (cut alpha_i + (1-cut) S) = 1.
+// The left-hand side decreases monotonically in S and the root lies
+// between the smallest and the largest separation factor of the isotopes
+// present, such that a safeguarded Newton iteration is used.
+void StageHeadsFractions(const IsotopeArray& separation_factors,
+                         const IsotopeArray& composition, double cut,
+                         IsotopeArray& heads_fractions) {
+  double s_min = 0;
+  double s_max = 0;
+  double s = 0;
+  bool first = true;
+  for (int i = 0; i < kNumIsotopes; i++) {
+    if (composition[i] > 0) {
+      s_min = first ? separation_factors[i]
+                    : std::min(s_min, separation_factors[i]);
+      s_max = first ? separation_factors[i]
+                    : std::max(s_max, separation_factors[i]);
+      first = false;
+      s += separation_factors[i] * composition[i];
+    }
+  }
+
+  for (int iter = 0; iter < 100 && s_max - s_min > 0; iter++) {
+    double g = -1;
+    double dg = 0;
+    for (int i = 0; i < kNumIsotopes; i++) {
+      double denominator = cut*separation_factors[i] + (1.-cut)*s;
+      double term = separation_factors[i] * composition[i] / denominator;
+      g += term;
+      dg -= term * (1.-cut) / denominator;
+    }
+    if (g > 0) {
+      s_min = s;
+    } else {
+      s_max = s;
+    }
+    double s_new = dg < 0 ? s - g/dg : s;
+    if (!(s_new > s_min && s_new < s_max)) {
+      s_new = 0.5 * (s_min+s_max);
+    }
+    bool converged = std::abs(s_new-s) <= 1e-15 * s;
+    s = s_new;
+    if (converged) {
+      break;
+    }
+  }
+  for (int i = 0; i < kNumIsotopes; i++) {
+    double heads = cut * separation_factors[i];
+    heads_fractions[i] = heads / (heads + (1.-cut)*s);
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Performs the simulation described in `SimulateStageCascade`, using the
+// stage compositions stored in `result` as initial guess.
+void SimulateStageCascadeFrom(const IsotopeArray& separation_factors,
+                              const IsotopeArray& feed_composition,
+                              StageCascadeResult& result) {
+  const int n_stages = result.n_enriching + result.n_stripping;
+  const int feed_stage = result.n_stripping;
+
+  std::vector<IsotopeArray> heads_fractions(n_stages);
+  std::array<std::vector<double>, kNumIsotopes> isotope_flows;
+  std::vector<double> lower(n_stages);
+  std::vector<double> diag(n_stages, 1.);
+  std::vector<double> upper(n_stages);
+  std::vector<double> scratch(n_stages);
+
+  bool converged = false;
+  result.iterations = 0;
+  while (!converged && result.iterations < kMaxStageIterations) {
+    result.iterations++;
+    for (int k = 0; k < n_stages; k++) {
+      StageHeadsFractions(separation_factors, result.stage_compositions[k],
+                          result.cut, heads_fractions[k]);
+    }
+    // Flow f_k of isotope i entering stage k:
+    //   f_k = h_{k-1} f_{k-1} + (1-h_{k+1}) f_{k+1} + feed_k,
+    // with h being the heads fractions of the isotope.
+    for (int i = 0; i < kNumIsotopes; i++) {
+      std::vector<double>& flows = isotope_flows[i];
+      flows.assign(n_stages, 0.);
+      if (!(feed_composition[i] > 0)) {
+        continue;
+      }
+      for (int k = 0; k < n_stages; k++) {
+        lower[k] = k > 0 ? -heads_fractions[k-1][i] : 0;
+        upper[k] = k < n_stages-1 ? heads_fractions[k+1][i] - 1. : 0;
+      }
+      flows[feed_stage] = feed_composition[i];
+      SolveTridiagonal(lower, diag, upper, flows, scratch);
+    }
+
+    converged = true;
+    for (int k = 0; k < n_stages; k++) {
+      double stage_flow = 0;
+      for (int i = 0; i < kNumIsotopes; i++) {
+        stage_flow += isotope_flows[i][k];
+      }
+      result.stage_flows[k] = stage_flow;
+      for (int i = 0; i < kNumIsotopes; i++) {
+        double new_fraction = isotope_flows[i][k] / stage_flow;
+        double& fraction = result.stage_compositions[k][i];
+        converged = converged && !(std::abs(new_fraction-fraction)
+                                   > kStageCompositionTol*new_fraction);
+        fraction = new_fraction;
+      }
+    }
+  }
+  if (!converged) {
+    throw Error("Stage compositions of the cascade did not converge!");
+  }
+
+  // The heads of the top stage form the product, the tails of the bottom
+  // stage form the tails of the cascade.
+  IsotopeArray product;
+  IsotopeArray tails;
+  result.product_per_feed = 0;
+  result.tails_per_feed = 0;
+  for (int i = 0; i < kNumIsotopes; i++) {
+    product[i] = heads_fractions[n_stages-1][i]
+                 * isotope_flows[i][n_stages-1];
+    tails[i] = (1.-heads_fractions[0][i]) * isotope_flows[i][0];
+    result.product_per_feed += product[i];
+    result.tails_per_feed += tails[i];
+  }
+  for (int i = 0; i < kNumIsotopes; i++) {
+    result.product_composition[i] = product[i] / result.product_per_feed;
+    result.tails_composition[i] = tails[i] / result.tails_per_feed;
+  }
+
+  // Separative work of each stage: value of the heads and tails leaving it
+  // minus the value of the stream entering it.
+  IsotopeArray value_coefficients;
+  std::array<bool, kNumIsotopes> value_log_term;
+  ValueFunctionCoefficients(separation_factors, value_coefficients,
+                            value_log_term);
+  result.swu_per_feed = 0;
+  for (int k = 0; k < n_stages; k++) {
+    IsotopeArray heads_composition;
+    IsotopeArray tails_composition;
+    double heads_flow = 0;
+    double tails_flow = 0;
+    for (int i = 0; i < kNumIsotopes; i++) {
+      heads_composition[i] = heads_fractions[k][i] * isotope_flows[i][k];
+      tails_composition[i] = isotope_flows[i][k] - heads_composition[i];
+      heads_flow += heads_composition[i];
+      tails_flow += tails_composition[i];
+    }
+    for (int i = 0; i < kNumIsotopes; i++) {
+      heads_composition[i] /= heads_flow;
+      tails_composition[i] /= tails_flow;
+    }
+    result.swu_per_feed +=
+        heads_flow*ValueFunction(heads_composition, value_coefficients,
+                                 value_log_term)
+        + tails_flow*ValueFunction(tails_composition, value_coefficients,
+                                   value_log_term)
+        - result.stage_flows[k]*ValueFunction(result.stage_compositions[k],
+                                              value_coefficients,
+                                              value_log_term);
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+StageCascadeResult InitialStageCascade(const IsotopeArray& feed_composition,
+                                       int n_enriching, int n_stripping,
+                                       double cut) {
+  if (n_enriching < 1 || n_stripping < 0) {
+    throw ValueError(
+      "A cascade needs at least one enriching stage and a non-negative "
+      "number of stripping stages."
+    );
+  }
+  if (!(cut > 0 && cut < 1)) {
+    throw ValueError("The stage cut must lie between 0 and 1.");
+  }
+  StageCascadeResult result;
+  result.n_enriching = n_enriching;
+  result.n_stripping = n_stripping;
+  result.cut = cut;
+  result.iterations = 0;
+  result.swu_per_feed = 0;
+  result.stage_flows.assign(n_enriching+n_stripping, 0.);
+  result.stage_compositions.assign(n_enriching+n_stripping,
+                                   feed_composition);
+  return result;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+StageCascadeResult SimulateStageCascade(
+    const IsotopeArray& separation_factors,
+    const IsotopeArray& feed_composition, int n_enriching, int n_stripping,
+    double cut) {
+  StageCascadeResult result = InitialStageCascade(
+      feed_composition, n_enriching, n_stripping, cut);
+  SimulateStageCascadeFrom(separation_factors, feed_composition, result);
+  return result;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+StageCascadeResult StageCascadeForSeparativeWork(
+    const IsotopeArray& separation_factors,
+    const IsotopeArray& feed_composition, int n_enriching, int n_stripping,
+    double swu_per_feed) {
+  if (!(swu_per_feed > 0)) {
+    throw ValueError(
+      "The separative work per unit of feed must be positive."
+    );
+  }
+  // Below a cut of 0.5, the separative work of the stages increases
+  // monotonically with the cut, it vanishes for a vanishing cut. The
+  // search starts from the cut of an ideal stage processing a stream with
+  // a small U235 content and uses the Illinois variant of the regula falsi
+  // method: a secant step within the bracket, where the residual at the
+  // end of the bracket that was kept twice in a row is halved. Each
+  // simulation starts from the stage compositions of the previous one.
+  const double kMaxCut = 0.5;
+  StageCascadeResult result = InitialStageCascade(
+      feed_composition, n_enriching, n_stripping,
+      1. / (1.+std::sqrt(separation_factors[kIdx235])));
+  SimulateStageCascadeFrom(separation_factors, feed_composition, result);
+
+  // For very small cuts, the flows reaching the top of the cascade may
+  // underflow, the resulting NaN is treated as no separative work.
+  auto residual = [&result, swu_per_feed]() {
+    return std::isnan(result.swu_per_feed) ? -swu_per_feed
+                                           : result.swu_per_feed-swu_per_feed;
+  };
+  double cut_min = 0;
+  double residual_min = -swu_per_feed;
+  double cut_max = kMaxCut;
+  double residual_max = residual();
+  if (residual_max < 0) {
+    cut_min = result.cut;
+    residual_min = residual_max;
+    result.cut = kMaxCut;
+    SimulateStageCascadeFrom(separation_factors, feed_composition, result);
+    residual_max = residual();
+    if (residual_max < 0) {
+      std::stringstream msg;
+      msg << "The stages of the cascade cannot perform " << swu_per_feed
+          << " units of separative work per unit of feed, at most "
+          << result.swu_per_feed << " are reached with a cut of "
+          << kMaxCut << ".";
+      throw Error(msg.str());
+    }
+  } else {
+    cut_max = result.cut;
+  }
+
+  int kept = 0;  // -1 (+1) if the lower (upper) end was kept last time
+  for (int iter = 0; iter < kMaxStageCutIterations; iter++) {
+    if (std::abs(result.swu_per_feed-swu_per_feed)
+          <= kStageCutTol*swu_per_feed
+        || cut_max-cut_min <= kStageCutTol*cut_max) {
+      return result;
+    }
+    double cut = cut_max - residual_max * (cut_max-cut_min)
+                           / (residual_max-residual_min);
+    if (!(cut > cut_min && cut < cut_max)) {
+      cut = 0.5 * (cut_min+cut_max);
+    }
+    result.cut = cut;
+    SimulateStageCascadeFrom(separation_factors, feed_composition, result);
+    double new_residual = residual();
+    if (new_residual < 0) {
+      cut_min = cut;
+      residual_min = new_residual;
+      residual_max *= kept == 1 ? 0.5 : 1.;
+      kept = 1;
+    } else {
+      cut_max = cut;
+      residual_max = new_residual;
+      residual_min *= kept == -1 ? 0.5 : 1.;
+      kept = -1;
+    }
+  }
+  throw Error("Unable to determine the cut of the stages!");
+}
+
+}  // namespace misoenrichment
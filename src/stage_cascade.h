@@ -0,0 +1,99 @@
+#ifndef MISOENRICHMENT_SRC_STAGE_CASCADE_H_
+#define MISOENRICHMENT_SRC_STAGE_CASCADE_H_
+
+#include <string>
+#include <vector>
+
+#include "core_helper.h"
+
+namespace misoenrichment {
+
+// Models available to calculate the product and tails compositions of a
+// cascade once its staging has been determined.
+//
+// - kMatchedAbundanceRatio: ideal matched abundance ratio cascade, solved
+//   analytically (E. von Halle, see `CascadeDesign`).
+// - kStageByStage: the staging of the matched abundance ratio cascade is
+//   kept, but all stages operate at one common cut, i.e., streams with
+//   different compositions get mixed. The cut is chosen such that the
+//   stages perform the same separative work per unit of feed as the ones
+//   of the matched abundance ratio cascade, i.e., the cascade consists of
+//   the same machines. Part of this separative work is lost when mixing
+//   the streams, such that the cascade separates less than the ideal one.
+//   The cascade is resolved stage by stage, see `SimulateStageCascade`.
+enum class EnrichmentModel { kMatchedAbundanceRatio, kStageByStage };
+
+// Converts 'matched_abundance_ratio' or 'stage_by_stage' into the
+// corresponding model. Throws a ValueError for any other name.
+EnrichmentModel EnrichmentModelFromString(const std::string& name);
+std::string EnrichmentModelName(EnrichmentModel model);
+
+// Solves the tridiagonal system
+//   lower[k] x[k-1] + diag[k] x[k] + upper[k] x[k+1] = rhs[k]
+// in O(n) using the Thomas algorithm, with lower[0] and upper[n-1] not
+// being used. The system must not require pivoting, e.g., it must be
+// diagonally dominant. Upon return, `rhs` holds the solution x, `scratch`
+// is resized and used as temporary storage.
+void SolveTridiagonal(const std::vector<double>& lower,
+                      const std::vector<double>& diag,
+                      const std::vector<double>& upper,
+                      std::vector<double>& rhs,
+                      std::vector<double>& scratch);
+
+// Stage-resolved state of a cascade, all flows are given per unit of
+// cascade feed. Stage 0 is the bottom stage (delivering the tails), the
+// feed enters stage `n_stripping` and the last stage delivers the product.
+struct StageCascadeResult {
+  int n_enriching;
+  int n_stripping;
+  double cut;  // Heads flow divided by the flow entering, for all stages
+  int iterations;  // Number of fixed-point iterations needed
+
+  // Flow entering each stage and its composition (atom fractions, see
+  // `IsotopeArray`).
+  std::vector<double> stage_flows;
+  std::vector<IsotopeArray> stage_compositions;
+
+  IsotopeArray product_composition;
+  IsotopeArray tails_composition;
+  double product_per_feed;
+  double tails_per_feed;
+
+  // Separative work performed by all stages, calculated from the stage
+  // flows and the value functions (see `ValueFunction`) of the streams
+  // entering and leaving each stage. It exceeds the separative work of the
+  // product and tails due to the mixing losses.
+  double swu_per_feed;
+};
+
+// Simulates a counter-current cascade consisting of `n_enriching` +
+// `n_stripping` stages, all of them operating at the same `cut`. In each
+// stage, the heads-to-tails abundance ratio of isotope i relative to U238
+// is given by `separation_factors[i]`.
+//
+// The stage-wise mass balance of each isotope forms a tridiagonal system
+// which is solved using `SolveTridiagonal`. The separation in a stage
+// depends on the composition entering it, hence the systems are solved
+// repeatedly until the stage compositions converge. Each iteration costs
+// O(stages x isotopes).
+//
+// Throws a ValueError for invalid arguments and an Error if
+// the stage compositions do not converge.
+StageCascadeResult SimulateStageCascade(
+    const IsotopeArray& separation_factors,
+    const IsotopeArray& feed_composition, int n_enriching, int n_stripping,
+    double cut);
+
+// Simulates the cascade described above at the common stage cut for
+// which the stages perform `swu_per_feed` units of separative work per
+// unit of feed. The cut is searched for below 0.5 using a safeguarded
+// secant method. Throws a ValueError if `swu_per_feed` is not positive and
+// an Error if the stages cannot perform that much separative work.
+StageCascadeResult StageCascadeForSeparativeWork(
+    const IsotopeArray& separation_factors,
+    const IsotopeArray& feed_composition, int n_enriching, int n_stripping,
+    double swu_per_feed);
+
+}  // namespace misoenrichment
+
+#endif  // MISOENRICHMENT_SRC_STAGE_CASCADE_H_
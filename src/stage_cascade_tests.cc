@@ -0,0 +1,138 @@
+#include <gtest/gtest.h>
+
+#include <array>
+#include <cmath>
+#include <vector>
+
+#include "cascade_design.h"
+#include "core_error.h"
+#include "core_helper.h"
+#include "enrichment_process.h"
+#include "stage_cascade.h"
+
+namespace misoenrichment {
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST(StageCascadeTest, EnrichmentModelFromString) {
+  EXPECT_EQ(EnrichmentModelFromString("matched_abundance_ratio"),
+            EnrichmentModel::kMatchedAbundanceRatio);
+  EXPECT_EQ(EnrichmentModelFromString("stage_by_stage"),
+            EnrichmentModel::kStageByStage);
+  EXPECT_EQ(EnrichmentModelName(EnrichmentModel::kStageByStage),
+            "stage_by_stage");
+  EXPECT_THROW(EnrichmentModelFromString("ideal"), ValueError);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST(StageCascadeTest, SolveTridiagonal) {
+  std::vector<double> lower({0, -1, -1, -1});
+  std::vector<double> diag({4, 4, 4, 4});
+  std::vector<double> upper({-1, -1, -1, 0});
+  std::vector<double> expected({1, 2, 3, 4});
+  std::vector<double> rhs(4);
+  for (int k = 0; k < 4; k++) {
+    rhs[k] = diag[k] * expected[k];
+    rhs[k] += k > 0 ? lower[k] * expected[k-1] : 0;
+    rhs[k] += k < 3 ? upper[k] * expected[k+1] : 0;
+  }
+  std::vector<double> scratch;
+  SolveTridiagonal(lower, diag, upper, rhs, scratch);
+  for (int k = 0; k < 4; k++) {
+    EXPECT_NEAR(rhs[k], expected[k], 1e-14);
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST(StageCascadeTest, MassBalance) {
+  IsotopeArray feed = misotest::NaturalUranium();
+  IsotopeArray separation_factors = SeparationFactors(
+      1.3, EnrichmentProcess::kCentrifuge);
+  StageCascadeResult result = SimulateStageCascade(separation_factors, feed,
+                                                   20, 10, 0.47);
+
+  ASSERT_EQ(result.stage_flows.size(), 30);
+  EXPECT_NEAR(result.product_per_feed + result.tails_per_feed, 1, 1e-12);
+  for (int i = 0; i < kNumIsotopes; i++) {
+    EXPECT_NEAR(result.product_per_feed*result.product_composition[i]
+                + result.tails_per_feed*result.tails_composition[i],
+                feed[i], 1e-14);
+  }
+  // U235 gets enriched from stage to stage.
+  for (int k = 1; k < 30; k++) {
+    EXPECT_TRUE(result.stage_compositions[k][kIdx235]
+                > result.stage_compositions[k-1][kIdx235]);
+  }
+  EXPECT_TRUE(result.product_composition[kIdx235] > feed[kIdx235]);
+  EXPECT_TRUE(result.tails_composition[kIdx235] < feed[kIdx235]);
+
+  // Part of the separative work of the stages is lost by mixing.
+  IsotopeArray coefficients;
+  std::array<bool, kNumIsotopes> log_term;
+  ValueFunctionCoefficients(separation_factors, coefficients, log_term);
+  double delivered_swu =
+      result.product_per_feed * ValueFunction(result.product_composition,
+                                              coefficients, log_term)
+      + result.tails_per_feed * ValueFunction(result.tails_composition,
+                                              coefficients, log_term)
+      - ValueFunction(feed, coefficients, log_term);
+  EXPECT_GT(delivered_swu, 0);
+  EXPECT_LT(delivered_swu, result.swu_per_feed);
+
+  EXPECT_THROW(SimulateStageCascade(separation_factors, feed, 0, 10, 0.47),
+               ValueError);
+  EXPECT_THROW(SimulateStageCascade(separation_factors, feed, 20, 10, 1.),
+               ValueError);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST(StageCascadeTest, SeparativeWork) {
+  IsotopeArray feed = misotest::NaturalUranium();
+  IsotopeArray separation_factors = SeparationFactors(
+      1.3, EnrichmentProcess::kCentrifuge);
+  IsotopeArray log_alpha_star;
+  IsotopeArray alpha_star = AlphaStar(1.3, EnrichmentProcess::kCentrifuge);
+  for (int i = 0; i < kNumIsotopes; i++) {
+    log_alpha_star[i] = std::log(alpha_star[i]);
+  }
+  IsotopeArray coefficients;
+  std::array<bool, kNumIsotopes> log_term;
+  ValueFunctionCoefficients(separation_factors, coefficients, log_term);
+
+  // Matched abundance ratio cascades for low and for highly enriched
+  // uranium.
+  for (int n_enriching : {15, 56}) {
+    IsotopeArray product;
+    IsotopeArray tails;
+    double sum_e;
+    double sum_s;
+    CalculateConcentrations(log_alpha_star, feed, double(n_enriching), 6.,
+                            product, tails, sum_e, sum_s);
+    double swu_per_feed =
+        sum_e * ValueFunction(product, coefficients, log_term)
+        + sum_s * ValueFunction(tails, coefficients, log_term)
+        - ValueFunction(feed, coefficients, log_term);
+
+    StageCascadeResult result = StageCascadeForSeparativeWork(
+        separation_factors, feed, n_enriching, 6, swu_per_feed);
+    EXPECT_NEAR(result.swu_per_feed, swu_per_feed, 1e-10*swu_per_feed);
+    EXPECT_LT(result.cut, 0.5);
+    StageCascadeResult resimulated = SimulateStageCascade(
+        separation_factors, feed, n_enriching, 6, result.cut);
+    EXPECT_NEAR(resimulated.swu_per_feed, swu_per_feed, 1e-9*swu_per_feed);
+
+    // The same machines separate less than in the ideal cascade: the
+    // tails assay is higher and less product is obtained per unit of
+    // feed.
+    EXPECT_GT(result.tails_composition[kIdx235], tails[kIdx235]);
+    EXPECT_LT(result.product_per_feed, sum_e);
+  }
+
+  EXPECT_THROW(StageCascadeForSeparativeWork(separation_factors, feed, 56,
+                                             6, 0.),
+               ValueError);
+  EXPECT_THROW(StageCascadeForSeparativeWork(separation_factors, feed, 56,
+                                             6, 1e3),
+               Error);
+}
+
+}  // namespace misoenrichment
@@ -0,0 +1,143 @@
+#include "tails_assay_search.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+#include "core_error.h"
+
+namespace misoenrichment {
+
+// 1 / golden ratio
+const double kInverseGoldenRatio = 0.5 * (std::sqrt(5.) - 1.);
+
+namespace {
+
+// Enrichment at a grid point of the tails assays.
+struct GridPoint {
+  double score;
+  // Number of stripping stages, infinite if the tails assay is infeasible
+  // (i.e., too low to be reached).
+  double n_stripping;
+  EnrichmentResult result;
+};
+
+}  // namespace
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+double OptimalTailsAssay(const TailsAssaySearch& search,
+                         const EnrichmentInput& input,
+                         EnrichmentResult& result) {
+  double upper_bound = std::min({search.max_tails_assay,
+                                 input.feed_composition[kIdx235],
+                                 input.product_assay});
+  // Grid points min_tails_assay + k*kTailsAssayStep with k = 0, ..., n_max,
+  // all of them lying strictly below `upper_bound`.
+  int n_max = std::ceil((upper_bound-search.min_tails_assay)
+                        / kTailsAssayStep) - 1;
+  auto tails_assay = [&search](int k) {
+    return search.min_tails_assay + k*kTailsAssayStep;
+  };
+  std::stringstream infeasible;
+  infeasible << "No feasible tails assay between " << search.min_tails_assay
+             << " and " << upper_bound << " for a product assay of "
+             << input.product_assay << ".";
+  if (n_max < 0) {
+    throw ValueError(infeasible.str());
+  }
+
+  bool minimise_cost = search.feed_cost > 0 || search.swu_cost > 0;
+  // Each grid point is evaluated at most once.
+  std::map<int, GridPoint> points;
+  auto evaluate = [&](int k) -> const GridPoint& {
+    std::map<int, GridPoint>::iterator it = points.find(k);
+    if (it != points.end()) {
+      return it->second;
+    }
+    GridPoint& point = points[k];
+    point.score = -std::numeric_limits<double>::infinity();
+    point.n_stripping = std::numeric_limits<double>::infinity();
+    EnrichmentInput grid_input = input;
+    grid_input.tails_assay = tails_assay(k);
+    try {
+      point.result = EvaluateEnrichment(grid_input);
+    } catch (Error& e) {
+      // No staging reaches the targets, the tails assay is infeasible.
+      return point;
+    }
+    point.n_stripping = point.result.n_stripping;
+    const CascadeFlows& flows = point.result.flows;
+    if (!minimise_cost) {
+      point.score = flows.product_qty;
+    } else if (flows.product_qty > 0) {
+      point.score = -(search.feed_cost*flows.feed_qty
+                      + search.swu_cost*flows.swu) / flows.product_qty;
+    }
+    return point;
+  };
+
+  if (input.use_integer_stages) {
+    // The number of stripping stages does not increase with the tails
+    // assay. If it is the same at two grid points, then so is the
+    // enrichment in between. Else, the interval is bisected until the
+    // grid points at which the staging changes are found.
+    std::vector<std::pair<int, int>> intervals(1, std::make_pair(0, n_max));
+    while (!intervals.empty()) {
+      int lower = intervals.back().first;
+      int upper = intervals.back().second;
+      intervals.pop_back();
+      if (evaluate(lower).n_stripping == evaluate(upper).n_stripping
+          || upper - lower < 2) {
+        continue;
+      }
+      int middle = (lower + upper) / 2;
+      intervals.push_back(std::make_pair(middle, upper));
+      intervals.push_back(std::make_pair(lower, middle));
+    }
+  } else {
+    // Golden section search.
+    int lower = 0;
+    int upper = n_max;
+    while (upper - lower > 3) {
+      int width = upper - lower;
+      int inner_lower = upper - static_cast<int>(std::lround(
+          kInverseGoldenRatio*width));
+      int inner_upper = lower + static_cast<int>(std::lround(
+          kInverseGoldenRatio*width));
+      // Infeasible tails assays are too low to be reached, hence the
+      // search continues towards higher tails assays.
+      double score_lower = evaluate(inner_lower).score;
+      if (score_lower >= evaluate(inner_upper).score
+          && !std::isinf(score_lower)) {
+        upper = inner_upper;
+      } else {
+        lower = inner_lower;
+      }
+    }
+    for (int k = lower; k <= upper; k++) {
+      evaluate(k);
+    }
+  }
+
+  // With an integer staging, the first grid point of each interval of
+  // constant staging has been evaluated. Only strictly better scores are
+  // accepted, such that ties go to the lowest tails assay.
+  std::map<int, GridPoint>::const_iterator best = points.begin();
+  for (std::map<int, GridPoint>::const_iterator it = points.begin();
+       it != points.end(); ++it) {
+    if (it->second.score > best->second.score) {
+      best = it;
+    }
+  }
+  if (std::isinf(best->second.score)) {
+    throw ValueError(infeasible.str());
+  }
+  result = best->second.result;
+  return tails_assay(best->first);
+}
+
+}  // namespace misoenrichment
@@ -0,0 +1,53 @@
+#ifndef MISOENRICHMENT_SRC_TAILS_ASSAY_SEARCH_H_
+#define MISOENRICHMENT_SRC_TAILS_ASSAY_SEARCH_H_
+
+#include "cascade_calculator.h"
+
+namespace misoenrichment {
+
+// Spacing of the tails assays evaluated by `OptimalTailsAssay`. Using a
+// fixed grid means that repeated searches (e.g., when bidding, when
+// evaluating the capacity constraints and when trading) evaluate the same
+// tails assays and thus reuse the cascade designs from the `CascadeCache`.
+const double kTailsAssayStep = 1e-5;
+
+// Settings of the optimal tails assay search.
+struct TailsAssaySearch {
+  bool enabled;
+  double min_tails_assay;
+  double max_tails_assay;
+  // If both costs are zero, then the product is maximised. Else, the cost
+  // per unit of product, (feed_cost*feed + swu_cost*SWU) / product, is
+  // minimised.
+  double feed_cost;  // per kg of feed
+  double swu_cost;  // per kg SWU
+};
+
+// Returns the tails assay in [search.min_tails_assay, search.max_tails_assay]
+// optimising the enrichment described by `input`, see `TailsAssaySearch`
+// for the objective. The tails assay of `input` is ignored and tails
+// assays exceeding the feed or product assay are not considered. Only the
+// grid of tails assays (see `kTailsAssayStep`) is evaluated. Ties are
+// resolved towards lower tails assays, i.e., feed is saved at the expense
+// of separative work. Tails assays whose targets cannot be reached (see
+// `EvaluateEnrichment`) are infeasible.
+//
+// With an integer number of stages, the staging and thus the objective are
+// constant between the tails assays at which the number of stripping
+// stages changes. These intervals are located using bisections and each
+// one is scored once, such that the optimum over the grid is found. With a
+// non-integer staging, a golden section search is used, needing O(log(n))
+// enrichment calculations for n grid points. Low tails assays are limited
+// by the separative work and high ones by the feed, but the objective is
+// not guaranteed to be unimodal, hence the result may be a local optimum.
+//
+// The enrichments are calculated using `EvaluateEnrichment`, the search is
+// thus reentrant as well. Upon return, `result` holds the enrichment at the
+// optimal tails assay. Throws a ValueError if no tails assay is feasible.
+double OptimalTailsAssay(const TailsAssaySearch& search,
+                         const EnrichmentInput& input,
+                         EnrichmentResult& result);
+
+}  // namespace misoenrichment
+
+#endif  // MISOENRICHMENT_SRC_TAILS_ASSAY_SEARCH_H_
@@ -0,0 +1,155 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <set>
+
+#include "cascade_calculator.h"
+#include "core_error.h"
+#include "core_helper.h"
+#include "tails_assay_search.h"
+
+namespace misoenrichment {
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TailsAssaySearch DefaultSearch(double feed_cost, double swu_cost) {
+  TailsAssaySearch search;
+  search.enabled = true;
+  search.min_tails_assay = 0.001;
+  search.max_tails_assay = 0.004;
+  search.feed_cost = feed_cost;
+  search.swu_cost = swu_cost;
+  return search;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Enrichment of natural uranium to 5% with the given constraints.
+EnrichmentInput DefaultInput(double feed_qty, double product_qty,
+                             double max_swu, bool use_integer_stages) {
+  EnrichmentInput input;
+  input.feed_composition = misotest::NaturalUranium();
+  input.product_assay = 0.05;
+  input.feed_qty = feed_qty;
+  input.product_qty = product_qty;
+  input.max_swu = max_swu;
+  input.use_downblending = false;
+  input.use_integer_stages = use_integer_stages;
+  return input;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Returns the objective of `search` (to be maximised) for the enrichment
+// described by `input` at the given tails assay.
+double Objective(const TailsAssaySearch& search, EnrichmentInput input,
+                 double tails_assay) {
+  input.tails_assay = tails_assay;
+  CascadeFlows flows = EvaluateEnrichment(input).flows;
+  if (search.feed_cost > 0 || search.swu_cost > 0) {
+    return -(search.feed_cost*flows.feed_qty + search.swu_cost*flows.swu)
+           / flows.product_qty;
+  }
+  return flows.product_qty;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST(TailsAssaySearchTest, MaximiseProduct) {
+  // With both feed and SWU being limited, the product is maximal where
+  // both constraints are binding. The search must find the same tails
+  // assay as an exhaustive search over the grid.
+  TailsAssaySearch search = DefaultSearch(0, 0);
+  for (double max_swu : {50., 150., 400.}) {
+    EnrichmentInput input = DefaultInput(100, 1e299, max_swu, false);
+    EnrichmentResult result;
+    double tails_assay = OptimalTailsAssay(search, input, result);
+
+    double best_product = 0;
+    for (int k = 0; k < 300; k++) {
+      double t = search.min_tails_assay + k*kTailsAssayStep;
+      best_product = std::max(best_product, Objective(search, input, t));
+    }
+    EXPECT_NEAR(result.flows.product_qty, best_product, 1e-9*best_product);
+    EXPECT_DOUBLE_EQ(result.flows.product_qty,
+                     Objective(search, input, tails_assay));
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST(TailsAssaySearchTest, MinimiseCost) {
+  // Unconstrained enrichment: the classical optimal tails assay, which
+  // increases with the ratio of the SWU to the feed cost.
+  double previous_tails_assay = 0;
+  for (double swu_cost : {50., 150., 400.}) {
+    TailsAssaySearch search = DefaultSearch(100, swu_cost);
+    EnrichmentInput input = DefaultInput(1e299, 10, 1e299, false);
+    EnrichmentResult result;
+    double tails_assay = OptimalTailsAssay(search, input, result);
+
+    double best_objective = -1e299;
+    for (int k = 0; k < 300; k++) {
+      double t = search.min_tails_assay + k*kTailsAssayStep;
+      best_objective = std::max(best_objective, Objective(search, input, t));
+    }
+    EXPECT_NEAR(Objective(search, input, tails_assay), best_objective,
+                1e-9*std::abs(best_objective));
+    EXPECT_TRUE(tails_assay > previous_tails_assay);
+    previous_tails_assay = tails_assay;
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST(TailsAssaySearchTest, IntegerStaging) {
+  // With an integer staging, the objective is piecewise constant and jumps
+  // whenever a stripping stage is added. The search must find the best
+  // interval (and therein the lowest tails assay) of an exhaustive search,
+  // also for ties and for infeasible grid points at the lower end.
+  for (double min_tails_assay : {0.001, 1e-7}) {
+    for (double max_swu : {50., 150., 400.}) {
+      for (double swu_cost : {0., 150.}) {
+        TailsAssaySearch search = DefaultSearch(swu_cost > 0 ? 100 : 0,
+                                                swu_cost);
+        search.min_tails_assay = min_tails_assay;
+        EnrichmentInput input = DefaultInput(100, 1e299, max_swu, true);
+        EnrichmentResult result;
+        double tails_assay = OptimalTailsAssay(search, input, result);
+
+        int n_grid = std::ceil((search.max_tails_assay-min_tails_assay)
+                               / kTailsAssayStep);
+        double best_tails_assay = 0;
+        double best_objective = -1e299;
+        std::set<double> stagings;
+        for (int k = 0; k < n_grid; k++) {
+          double t = min_tails_assay + k*kTailsAssayStep;
+          input.tails_assay = t;
+          try {
+            stagings.insert(EvaluateEnrichment(input).n_stripping);
+          } catch (Error& e) {
+            continue;
+          }
+          double objective = Objective(search, input, t);
+          if (objective > best_objective) {
+            best_objective = objective;
+            best_tails_assay = t;
+          }
+        }
+        ASSERT_GT(stagings.size(), 2);
+        EXPECT_EQ(best_tails_assay, tails_assay);
+        EXPECT_EQ(best_objective, Objective(search, input, tails_assay));
+        input.tails_assay = tails_assay;
+        EXPECT_EQ(EvaluateEnrichment(input).flows.swu, result.flows.swu);
+      }
+    }
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST(TailsAssaySearchTest, Infeasible) {
+  TailsAssaySearch search = DefaultSearch(0, 0);
+  search.min_tails_assay = 0.008;
+  search.max_tails_assay = 0.01;
+  EnrichmentInput input = DefaultInput(100, 1e299, 1e299, true);
+  input.use_downblending = true;
+  EnrichmentResult result;
+  EXPECT_THROW(OptimalTailsAssay(search, input, result), ValueError);
+}
+
+}  // namespace misoenrichment